@@ -0,0 +1,268 @@
+// Asynchronous file reads and writes, through io_uring where the kernel allows it
+// PackLab - CS213 - Northwestern University
+
+#define _DEFAULT_SOURCE // syscall, pread/pwrite, MAP_POPULATE
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "async-io.h"
+#include "unpack-utilities.h"
+
+// Largest buffer the kernel accepts for registration
+#define MAX_REGISTERED_LEN ((size_t)1 << 30)
+
+
+// --- helper functions ---
+
+static bool setup_io_uring(async_io_t* io) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = (int)syscall(__NR_io_uring_setup, io->depth, &params);
+  if (ring_fd < 0) {
+    return false;
+  }
+
+  io->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  io->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap && io->cq_ring_len > io->sq_ring_len) {
+    io->sq_ring_len = io->cq_ring_len;
+  }
+  io->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  io->sq_ring = mmap(NULL, io->sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd, IORING_OFF_SQ_RING);
+  io->cq_ring = single_mmap ? io->sq_ring :
+                mmap(NULL, io->cq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd, IORING_OFF_CQ_RING);
+  io->sqes    = mmap(NULL, io->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd, IORING_OFF_SQES);
+  if (io->sq_ring == MAP_FAILED || io->cq_ring == MAP_FAILED || io->sqes == MAP_FAILED) {
+    if (io->sq_ring != MAP_FAILED) munmap(io->sq_ring, io->sq_ring_len);
+    if (!single_mmap && io->cq_ring != MAP_FAILED) munmap(io->cq_ring, io->cq_ring_len);
+    if (io->sqes != MAP_FAILED) munmap(io->sqes, io->sqes_len);
+    close(ring_fd);
+    return false;
+  }
+  if (single_mmap) {
+    io->cq_ring_len = 0; // unmapped along with the submission ring
+  }
+
+  uint8_t* sq = io->sq_ring;
+  uint8_t* cq = io->cq_ring;
+  io->sq_head  = (unsigned*)(void*)&sq[params.sq_off.head];
+  io->sq_tail  = (unsigned*)(void*)&sq[params.sq_off.tail];
+  io->sq_mask  = (unsigned*)(void*)&sq[params.sq_off.ring_mask];
+  io->sq_array = (unsigned*)(void*)&sq[params.sq_off.array];
+  io->cq_head  = (unsigned*)(void*)&cq[params.cq_off.head];
+  io->cq_tail  = (unsigned*)(void*)&cq[params.cq_off.tail];
+  io->cq_mask  = (unsigned*)(void*)&cq[params.cq_off.ring_mask];
+  io->cqes     = &cq[params.cq_off.cqes];
+  io->ring_fd  = ring_fd;
+  return true;
+}
+
+// Puts (the rest of) a request on the submission ring and tells the kernel
+static void queue_request(async_io_t* io, unsigned slot) {
+  async_io_request_t* request = &io->requests[slot];
+
+  // only this thread moves the tail, so a plain read of it is fine
+  unsigned tail  = *io->sq_tail;
+  unsigned index = tail & *io->sq_mask;
+  struct io_uring_sqe* sqe = &((struct io_uring_sqe*)io->sqes)[index];
+  memset(sqe, 0, sizeof(*sqe));
+
+  uint8_t* buffer = &request->buffer[request->done];
+  size_t len = request->len - request->done;
+  bool is_fixed = io->registered != NULL && buffer >= io->registered &&
+                  buffer + len <= io->registered + io->registered_len;
+  if (request->is_write) {
+    sqe->opcode = is_fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+  } else {
+    sqe->opcode = is_fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  }
+  sqe->fd        = request->fd;
+  sqe->addr      = (uint64_t)(uintptr_t)buffer;
+  sqe->len       = (uint32_t)len;
+  sqe->off       = request->offset + request->done;
+  sqe->buf_index = 0;
+  sqe->user_data = slot;
+
+  io->sq_array[index] = index;
+  __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  // if this fails (e.g. EINTR), the entry is picked up by the next async_io_wait()
+  syscall(__NR_io_uring_enter, io->ring_fd, 1, 0, 0, NULL, 0);
+}
+
+// Runs a request to completion with plain pread/pwrite
+static void run_request(async_io_request_t* request) {
+  while (request->done < request->len) {
+    uint8_t* buffer = &request->buffer[request->done];
+    size_t len = request->len - request->done;
+    off_t offset = (off_t)(request->offset + request->done);
+    ssize_t got = request->is_write ? pwrite(request->fd, buffer, len, offset) :
+                                      pread(request->fd, buffer, len, offset);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got < 0) {
+      request->result = -errno;
+      return;
+    }
+    if (got == 0) {
+      break;
+    }
+    request->done += got;
+  }
+  request->result = request->done;
+}
+
+static void submit(async_io_t* io, bool is_write, int fd, uint8_t* buffer, size_t len, uint64_t offset,
+                   void* tag) {
+  if (!async_io_can_submit(io)) {
+    error_and_exit("ERROR: too many I/O requests in flight\n");
+  }
+
+  unsigned slot = 0;
+  while (io->requests[slot].in_use) {
+    slot++;
+  }
+  async_io_request_t* request = &io->requests[slot];
+  memset(request, 0, sizeof(*request));
+  request->in_use   = true;
+  request->is_write = is_write;
+  request->fd       = fd;
+  request->buffer   = buffer;
+  request->len      = len;
+  request->offset   = offset;
+  request->tag      = tag;
+  io->in_flight++;
+
+  if (io->uses_io_uring) {
+    queue_request(io, slot);
+  } else {
+    run_request(request);
+  }
+}
+
+static void* collect(async_io_t* io, unsigned slot, int64_t* result) {
+  async_io_request_t* request = &io->requests[slot];
+  *result = request->result;
+  request->in_use = false;
+  io->in_flight--;
+  return request->tag;
+}
+
+
+// --- public functions ---
+
+void async_io_init(async_io_t* io, unsigned queue_depth, bool allow_io_uring) {
+  memset(io, 0, sizeof(*io));
+  io->depth   = (queue_depth == 0) ? 1 : (queue_depth > ASYNC_IO_MAX_DEPTH) ? ASYNC_IO_MAX_DEPTH : queue_depth;
+  io->ring_fd = -1;
+  io->uses_io_uring = allow_io_uring && setup_io_uring(io);
+}
+
+void async_io_free(async_io_t* io) {
+  if (!io->uses_io_uring) {
+    return;
+  }
+  munmap(io->sqes, io->sqes_len);
+  if (io->cq_ring_len > 0) {
+    munmap(io->cq_ring, io->cq_ring_len);
+  }
+  munmap(io->sq_ring, io->sq_ring_len);
+  // closing the ring also drops any registered buffer
+  close(io->ring_fd);
+  io->uses_io_uring = false;
+}
+
+bool async_io_register_buffer(async_io_t* io, uint8_t* buffer, size_t len) {
+  if (!io->uses_io_uring || buffer == NULL || len == 0 || len > MAX_REGISTERED_LEN) {
+    return false;
+  }
+  if (io->registered != NULL) {
+    syscall(__NR_io_uring_register, io->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    io->registered = NULL;
+  }
+
+  struct iovec iov = { .iov_base = buffer, .iov_len = len };
+  if (syscall(__NR_io_uring_register, io->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) != 0) {
+    return false;
+  }
+  io->registered     = buffer;
+  io->registered_len = len;
+  return true;
+}
+
+bool async_io_can_submit(async_io_t* io) {
+  return io->in_flight < io->depth;
+}
+
+void async_io_submit_read(async_io_t* io, int fd, uint8_t* buffer, size_t len, uint64_t offset, void* tag) {
+  submit(io, false, fd, buffer, len, offset, tag);
+}
+
+void async_io_submit_write(async_io_t* io, int fd, uint8_t* buffer, size_t len, uint64_t offset, void* tag) {
+  submit(io, true, fd, buffer, len, offset, tag);
+}
+
+void* async_io_wait(async_io_t* io, int64_t* result) {
+  if (io->in_flight == 0) {
+    error_and_exit("ERROR: waited on I/O with nothing in flight\n");
+  }
+
+  if (!io->uses_io_uring) {
+    // already done at submission; hand them back oldest slot first
+    unsigned slot = 0;
+    while (!io->requests[slot].in_use) {
+      slot++;
+    }
+    return collect(io, slot, result);
+  }
+
+  while (true) {
+    unsigned head = *io->cq_head;
+    unsigned tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+      // also (re)submits anything a failed enter left on the ring
+      unsigned unsubmitted = *io->sq_tail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE);
+      syscall(__NR_io_uring_enter, io->ring_fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      continue;
+    }
+
+    struct io_uring_cqe* cqe = &((struct io_uring_cqe*)io->cqes)[head & *io->cq_mask];
+    unsigned slot = (unsigned)cqe->user_data;
+    int32_t res   = cqe->res;
+    __atomic_store_n(io->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    async_io_request_t* request = &io->requests[slot];
+    if (res == -EINTR || res == -EAGAIN) {
+      queue_request(io, slot);
+      continue;
+    }
+    if (res < 0) {
+      request->result = res;
+      return collect(io, slot, result);
+    }
+
+    request->done += res;
+    if (res > 0 && request->done < request->len) {
+      // short transfer: go again for the rest
+      queue_request(io, slot);
+      continue;
+    }
+    request->result = request->done;
+    return collect(io, slot, result);
+  }
+}
@@ -0,0 +1,86 @@
+// Asynchronous file reads and writes, through io_uring where the kernel allows it
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+// Definitions
+#define ASYNC_IO_MAX_DEPTH 64 // most requests in flight at once
+
+
+// One read or write that has been submitted and not yet collected
+typedef struct {
+  bool in_use;
+  bool is_write;
+  int fd;
+  uint8_t* buffer;
+  size_t len;
+  uint64_t offset;
+  size_t done;  // bytes transferred so far (short transfers are resubmitted)
+  int64_t result;
+  void* tag;
+} async_io_request_t;
+
+// Queue of in-flight requests
+// With io_uring, requests really run in the background, up to `depth` at a
+// time. Without it (old kernel, seccomp, or disallowed), each request is run
+// with pread/pwrite when submitted and simply reported as done on the next wait
+typedef struct {
+  bool uses_io_uring;
+  unsigned depth;
+  unsigned in_flight;
+  async_io_request_t requests[ASYNC_IO_MAX_DEPTH];
+
+  // io_uring rings, shared with the kernel
+  int ring_fd;
+  void* sq_ring;
+  size_t sq_ring_len;
+  void* cq_ring;
+  size_t cq_ring_len;
+  void* sqes;
+  size_t sqes_len;
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned* cq_mask;
+  void* cqes;
+
+  // buffer registered with the kernel, so requests inside it skip page pinning
+  uint8_t* registered;
+  size_t registered_len;
+} async_io_t;
+
+
+// Sets up a queue allowing `queue_depth` requests in flight (at most ASYNC_IO_MAX_DEPTH)
+// Uses io_uring if `allow_io_uring` and the kernel supports it, else pread/pwrite
+void async_io_init(async_io_t* io, unsigned queue_depth, bool allow_io_uring);
+
+// Tears the queue down. Every request must have been collected
+void async_io_free(async_io_t* io);
+
+// Registers one buffer that later requests will mostly fall within
+// Returns false (harmlessly) if the kernel would not take it
+bool async_io_register_buffer(async_io_t* io, uint8_t* buffer, size_t len);
+
+// Whether another request may be submitted right now
+bool async_io_can_submit(async_io_t* io);
+
+// Starts reading `len` bytes at `offset` of `fd` into `buffer`
+// Only allowed when async_io_can_submit(). `tag` is handed back by async_io_wait()
+void async_io_submit_read(async_io_t* io, int fd, uint8_t* buffer, size_t len, uint64_t offset, void* tag);
+
+// Starts writing `len` bytes from `buffer` at `offset` of `fd`
+// Only allowed when async_io_can_submit(). `tag` is handed back by async_io_wait()
+void async_io_submit_write(async_io_t* io, int fd, uint8_t* buffer, size_t len, uint64_t offset, void* tag);
+
+// Waits for any one request to finish and returns its tag
+// `result` gets the bytes transferred (less than asked only at end of file)
+// or a negative errno value
+// Must only be called with requests in flight
+void* async_io_wait(async_io_t* io, int64_t* result);
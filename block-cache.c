@@ -0,0 +1,316 @@
+// Cache of decoded blocks for repeated random reads
+// PackLab - CS213 - Northwestern University
+
+#define _POSIX_C_SOURCE 200809L // fstat st_mtim
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "block-cache.h"
+#include "unpack-utilities.h"
+
+
+// One cached block. Entries live on two lists at once:
+//  - the hash chain of their bucket (next_in_bucket)
+//  - the shard's LRU list (lru_prev/lru_next), most recently used at the head
+typedef struct block_cache_entry {
+  block_cache_key_t key;
+  uint64_t hash;
+  size_t len;
+
+  struct block_cache_entry* next_in_bucket;
+  struct block_cache_entry* lru_prev;
+  struct block_cache_entry* lru_next;
+
+  uint8_t data[];
+} block_cache_entry_t;
+
+typedef struct {
+  pthread_mutex_t lock;
+
+  block_cache_entry_t** buckets;
+  size_t bucket_count; // always a power of two
+
+  block_cache_entry_t* lru_head;
+  block_cache_entry_t* lru_tail;
+
+  size_t budget;
+  block_cache_stats_t stats;
+} block_cache_shard_t;
+
+struct block_cache {
+  block_cache_shard_t shards[BLOCK_CACHE_SHARDS];
+};
+
+
+// --- helper functions ---
+
+static uint64_t hash_file(const block_cache_key_t* key) {
+  uint64_t hash = mix64(0, key->device);
+  hash = mix64(hash, key->inode);
+  hash = mix64(hash, key->file_size);
+  return mix64(hash, key->mtime_ns);
+}
+
+static uint64_t hash_key(const block_cache_key_t* key) {
+  return mix64(mix64(hash_file(key), key->encryption_key), key->block_number);
+}
+
+static bool same_file(const block_cache_key_t* a, const block_cache_key_t* b) {
+  return a->device == b->device && a->inode == b->inode &&
+         a->file_size == b->file_size && a->mtime_ns == b->mtime_ns;
+}
+
+static bool same_key(const block_cache_key_t* a, const block_cache_key_t* b) {
+  return same_file(a, b) && a->encryption_key == b->encryption_key && a->block_number == b->block_number;
+}
+
+// Blocks of one file are spread across shards by block number, so that
+// concurrent readers of neighbouring blocks take different locks
+static block_cache_shard_t* shard_for(block_cache_t* cache, uint64_t hash) {
+  return &cache->shards[(hash >> 32) % BLOCK_CACHE_SHARDS];
+}
+
+static void lru_unlink(block_cache_shard_t* shard, block_cache_entry_t* entry) {
+  if (entry->lru_prev != NULL) {
+    entry->lru_prev->lru_next = entry->lru_next;
+  } else {
+    shard->lru_head = entry->lru_next;
+  }
+  if (entry->lru_next != NULL) {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  } else {
+    shard->lru_tail = entry->lru_prev;
+  }
+  entry->lru_prev = NULL;
+  entry->lru_next = NULL;
+}
+
+static void lru_push_front(block_cache_shard_t* shard, block_cache_entry_t* entry) {
+  entry->lru_prev = NULL;
+  entry->lru_next = shard->lru_head;
+  if (shard->lru_head != NULL) {
+    shard->lru_head->lru_prev = entry;
+  }
+  shard->lru_head = entry;
+  if (shard->lru_tail == NULL) {
+    shard->lru_tail = entry;
+  }
+}
+
+// Returns the link pointing at the entry for `key`, or at the NULL ending its chain
+static block_cache_entry_t** find_link(block_cache_shard_t* shard, const block_cache_key_t* key,
+                                       uint64_t hash) {
+  block_cache_entry_t** link = &shard->buckets[hash & (shard->bucket_count - 1)];
+  while (*link != NULL && ((*link)->hash != hash || !same_key(&(*link)->key, key))) {
+    link = &(*link)->next_in_bucket;
+  }
+  return link;
+}
+
+// Removes an entry from both lists and frees it
+static void remove_entry(block_cache_shard_t* shard, block_cache_entry_t* entry) {
+  block_cache_entry_t** link = find_link(shard, &entry->key, entry->hash);
+  *link = entry->next_in_bucket;
+  lru_unlink(shard, entry);
+
+  shard->stats.bytes_used -= entry->len;
+  shard->stats.entries--;
+  free(entry);
+}
+
+// Doubles the bucket array once the chains get longer than one entry on average
+static void maybe_grow(block_cache_shard_t* shard) {
+  if (shard->stats.entries <= shard->bucket_count) {
+    return;
+  }
+
+  size_t new_count = shard->bucket_count * 2;
+  block_cache_entry_t** new_buckets = malloc_and_check(new_count * sizeof(*new_buckets));
+  memset(new_buckets, 0, new_count * sizeof(*new_buckets));
+
+  for (size_t i = 0; i < shard->bucket_count; i++) {
+    block_cache_entry_t* entry = shard->buckets[i];
+    while (entry != NULL) {
+      block_cache_entry_t* next = entry->next_in_bucket;
+      size_t slot = entry->hash & (new_count - 1);
+      entry->next_in_bucket = new_buckets[slot];
+      new_buckets[slot] = entry;
+      entry = next;
+    }
+  }
+
+  free(shard->buckets);
+  shard->buckets      = new_buckets;
+  shard->bucket_count = new_count;
+}
+
+
+// --- public functions ---
+
+block_cache_t* block_cache_create(size_t memory_budget) {
+  block_cache_t* cache = malloc_and_check(sizeof(*cache));
+  memset(cache, 0, sizeof(*cache));
+
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    block_cache_shard_t* shard = &cache->shards[i];
+    if (pthread_mutex_init(&shard->lock, NULL) != 0) {
+      error_and_exit("ERROR: could not create block cache lock\n");
+    }
+    shard->bucket_count = BLOCK_CACHE_MIN_BUCKETS;
+    shard->buckets = malloc_and_check(shard->bucket_count * sizeof(*shard->buckets));
+    memset(shard->buckets, 0, shard->bucket_count * sizeof(*shard->buckets));
+    shard->budget = memory_budget / BLOCK_CACHE_SHARDS;
+  }
+  return cache;
+}
+
+void block_cache_destroy(block_cache_t* cache) {
+  if (cache == NULL) return;
+
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    block_cache_shard_t* shard = &cache->shards[i];
+    block_cache_entry_t* entry = shard->lru_head;
+    while (entry != NULL) {
+      block_cache_entry_t* next = entry->lru_next;
+      free(entry);
+      entry = next;
+    }
+    free(shard->buckets);
+    pthread_mutex_destroy(&shard->lock);
+  }
+  free(cache);
+}
+
+bool block_cache_key_from_fd(int fd, uint64_t block_number, block_cache_key_t* key) {
+  struct stat st;
+  if (key == NULL || fstat(fd, &st) != 0) {
+    return false;
+  }
+
+  memset(key, 0, sizeof(*key));
+  key->device       = (uint64_t)st.st_dev;
+  key->inode        = (uint64_t)st.st_ino;
+  key->file_size    = (uint64_t)st.st_size;
+  key->mtime_ns     = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+  key->block_number = block_number;
+  return true;
+}
+
+bool block_cache_lookup(block_cache_t* cache, const block_cache_key_t* key,
+                        uint8_t* output_data, size_t output_len, size_t* block_len) {
+  if (cache == NULL || key == NULL) return false;
+
+  uint64_t hash = hash_key(key);
+  block_cache_shard_t* shard = shard_for(cache, hash);
+  bool hit = false;
+
+  pthread_mutex_lock(&shard->lock);
+  block_cache_entry_t* entry = *find_link(shard, key, hash);
+  if (entry != NULL && entry->len <= output_len && (output_data != NULL || entry->len == 0)) {
+    if (entry->len > 0) {
+      memcpy(output_data, entry->data, entry->len);
+    }
+    if (block_len != NULL) {
+      *block_len = entry->len;
+    }
+
+    // move to the front so it is evicted last
+    lru_unlink(shard, entry);
+    lru_push_front(shard, entry);
+
+    shard->stats.hits++;
+    hit = true;
+  } else {
+    shard->stats.misses++;
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  return hit;
+}
+
+void block_cache_insert(block_cache_t* cache, const block_cache_key_t* key,
+                        uint8_t* input_data, size_t input_len) {
+  if (cache == NULL || key == NULL || (input_data == NULL && input_len > 0)) return;
+
+  uint64_t hash = hash_key(key);
+  block_cache_shard_t* shard = shard_for(cache, hash);
+  if (input_len > shard->budget) {
+    return; // would evict the entire shard and still not fit
+  }
+
+  // copy outside of the lock, so the critical section is only list surgery
+  block_cache_entry_t* fresh = malloc_and_check(sizeof(*fresh) + input_len);
+  memset(fresh, 0, sizeof(*fresh));
+  fresh->key  = *key;
+  fresh->hash = hash;
+  fresh->len  = input_len;
+  if (input_len > 0) {
+    memcpy(fresh->data, input_data, input_len);
+  }
+
+  pthread_mutex_lock(&shard->lock);
+
+  block_cache_entry_t* existing = *find_link(shard, key, hash);
+  if (existing != NULL) {
+    remove_entry(shard, existing);
+  }
+
+  // evict from the cold end until the new block fits
+  while (shard->lru_tail != NULL && shard->stats.bytes_used + input_len > shard->budget) {
+    remove_entry(shard, shard->lru_tail);
+    shard->stats.evictions++;
+  }
+
+  block_cache_entry_t** link = &shard->buckets[hash & (shard->bucket_count - 1)];
+  fresh->next_in_bucket = *link;
+  *link = fresh;
+  lru_push_front(shard, fresh);
+
+  shard->stats.bytes_used += input_len;
+  shard->stats.entries++;
+  shard->stats.insertions++;
+  maybe_grow(shard);
+
+  pthread_mutex_unlock(&shard->lock);
+}
+
+void block_cache_invalidate_file(block_cache_t* cache, const block_cache_key_t* key) {
+  if (cache == NULL || key == NULL) return;
+
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    block_cache_shard_t* shard = &cache->shards[i];
+    pthread_mutex_lock(&shard->lock);
+    block_cache_entry_t* entry = shard->lru_head;
+    while (entry != NULL) {
+      block_cache_entry_t* next = entry->lru_next;
+      if (same_file(&entry->key, key)) {
+        remove_entry(shard, entry);
+      }
+      entry = next;
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
+
+block_cache_stats_t block_cache_get_stats(block_cache_t* cache) {
+  block_cache_stats_t total = {0};
+  if (cache == NULL) return total;
+
+  for (int i = 0; i < BLOCK_CACHE_SHARDS; i++) {
+    block_cache_shard_t* shard = &cache->shards[i];
+    pthread_mutex_lock(&shard->lock);
+    total.hits       += shard->stats.hits;
+    total.misses     += shard->stats.misses;
+    total.insertions += shard->stats.insertions;
+    total.evictions  += shard->stats.evictions;
+    total.bytes_used += shard->stats.bytes_used;
+    total.entries    += shard->stats.entries;
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return total;
+}
@@ -0,0 +1,77 @@
+// Cache of decoded blocks for repeated random reads
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+// Definitions
+#define BLOCK_CACHE_SHARDS      16 // independent locks, so readers on different blocks rarely contend
+#define BLOCK_CACHE_MIN_BUCKETS 64 // initial hash buckets per shard (grows by doubling)
+
+
+// Identifies one decoded block of one packed file
+// The file identity is (device, inode, size, mtime) so that a file rewritten
+// in place never returns stale blocks from before the rewrite
+typedef struct {
+  uint64_t device;
+  uint64_t inode;
+  uint64_t file_size;
+  uint64_t mtime_ns;
+
+  // key the block was decrypted with (0 if not encrypted), so a block is
+  // only ever handed to whoever could have decoded it the same way
+  uint16_t encryption_key;
+
+  // index of the block within the decoded output of the file
+  uint64_t block_number;
+} block_cache_key_t;
+
+// Counters describing cache behavior since it was created
+typedef struct {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t insertions;
+  uint64_t evictions;
+
+  // bytes of decoded block data currently held (not counting bookkeeping)
+  uint64_t bytes_used;
+  uint64_t entries;
+} block_cache_stats_t;
+
+// Opaque cache handle, safe to share between threads
+typedef struct block_cache block_cache_t;
+
+
+// Creates a cache that holds at most `memory_budget` bytes of decoded data
+// The budget is split evenly across shards
+block_cache_t* block_cache_create(size_t memory_budget);
+
+// Frees the cache and every block it holds
+void block_cache_destroy(block_cache_t* cache);
+
+// Fills in the file identity part of `key` from an open file descriptor
+// (encryption_key is left 0)
+// Returns false if the file could not be examined
+bool block_cache_key_from_fd(int fd, uint64_t block_number, block_cache_key_t* key);
+
+// Looks up a block and copies it into `output_data`
+// Returns true on a hit, writing the block length into `block_len`
+// A block larger than `output_len` is treated as a miss
+bool block_cache_lookup(block_cache_t* cache, const block_cache_key_t* key,
+                        uint8_t* output_data, size_t output_len, size_t* block_len);
+
+// Copies a decoded block into the cache, evicting least recently used blocks
+// of the same shard as needed. Blocks larger than a shard's budget are ignored
+// Replaces any block already cached under the same key
+void block_cache_insert(block_cache_t* cache, const block_cache_key_t* key,
+                        uint8_t* input_data, size_t input_len);
+
+// Drops every cached block belonging to the file identified by `key`
+// (block_number is ignored)
+void block_cache_invalidate_file(block_cache_t* cache, const block_cache_key_t* key);
+
+// Returns a snapshot of the counters summed over all shards
+block_cache_stats_t block_cache_get_stats(block_cache_t* cache);
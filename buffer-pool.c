@@ -0,0 +1,205 @@
+// Pool of large, page-aligned buffers recycled between streams and files
+// PackLab - CS213 - Northwestern University
+
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, MAP_POPULATE, MADV_HUGEPAGE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "buffer-pool.h"
+#include "unpack-utilities.h"
+
+
+// One mapped buffer, either handed out or waiting for reuse
+typedef struct buffer_pool_entry {
+  uint8_t* data;
+  size_t capacity;
+  struct buffer_pool_entry* next;
+} buffer_pool_entry_t;
+
+struct buffer_pool {
+  pthread_mutex_t lock;
+  unsigned options;
+
+  buffer_pool_entry_t* in_use;
+  buffer_pool_entry_t* cached; // oldest put-back first
+  size_t cached_bytes;
+  size_t max_cached_bytes;
+
+  buffer_pool_stats_t stats;
+};
+
+
+// --- helper functions ---
+
+// Size classes: powers of two up to one granule, then whole granules
+static size_t capacity_for(size_t len) {
+  if (len <= BUFFER_POOL_GRANULE) {
+    size_t capacity = BUFFER_POOL_MIN_LEN;
+    while (capacity < len) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+  return ((len + BUFFER_POOL_GRANULE - 1) / BUFFER_POOL_GRANULE) * BUFFER_POOL_GRANULE;
+}
+
+static void unmap_entry(buffer_pool_t* pool, buffer_pool_entry_t* entry) {
+  munmap(entry->data, entry->capacity);
+  pool->stats.bytes_mapped -= entry->capacity;
+  pool->stats.unmaps++;
+  free(entry);
+}
+
+// Unlinks and returns the entry whose link is `link`
+static buffer_pool_entry_t* take(buffer_pool_entry_t** link) {
+  buffer_pool_entry_t* entry = *link;
+  *link = entry->next;
+  entry->next = NULL;
+  return entry;
+}
+
+// Finds the smallest cached buffer that fits `capacity` without wasting more
+// than half of itself. Returns the link pointing at it, or NULL
+static buffer_pool_entry_t** best_fit(buffer_pool_t* pool, size_t capacity) {
+  buffer_pool_entry_t** best = NULL;
+  for (buffer_pool_entry_t** link = &pool->cached; *link != NULL; link = &(*link)->next) {
+    size_t have = (*link)->capacity;
+    if (have >= capacity && have / 2 <= capacity && (best == NULL || have < (*best)->capacity)) {
+      best = link;
+    }
+  }
+  return best;
+}
+
+
+// --- public functions ---
+
+buffer_pool_t* buffer_pool_create(size_t max_cached_bytes, unsigned options) {
+  buffer_pool_t* pool = malloc_and_check(sizeof(*pool));
+  memset(pool, 0, sizeof(*pool));
+  if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+    error_and_exit("ERROR: could not create buffer pool lock\n");
+  }
+  pool->options          = options;
+  pool->max_cached_bytes = max_cached_bytes;
+  return pool;
+}
+
+void buffer_pool_destroy(buffer_pool_t* pool) {
+  if (pool == NULL) return;
+
+  buffer_pool_entry_t* lists[] = { pool->in_use, pool->cached };
+  for (int i = 0; i < 2; i++) {
+    buffer_pool_entry_t* entry = lists[i];
+    while (entry != NULL) {
+      buffer_pool_entry_t* next = entry->next;
+      unmap_entry(pool, entry);
+      entry = next;
+    }
+  }
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+uint8_t* buffer_pool_get(buffer_pool_t* pool, size_t len) {
+  size_t capacity = capacity_for(len);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stats.gets++;
+
+  buffer_pool_entry_t* entry = NULL;
+  buffer_pool_entry_t** link = best_fit(pool, capacity);
+  if (link != NULL) {
+    entry = take(link);
+    pool->cached_bytes -= entry->capacity;
+    pool->stats.reuses++;
+  } else {
+    // mapping happens outside the lock; it can take a while with MAP_POPULATE
+    pthread_mutex_unlock(&pool->lock);
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (pool->options & BUFFER_POOL_PREFAULT) {
+      flags |= MAP_POPULATE;
+    }
+    void* data = mmap(NULL, capacity, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (data == MAP_FAILED) {
+      error_and_exit("ERROR: malloc failed\n");
+    }
+    if (pool->options & BUFFER_POOL_HUGE_PAGES) {
+      // only a hint; kernels without transparent huge pages just say no
+      madvise(data, capacity, MADV_HUGEPAGE);
+    }
+
+    entry = malloc_and_check(sizeof(*entry));
+    entry->data     = data;
+    entry->capacity = capacity;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.maps++;
+    pool->stats.bytes_mapped += capacity;
+    if (pool->stats.bytes_mapped > pool->stats.peak_bytes_mapped) {
+      pool->stats.peak_bytes_mapped = pool->stats.bytes_mapped;
+    }
+  }
+
+  entry->next   = pool->in_use;
+  pool->in_use  = entry;
+  pool->stats.bytes_in_use += entry->capacity;
+  if (pool->stats.bytes_in_use > pool->stats.peak_bytes_in_use) {
+    pool->stats.peak_bytes_in_use = pool->stats.bytes_in_use;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return entry->data;
+}
+
+void buffer_pool_put(buffer_pool_t* pool, uint8_t* buffer) {
+  if (buffer == NULL) return;
+
+  pthread_mutex_lock(&pool->lock);
+
+  buffer_pool_entry_t** link = &pool->in_use;
+  while (*link != NULL && (*link)->data != buffer) {
+    link = &(*link)->next;
+  }
+  if (*link == NULL) {
+    pthread_mutex_unlock(&pool->lock);
+    error_and_exit("ERROR: buffer was not from this pool\n");
+  }
+  buffer_pool_entry_t* entry = take(link);
+  pool->stats.bytes_in_use -= entry->capacity;
+
+  // make room by dropping the oldest cached buffers; if it can never fit, drop it
+  while (pool->cached != NULL && pool->cached_bytes + entry->capacity > pool->max_cached_bytes) {
+    buffer_pool_entry_t* oldest = take(&pool->cached);
+    pool->cached_bytes -= oldest->capacity;
+    unmap_entry(pool, oldest);
+  }
+  if (entry->capacity > pool->max_cached_bytes) {
+    unmap_entry(pool, entry);
+  } else {
+    buffer_pool_entry_t** tail = &pool->cached;
+    while (*tail != NULL) {
+      tail = &(*tail)->next;
+    }
+    *tail = entry;
+    pool->cached_bytes += entry->capacity;
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+}
+
+buffer_pool_stats_t buffer_pool_get_stats(buffer_pool_t* pool) {
+  buffer_pool_stats_t stats = {0};
+  if (pool == NULL) return stats;
+
+  pthread_mutex_lock(&pool->lock);
+  stats = pool->stats;
+  pthread_mutex_unlock(&pool->lock);
+  return stats;
+}
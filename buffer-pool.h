@@ -0,0 +1,53 @@
+// Pool of large, page-aligned buffers recycled between streams and files
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+// Definitions
+#define BUFFER_POOL_MIN_LEN (64 * 1024)       // smallest buffer handed out
+#define BUFFER_POOL_GRANULE (2 * 1024 * 1024) // larger buffers are sized in multiples of one huge page
+
+// Options for how new buffers are backed
+#define BUFFER_POOL_HUGE_PAGES 0x1 // ask for transparent huge pages (MADV_HUGEPAGE)
+#define BUFFER_POOL_PREFAULT   0x2 // fault every page in up front (MAP_POPULATE)
+
+
+// Counters describing pool behavior since it was created
+typedef struct {
+  uint64_t gets;
+  uint64_t reuses;   // gets served by a recycled buffer
+  uint64_t maps;     // gets that needed fresh memory from the kernel
+  uint64_t unmaps;   // buffers given back to the kernel
+
+  uint64_t bytes_in_use;      // handed out and not yet put back
+  uint64_t peak_bytes_in_use;
+  uint64_t bytes_mapped;      // in use plus kept for reuse
+  uint64_t peak_bytes_mapped;
+} buffer_pool_stats_t;
+
+// Opaque pool handle, safe to share between threads
+typedef struct buffer_pool buffer_pool_t;
+
+
+// Creates a pool that keeps up to `max_cached_bytes` of put-back buffers for reuse
+// `options` is any of the BUFFER_POOL_* options
+buffer_pool_t* buffer_pool_create(size_t max_cached_bytes, unsigned options);
+
+// Gives every buffer back to the kernel. Buffers still in use must not be touched afterward
+void buffer_pool_destroy(buffer_pool_t* pool);
+
+// Returns a buffer of at least `len` bytes, aligned to a page (and to DATA_ALIGN)
+// Its contents are whatever its last user left (zero if freshly mapped)
+// Exits with an error if memory runs out
+uint8_t* buffer_pool_get(buffer_pool_t* pool, size_t len);
+
+// Puts a buffer from buffer_pool_get() back, for reuse by a later get
+// NULL is ignored
+void buffer_pool_put(buffer_pool_t* pool, uint8_t* buffer);
+
+// Returns a snapshot of the counters
+buffer_pool_stats_t buffer_pool_get_stats(buffer_pool_t* pool);
@@ -0,0 +1,93 @@
+// Run-time detection of the instruction sets kernels may use
+// PackLab - CS213 - Northwestern University
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu-dispatch.h"
+
+static const char* isa_names[CPU_ISA_COUNT] = {
+  "scalar", "sse2", "ssse3", "sse4.2", "avx2", "avx512",
+};
+
+static pthread_once_t active_once = PTHREAD_ONCE_INIT;
+static cpu_isa_t active_isa = CPU_ISA_SCALAR;
+
+
+// --- helper functions ---
+
+static void choose_active_isa(void) {
+  cpu_isa_t detected = cpu_isa_detect();
+  active_isa = detected;
+
+  const char* forced = getenv(CPU_ISA_ENV);
+  if (forced == NULL || forced[0] == '\0') {
+    return;
+  }
+
+  cpu_isa_t isa = CPU_ISA_SCALAR;
+  if (!cpu_isa_parse(forced, &isa)) {
+    fprintf(stderr, "WARNING: unknown %s level \"%s\", using %s\n", CPU_ISA_ENV, forced,
+            cpu_isa_name(detected));
+  } else if (isa > detected) {
+    // running instructions the CPU lacks would just crash
+    fprintf(stderr, "WARNING: this CPU does not support %s=%s, using %s\n", CPU_ISA_ENV, forced,
+            cpu_isa_name(detected));
+  } else {
+    active_isa = isa;
+  }
+}
+
+
+// --- public functions ---
+
+cpu_isa_t cpu_isa_detect(void) {
+#if defined(__x86_64__)
+  // reads CPUID, and XGETBV for whether the OS saves the AVX registers
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("f16c")) {
+    return CPU_ISA_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("f16c")) {
+    return CPU_ISA_AVX2;
+  }
+  if (__builtin_cpu_supports("sse4.2")) {
+    return CPU_ISA_SSE42;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return CPU_ISA_SSSE3;
+  }
+  // part of x86-64 itself
+  return CPU_ISA_SSE2;
+#else
+  return CPU_ISA_SCALAR;
+#endif
+}
+
+cpu_isa_t cpu_isa_active(void) {
+  pthread_once(&active_once, choose_active_isa);
+  return active_isa;
+}
+
+const char* cpu_isa_name(cpu_isa_t isa) {
+  if (isa >= CPU_ISA_COUNT) {
+    return "unknown";
+  }
+  return isa_names[isa];
+}
+
+bool cpu_isa_parse(const char* name, cpu_isa_t* isa) {
+  for (int i = 0; i < CPU_ISA_COUNT; i++) {
+    if (strcmp(name, isa_names[i]) == 0) {
+      *isa = (cpu_isa_t)i;
+      return true;
+    }
+  }
+  return false;
+}
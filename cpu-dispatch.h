@@ -0,0 +1,36 @@
+// Run-time detection of the instruction sets kernels may use
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+
+// Definitions
+#define CPU_ISA_ENV "PACKLAB_ISA" // names a level to use instead of the detected one (e.g. "scalar")
+
+
+// Instruction set levels, in order: each level includes all the ones before it
+typedef enum {
+  CPU_ISA_SCALAR, // plain C only
+  CPU_ISA_SSE2,
+  CPU_ISA_SSSE3,
+  CPU_ISA_SSE42,  // adds the crc32 instruction
+  CPU_ISA_AVX2,   // also requires BMI2 and F16C (every AVX2 part ships them)
+  CPU_ISA_AVX512, // AVX-512 F and BW
+  CPU_ISA_COUNT,
+} cpu_isa_t;
+
+
+// Highest level this CPU (and its OS, which must save the wider registers) supports
+// Always CPU_ISA_SCALAR on non-x86 hosts
+cpu_isa_t cpu_isa_detect(void);
+
+// Level kernels should use: the detected one, unless CPU_ISA_ENV asks for a lower one
+// Worked out once, on first call; later calls return the same level
+cpu_isa_t cpu_isa_active(void);
+
+// Name of a level, as accepted in CPU_ISA_ENV
+const char* cpu_isa_name(cpu_isa_t isa);
+
+// Looks up a level by name. Returns false if there is no such level
+bool cpu_isa_parse(const char* name, cpu_isa_t* isa);
@@ -0,0 +1,297 @@
+// Reading packed file headers without the data, and a catalog that caches them
+// PackLab - CS213 - Northwestern University
+
+#define _POSIX_C_SOURCE 200809L // pread, st_mtim
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "header-catalog.h"
+#include "unpack-utilities.h"
+
+#define MIN_CAPACITY 1024 // initial hash slots (grows by doubling)
+
+
+// One cached file: its identity, then its headers
+// Written to the catalog file as is, so it is zeroed before being filled in
+typedef struct {
+  bool in_use;
+  uint64_t device;
+  uint64_t inode;
+  uint64_t file_size;
+  uint64_t mtime_ns;
+  archive_headers_t headers;
+} catalog_entry_t;
+
+// What precedes the entries in a catalog file
+typedef struct {
+  char magic[8];
+  uint64_t entry_len; // sizeof(catalog_entry_t) of the build that wrote it
+  uint64_t num_entries;
+} catalog_file_header_t;
+
+struct header_catalog {
+  catalog_entry_t* entries; // open addressing, linear probing
+  size_t capacity;          // always a power of two
+  header_catalog_stats_t stats;
+};
+
+
+// --- helper functions ---
+
+static uint64_t mtime_ns(const struct stat* st) {
+  return (uint64_t)st->st_mtim.tv_sec * 1000000000ull + (uint64_t)st->st_mtim.tv_nsec;
+}
+
+// Finds the slot holding the file with this device and inode, or the empty
+// slot where it would go
+static catalog_entry_t* find_slot(header_catalog_t* catalog, uint64_t device, uint64_t inode) {
+  size_t mask = catalog->capacity - 1;
+  size_t slot = mix64(mix64(0, device), inode) & mask;
+  while (catalog->entries[slot].in_use &&
+         (catalog->entries[slot].device != device || catalog->entries[slot].inode != inode)) {
+    slot = (slot + 1) & mask;
+  }
+  return &catalog->entries[slot];
+}
+
+static void allocate_slots(header_catalog_t* catalog, size_t capacity) {
+  catalog->entries  = malloc_and_check(capacity * sizeof(catalog_entry_t));
+  catalog->capacity = capacity;
+  memset(catalog->entries, 0, capacity * sizeof(catalog_entry_t));
+}
+
+// Places an entry, keeping the table at most half full
+static void put_entry(header_catalog_t* catalog, const catalog_entry_t* entry) {
+  if ((catalog->stats.entries + 1) * 2 > catalog->capacity) {
+    catalog_entry_t* old = catalog->entries;
+    size_t old_capacity  = catalog->capacity;
+    allocate_slots(catalog, old_capacity * 2);
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old[i].in_use) {
+        *find_slot(catalog, old[i].device, old[i].inode) = old[i];
+      }
+    }
+    free(old);
+  }
+
+  catalog_entry_t* slot = find_slot(catalog, entry->device, entry->inode);
+  if (!slot->in_use) {
+    catalog->stats.entries++;
+  }
+  *slot = *entry;
+}
+
+// Drops every entry, after a catalog file turned out to be unusable
+static void clear_entries(header_catalog_t* catalog) {
+  memset(catalog->entries, 0, catalog->capacity * sizeof(catalog_entry_t));
+  catalog->stats.entries = 0;
+}
+
+// Parses and checks the header of stream `stream`, found at `offset` in a file
+// of `file_len` bytes, into `headers`. Sets `is_last` if no stream follows
+// Returns NULL if it is fine, or why not
+static const char* check_header(archive_headers_t* headers, uint64_t stream, uint64_t offset,
+                                uint8_t* header_data, size_t header_data_len, uint64_t file_len, bool* is_last) {
+  packlab_config_t* config = &headers->streams[stream];
+  parse_header(header_data, header_data_len, config);
+  if (!config->is_valid) {
+    return "header is invalid";
+  }
+  if (config->header_len > MAX_HEADER_SIZE || config->header_len == 0) {
+    return "header length is invalid";
+  }
+  if (config->should_continue && !config->should_float) {
+    return "continuation outside of float";
+  }
+  if ((stream == 1 && !config->should_float) || (stream == 2 && !config->should_float3)) {
+    return "extra stream is not part of a float layout";
+  }
+  if (stream > 0 && config->is_float64 != headers->streams[0].is_float64) {
+    return "float streams disagree on value size";
+  }
+  if (config->float_transform != FLOAT_TRANSFORM_NONE && !float_transform_allowed(stream, config)) {
+    return "float transform on a stream that can't take one";
+  }
+
+  // the data (and block table) must be inside the file
+  uint64_t data_offset = offset + stream_data_offset(config);
+  uint64_t data_end    = data_offset + config->data_size + block_table_len(config);
+  if (data_end < data_offset || data_end > file_len) {
+    return "stream data extends past end of file";
+  }
+  headers->header_offsets[stream] = offset;
+
+  if (!config->should_continue) {
+    *is_last = true;
+    headers->num_streams = stream + 1;
+    if (headers->num_streams == 2 && config->should_float3) {
+      return "2 stream file, but not valid FP";
+    }
+    if (headers->num_streams == 3 && !config->should_float3) {
+      return "3 stream file, but not valid FP";
+    }
+  }
+  return NULL;
+}
+
+
+// --- public functions ---
+
+const char* read_archive_headers(int fd, uint64_t file_len, archive_headers_t* headers) {
+  memset(headers, 0, sizeof(*headers));
+
+  uint64_t offset = 0;
+  for (uint64_t stream = 0; stream < HEADER_CATALOG_MAX_STREAMS; stream++) {
+    if (offset >= file_len) {
+      return "continuation extends past end of file";
+    }
+
+    // a header always fits in the page it starts
+    uint8_t page[HEADER_ALIGN];
+    size_t want = (file_len - offset < HEADER_ALIGN) ? (size_t)(file_len - offset) : HEADER_ALIGN;
+    if (pread(fd, page, want, (off_t)offset) != (ssize_t)want) {
+      return "could not read header";
+    }
+
+    bool is_last = false;
+    const char* error = check_header(headers, stream, offset, page, want, file_len, &is_last);
+    if (error != NULL || is_last) {
+      return error;
+    }
+    offset = next_header_offset(&headers->streams[stream], offset);
+  }
+
+  return "too many streams";
+}
+
+const char* parse_archive_headers(uint8_t* file_data, uint64_t file_len, archive_headers_t* headers) {
+  memset(headers, 0, sizeof(*headers));
+
+  uint64_t offset = 0;
+  for (uint64_t stream = 0; stream < HEADER_CATALOG_MAX_STREAMS; stream++) {
+    if (offset >= file_len) {
+      return "continuation extends past end of file";
+    }
+
+    bool is_last = false;
+    const char* error = check_header(headers, stream, offset, &file_data[offset], file_len - offset,
+                                     file_len, &is_last);
+    if (error != NULL || is_last) {
+      return error;
+    }
+    offset = next_header_offset(&headers->streams[stream], offset);
+  }
+
+  return "too many streams";
+}
+
+header_catalog_t* header_catalog_load(const char* path) {
+  header_catalog_t* catalog = malloc_and_check(sizeof(*catalog));
+  memset(catalog, 0, sizeof(*catalog));
+  allocate_slots(catalog, MIN_CAPACITY);
+
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    if (errno != ENOENT) {
+      fprintf(stderr, "WARNING: could not open catalog %s, starting an empty one\n", path);
+    }
+    return catalog;
+  }
+
+  catalog_file_header_t file_header;
+  if (fread(&file_header, sizeof(file_header), 1, file) != 1 ||
+      memcmp(file_header.magic, HEADER_CATALOG_MAGIC, sizeof(file_header.magic)) != 0 ||
+      file_header.entry_len != sizeof(catalog_entry_t)) {
+    fprintf(stderr, "WARNING: %s is not a catalog this unpack can read, starting an empty one\n", path);
+    fclose(file);
+    return catalog;
+  }
+
+  for (uint64_t i = 0; i < file_header.num_entries; i++) {
+    catalog_entry_t entry;
+    if (fread(&entry, sizeof(entry), 1, file) != 1 || !entry.in_use ||
+        entry.headers.num_streams == 0 || entry.headers.num_streams > HEADER_CATALOG_MAX_STREAMS) {
+      fprintf(stderr, "WARNING: catalog %s is damaged, starting an empty one\n", path);
+      clear_entries(catalog);
+      break;
+    }
+    put_entry(catalog, &entry);
+  }
+
+  fclose(file);
+  return catalog;
+}
+
+void header_catalog_destroy(header_catalog_t* catalog) {
+  if (catalog == NULL) return;
+
+  free(catalog->entries);
+  free(catalog);
+}
+
+bool header_catalog_lookup(header_catalog_t* catalog, const struct stat* st, archive_headers_t* headers) {
+  catalog_entry_t* entry = find_slot(catalog, (uint64_t)st->st_dev, (uint64_t)st->st_ino);
+  if (!entry->in_use || entry->file_size != (uint64_t)st->st_size || entry->mtime_ns != mtime_ns(st)) {
+    catalog->stats.misses++;
+    return false;
+  }
+
+  *headers = entry->headers;
+  catalog->stats.hits++;
+  return true;
+}
+
+void header_catalog_insert(header_catalog_t* catalog, const struct stat* st, const archive_headers_t* headers) {
+  catalog_entry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.in_use    = true;
+  entry.device    = (uint64_t)st->st_dev;
+  entry.inode     = (uint64_t)st->st_ino;
+  entry.file_size = (uint64_t)st->st_size;
+  entry.mtime_ns  = mtime_ns(st);
+  entry.headers   = *headers;
+  put_entry(catalog, &entry);
+}
+
+bool header_catalog_save(header_catalog_t* catalog, const char* path) {
+  char temp_path[PATH_MAX];
+  if (snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", path, (int)getpid()) >= (int)sizeof(temp_path)) {
+    return false;
+  }
+  FILE* file = fopen(temp_path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  catalog_file_header_t file_header;
+  memset(&file_header, 0, sizeof(file_header));
+  memcpy(file_header.magic, HEADER_CATALOG_MAGIC, sizeof(file_header.magic));
+  file_header.entry_len   = sizeof(catalog_entry_t);
+  file_header.num_entries = catalog->stats.entries;
+
+  bool written = fwrite(&file_header, sizeof(file_header), 1, file) == 1;
+  for (size_t i = 0; i < catalog->capacity && written; i++) {
+    if (catalog->entries[i].in_use) {
+      written = fwrite(&catalog->entries[i], sizeof(catalog_entry_t), 1, file) == 1;
+    }
+  }
+  written = (fclose(file) == 0) && written;
+
+  if (!written || rename(temp_path, path) != 0) {
+    unlink(temp_path);
+    return false;
+  }
+  return true;
+}
+
+header_catalog_stats_t header_catalog_get_stats(header_catalog_t* catalog) {
+  return catalog->stats;
+}
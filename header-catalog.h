@@ -0,0 +1,66 @@
+// Reading packed file headers without the data, and a catalog that caches them
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+#include <sys/stat.h>
+
+#include "unpack-utilities.h"
+
+// Definitions
+#define HEADER_CATALOG_MAX_STREAMS 3 // the most streams any supported layout has
+#define HEADER_CATALOG_MAGIC       "PLCAT001" // first 8 bytes of a catalog file
+
+
+// Every stream header of one packed file
+typedef struct {
+  uint64_t num_streams;
+  uint64_t header_offsets[HEADER_CATALOG_MAX_STREAMS]; // byte offset of each stream's header
+  packlab_config_t streams[HEADER_CATALOG_MAX_STREAMS];
+} archive_headers_t;
+
+// Counters since the catalog was loaded
+typedef struct {
+  uint64_t entries;
+  uint64_t hits;
+  uint64_t misses; // files not in the catalog, or changed since they were added
+} header_catalog_stats_t;
+
+// Opaque catalog handle (not thread safe)
+typedef struct header_catalog header_catalog_t;
+
+
+// Reads and checks the headers of the packed file open as `fd`, which is
+// `file_len` bytes long, with one pread of a header page per stream
+// The stream data is never read, so nothing is verified beyond the headers
+// Returns NULL on success, or why the file is not a valid packed file
+const char* read_archive_headers(int fd, uint64_t file_len, archive_headers_t* headers);
+
+// Like read_archive_headers, for a packed file already in memory
+const char* parse_archive_headers(uint8_t* file_data, uint64_t file_len, archive_headers_t* headers);
+
+// Loads the catalog stored at `path`
+// A missing file gives an empty catalog; so does an unreadable or
+// incompatible one, after a warning (it is only a cache)
+header_catalog_t* header_catalog_load(const char* path);
+
+// Frees the catalog
+void header_catalog_destroy(header_catalog_t* catalog);
+
+// Looks up the headers of the file `st` describes
+// Entries are keyed by device and inode, and only count if the file's size
+// and modification time are unchanged since they were added
+bool header_catalog_lookup(header_catalog_t* catalog, const struct stat* st, archive_headers_t* headers);
+
+// Adds (or replaces) the headers of the file `st` describes
+void header_catalog_insert(header_catalog_t* catalog, const struct stat* st, const archive_headers_t* headers);
+
+// Writes the catalog to `path`, through a temporary file renamed into place
+// Returns false if it could not be written
+bool header_catalog_save(header_catalog_t* catalog, const char* path);
+
+// Returns a snapshot of the counters
+header_catalog_stats_t header_catalog_get_stats(header_catalog_t* catalog);
@@ -0,0 +1,97 @@
+// Cache of decryption keystreams, for processes that decrypt many files
+// PackLab - CS213 - Northwestern University
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keystream-cache.h"
+#include "unpack-utilities.h"
+
+
+// One period of keystream for one key
+typedef struct {
+  bool in_use;
+  uint16_t key;
+  uint8_t* data; // KEYSTREAM_PERIOD_LEN bytes, once in use
+  uint64_t last_used;
+} keystream_entry_t;
+
+struct keystream_cache {
+  keystream_entry_t entries[KEYSTREAM_CACHE_KEYS];
+  uint64_t clock;
+};
+
+
+// --- helper functions ---
+
+// Finds the entry for `key`, or takes over the least recently used one and
+// generates the keystream for `key` in it
+static keystream_entry_t* entry_for(keystream_cache_t* cache, uint16_t key) {
+  keystream_entry_t* oldest = &cache->entries[0];
+  for (int i = 0; i < KEYSTREAM_CACHE_KEYS; i++) {
+    keystream_entry_t* entry = &cache->entries[i];
+    if (entry->in_use && entry->key == key) {
+      return entry;
+    }
+    if (!entry->in_use || (oldest->in_use && entry->last_used < oldest->last_used)) {
+      oldest = entry;
+    }
+  }
+
+  oldest->in_use = true;
+  oldest->key    = key;
+  if (oldest->data == NULL) {
+    oldest->data = malloc_and_check(KEYSTREAM_PERIOD_LEN);
+  }
+
+  // each LFSR state is the next two keystream bytes, low byte first
+  uint16_t state = key;
+  for (size_t i = 0; i < KEYSTREAM_PERIOD_LEN; i += 2) {
+    state = lfsr_step(state);
+    oldest->data[i]     = (uint8_t)(state & 0x00FFu);
+    oldest->data[i + 1] = (uint8_t)(state >> 8);
+  }
+  return oldest;
+}
+
+
+// --- public functions ---
+
+keystream_cache_t* keystream_cache_create(void) {
+  keystream_cache_t* cache = malloc_and_check(sizeof(*cache));
+  memset(cache, 0, sizeof(*cache));
+  return cache;
+}
+
+void keystream_cache_destroy(keystream_cache_t* cache) {
+  if (cache == NULL) return;
+
+  for (int i = 0; i < KEYSTREAM_CACHE_KEYS; i++) {
+    free(cache->entries[i].data);
+  }
+  free(cache);
+}
+
+const uint8_t* keystream_cache_get(keystream_cache_t* cache, uint16_t encryption_key) {
+  keystream_entry_t* entry = entry_for(cache, encryption_key);
+  entry->last_used = ++cache->clock;
+  return entry->data;
+}
+
+void keystream_xor(const uint8_t* keystream, uint64_t offset, const uint8_t* input, uint8_t* output, size_t len) {
+  size_t pos = offset % KEYSTREAM_PERIOD_LEN;
+  size_t i   = 0;
+  while (i < len) {
+    size_t span = KEYSTREAM_PERIOD_LEN - pos;
+    if (span > len - i) {
+      span = len - i;
+    }
+    for (size_t k = 0; k < span; k++) {
+      output[i + k] = input[i + k] ^ keystream[pos + k];
+    }
+    i  += span;
+    pos = 0;
+  }
+}
@@ -0,0 +1,34 @@
+// Cache of decryption keystreams, for processes that decrypt many files
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+// Definitions
+#define KEYSTREAM_CACHE_KEYS 4             // keys kept at once (least recently used is dropped)
+#define KEYSTREAM_PERIOD_LEN (2 * 65535)  // the LFSR repeats after 65535 steps, of two bytes each
+
+
+// Opaque cache handle, for use by one thread at a time
+typedef struct keystream_cache keystream_cache_t;
+
+
+// Creates an empty cache
+keystream_cache_t* keystream_cache_create(void);
+
+// Frees the cache and every keystream it holds
+void keystream_cache_destroy(keystream_cache_t* cache);
+
+// Returns one period (KEYSTREAM_PERIOD_LEN bytes) of the keystream for
+// `encryption_key`, generating it if not cached
+// Byte i of a stream decrypts as stored[i] ^ keystream[i % KEYSTREAM_PERIOD_LEN]
+// The bytes stay valid until the next call
+const uint8_t* keystream_cache_get(keystream_cache_t* cache, uint16_t encryption_key);
+
+// Decrypts `len` bytes found at byte `offset` of a stream, XORing them with
+// `keystream` (one period, from keystream_cache_get) into `output`, which may
+// be `input` itself
+void keystream_xor(const uint8_t* keystream, uint64_t offset, const uint8_t* input, uint8_t* output, size_t len);
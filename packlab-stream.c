@@ -0,0 +1,599 @@
+// Incremental (push/pull) decoder for packed files that arrive in pieces
+// PackLab - CS213 - Northwestern University
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packlab-stream.h"
+#include "unpack-utilities.h"
+
+
+// --- helper functions ---
+
+static packlab_stream_status_t fail(packlab_stream_t* ctx, const char* message) {
+  ctx->phase = PACKLAB_PHASE_FAILED;
+  ctx->error = message;
+  return PACKLAB_STREAM_ERROR;
+}
+
+static uint64_t roundup(uint64_t offset, uint64_t alignment) {
+  return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+static uint64_t min_u64(uint64_t a, uint64_t b) {
+  return (a < b) ? a : b;
+}
+
+// Makes room for at least `needed` items of `item_len` bytes in a buffer that
+// grows as data arrives, doubling up to `limit` items. Lengths in a header are
+// not checked until the data they describe has arrived, so they only cap
+// the growth; allocating them up front would let a few bytes of bad input
+// ask for any amount of memory
+static void* grow(void* buffer, uint64_t* capacity, uint64_t needed, uint64_t limit, size_t item_len) {
+  if (needed <= *capacity) {
+    return buffer;
+  }
+  uint64_t new_capacity = (*capacity > 0) ? 2 * *capacity : PACKLAB_STREAM_GROW_MIN;
+  new_capacity = min_u64(new_capacity, limit);
+  if (new_capacity < needed) {
+    new_capacity = needed;
+  }
+
+  void* grown = realloc(buffer, new_capacity * item_len);
+  if (grown == NULL) {
+    error_and_exit("ERROR: malloc failed\n");
+  }
+  *capacity = new_capacity;
+  return grown;
+}
+
+static void consume(packlab_stream_t* ctx, size_t len) {
+  ctx->next_in  += len;
+  ctx->avail_in -= len;
+  ctx->total_in += len;
+}
+
+static bool is_float_tail(packlab_stream_t* ctx) {
+  return ctx->num_streams > 1 && ctx->stream == ctx->num_streams - 1;
+}
+
+// Decrypts any number of bytes, continuing exactly where the last call stopped
+// (decrypt_data_resume needs even-length pieces, so an odd piece leaves the
+// high byte of its last key step for the next call)
+static void stream_decrypt(packlab_stream_t* ctx, uint8_t* input_data, uint8_t* output_data, size_t len) {
+  if (len > 0 && ctx->has_key_hi) {
+    output_data[0] = (uint8_t)(input_data[0] ^ ctx->key_hi);
+    ctx->has_key_hi = false;
+    input_data++;
+    output_data++;
+    len--;
+  }
+
+  size_t even_len = len & ~(size_t)1;
+  ctx->lfsr_state = decrypt_data_resume(input_data, even_len, output_data, even_len, ctx->lfsr_state);
+
+  if (len & 1) {
+    ctx->lfsr_state = lfsr_step(ctx->lfsr_state);
+    output_data[even_len] = (uint8_t)(input_data[even_len] ^ (ctx->lfsr_state & 0xFFu));
+    ctx->key_hi     = (uint8_t)(ctx->lfsr_state >> 8);
+    ctx->has_key_hi = true;
+  }
+}
+
+// Folds newly arrived stored bytes into the running checks, then decrypts or
+// copies them to `output_data`. Never crosses a block boundary
+// Returns whether this piece completed a block (or the whole stored data)
+static bool take_stored(packlab_stream_t* ctx, uint8_t* output_data, size_t len) {
+  uint8_t* stored = ctx->next_in;
+
+  if (ctx->config.is_checksummed) {
+    checksum_update(&ctx->checksum, stored, len);
+  }
+  if (ctx->config.is_crc32c) {
+    ctx->crc32c = crc32c_update(ctx->crc32c, stored, len);
+  }
+  if (ctx->config.is_encrypted) {
+    stream_decrypt(ctx, stored, output_data, len);
+  } else {
+    memcpy(output_data, stored, len);
+  }
+
+  consume(ctx, len);
+  ctx->stored_left -= len;
+
+  if (!ctx->config.has_block_checksums) {
+    return ctx->stored_left == 0;
+  }
+
+  ctx->block_crc32c = crc32c_update(ctx->block_crc32c, stored, len);
+  ctx->block_pos += len;
+  if (ctx->block_pos == ctx->config.block_size || ctx->stored_left == 0) {
+    ctx->block_crc32cs = grow(ctx->block_crc32cs, &ctx->block_crc32cs_capacity, ctx->block_index + 1,
+                              block_count(&ctx->config), sizeof(uint32_t));
+    ctx->block_crc32cs[ctx->block_index++] = ctx->block_crc32c;
+    ctx->block_crc32c = 0;
+    ctx->block_pos    = 0;
+    return true;
+  }
+  return false;
+}
+
+// How many stored bytes may be taken right now without crossing a block boundary
+static uint64_t stored_takeable(packlab_stream_t* ctx) {
+  uint64_t len = min_u64(ctx->avail_in, ctx->stored_left);
+  if (ctx->config.has_block_checksums) {
+    len = min_u64(len, ctx->config.block_size - ctx->block_pos);
+  }
+  return len;
+}
+
+// Joins freshly decoded bytes of the last stream of a float file with the
+// earlier streams, into `pending`
+static void join_tail(packlab_stream_t* ctx, size_t tail_len) {
+  uint64_t first = ctx->floats_done;
+  uint64_t count = 0;
+
+  if (ctx->is_float64) {
+    // 2 bytes per double in either layout; a byte of a value cut in two waits
+    // at the front of `tail` for the rest
+    tail_len += ctx->tail_have;
+    count = tail_len / 2;
+    if (ctx->num_streams == 2) {
+      join_double_array(&ctx->float_streams[0][FLOAT64_MANTISSA_LEN * first], FLOAT64_MANTISSA_LEN * count,
+                        ctx->tail, 2 * count, ctx->pending, 8 * count);
+    } else {
+      join_double_array_three_stream(&ctx->float_streams[0][FLOAT64_MANTISSA_LO_LEN * first],
+                                     FLOAT64_MANTISSA_LO_LEN * count,
+                                     &ctx->float_streams[1][FLOAT64_SIGNEXP_LEN * first],
+                                     FLOAT64_SIGNEXP_LEN * count, ctx->tail, 2 * count, ctx->pending, 8 * count);
+    }
+    ctx->tail_have = tail_len - 2 * count;
+    memmove(ctx->tail, &ctx->tail[2 * count], ctx->tail_have);
+
+    ctx->floats_done += count;
+    ctx->pending_len  = 8 * count;
+    ctx->pending_pos  = 0;
+    return;
+  }
+
+  if (ctx->num_streams == 2) {
+    // one exponent byte per float
+    count = tail_len;
+    ctx->tail_prev = undo_float_transform(ctx->tail, count, 1, ctx->config.float_transform, ctx->tail_prev);
+    join_float_array(&ctx->float_streams[0][3 * first], 3 * count, ctx->tail, count,
+                     ctx->pending, 4 * count);
+  } else {
+    // one sign bit per float; `first` is always a multiple of 8, so the
+    // fraction bits for it start on a byte boundary
+    count = min_u64(8 * (uint64_t)tail_len, ctx->floats_total - first);
+    uint64_t frac_offset = (23 * first) / 8;
+    join_float_array_three_stream(&ctx->float_streams[0][frac_offset], ctx->float_sizes[0] - frac_offset,
+                                  &ctx->float_streams[1][first], count,
+                                  ctx->tail, tail_len, ctx->pending, 4 * count);
+  }
+
+  ctx->floats_done += count;
+  ctx->pending_len  = 4 * count;
+  if (ctx->emit != FLOAT_EMIT_FP32) {
+    narrow_float_array(ctx->pending, count, ctx->pending, ctx->emit);
+    ctx->pending_len = 2 * count;
+  }
+  ctx->pending_pos  = 0;
+}
+
+// Wraps up a stream once its data (and table) has been fully used
+static packlab_stream_status_t finish_stream(packlab_stream_t* ctx) {
+  packlab_config_t* config = &ctx->config;
+
+  free(ctx->block_crc32cs);
+  ctx->block_crc32cs = NULL;
+  ctx->block_crc32cs_capacity = 0;
+
+  if (!config->should_continue) {
+    if (ctx->num_streams > 1 && ctx->floats_done != ctx->floats_total) {
+      return fail(ctx, "ERROR: float streams disagree on length\n");
+    }
+    ctx->phase = PACKLAB_PHASE_FINISHED;
+    return PACKLAB_STREAM_OK;
+  }
+
+  // skip to the next header
+  uint64_t next_header = next_header_offset(config, ctx->stream_start);
+  ctx->stream++;
+  ctx->stream_start        = next_header;
+  ctx->header_have         = 0;
+  ctx->padding_left        = next_header - ctx->total_in;
+  ctx->phase               = PACKLAB_PHASE_PADDING;
+  ctx->phase_after_padding = PACKLAB_PHASE_HEADER;
+  return PACKLAB_STREAM_OK;
+}
+
+// Checks a stream once all of its stored data has been decoded
+static packlab_stream_status_t end_data(packlab_stream_t* ctx) {
+  packlab_config_t* config = &ctx->config;
+
+  if (ctx->decoded != config->orig_data_size) {
+    return fail(ctx, "ERROR: reconstructed stream is wrong length\n");
+  }
+  if (config->is_checksummed && checksum_final(&ctx->checksum) != config->checksum_value) {
+    return fail(ctx, "ERROR: checksum is invalid\n");
+  }
+  if (config->is_crc32c && ctx->crc32c != config->crc32c_value) {
+    return fail(ctx, "ERROR: crc32c is invalid\n");
+  }
+
+  // earlier float streams are whole now, so their values can be put back
+  if (ctx->num_streams > 1 && !is_float_tail(ctx)) {
+    undo_float_transform(ctx->float_streams[ctx->stream], ctx->decoded, (ctx->stream == 0) ? 3 : 1,
+                         config->float_transform, 0);
+  }
+
+  if (config->has_block_checksums) {
+    ctx->phase = PACKLAB_PHASE_TABLE;
+    return PACKLAB_STREAM_OK;
+  }
+  return finish_stream(ctx);
+}
+
+// Sets up decoding of the stream whose header was just parsed into ctx->config
+static packlab_stream_status_t begin_stream(packlab_stream_t* ctx) {
+  packlab_config_t* config = &ctx->config;
+
+  if (config->header_len > MAX_HEADER_SIZE || config->header_len == 0) {
+    return fail(ctx, "ERROR: header length is invalid\n");
+  }
+  if (config->should_continue && !config->should_float) {
+    return fail(ctx, "ERROR: have non-float continuation\n");
+  }
+
+  // the first header decides the layout; the rest must agree with it
+  if (ctx->stream == 0) {
+    ctx->num_streams = !config->should_continue ? 1 : (config->should_float3 ? 3 : 2);
+    ctx->is_float64  = config->is_float64;
+    if (ctx->emit != FLOAT_EMIT_FP32 && (ctx->num_streams == 1 || ctx->is_float64)) {
+      return fail(ctx, "ERROR: only 32-bit float files can be narrowed\n");
+    }
+  } else if (config->is_float64 != ctx->is_float64) {
+    return fail(ctx, "ERROR: float streams disagree on value size\n");
+  } else if (ctx->stream == 1 && !config->should_float) {
+    return fail(ctx, "ERROR: have 2nd stream without float\n");
+  } else if (ctx->stream == 2 && !config->should_float3) {
+    return fail(ctx, "ERROR: have 3rd stream without float3\n");
+  }
+  bool is_last = (ctx->stream == ctx->num_streams - 1);
+  if (config->should_continue == is_last) {
+    return fail(ctx, "ERROR: number of streams is not 1, 2 (FP), or 3 (FP3)\n");
+  }
+  if (config->float_transform != FLOAT_TRANSFORM_NONE && !float_transform_allowed(ctx->stream, config)) {
+    return fail(ctx, "ERROR: have a float transform on a stream that can't take one\n");
+  }
+
+  if (!config->is_compressed && config->data_size != config->orig_data_size) {
+    return fail(ctx, "ERROR: reconstructed stream is wrong length\n");
+  }
+
+  // earlier streams of a float file are kept until the last one arrives
+  if (ctx->num_streams > 1 && !is_last) {
+    ctx->float_streams[ctx->stream] = grow(NULL, &ctx->float_capacity[ctx->stream], 1,
+                                           config->orig_data_size, 1);
+    ctx->float_sizes[ctx->stream]   = config->orig_data_size;
+  }
+  if (ctx->is_float64 && is_last) {
+    // the sign and exponent stream (stream 1) has 2 bytes per double
+    uint64_t signexp_len = (ctx->num_streams == 2) ? config->orig_data_size : ctx->float_sizes[1];
+    ctx->floats_total = signexp_len / FLOAT64_SIGNEXP_LEN;
+    uint64_t lo_len = ((ctx->num_streams == 2) ? FLOAT64_MANTISSA_LEN : FLOAT64_MANTISSA_LO_LEN) * ctx->floats_total;
+    if (signexp_len % FLOAT64_SIGNEXP_LEN != 0 || ctx->float_sizes[0] != lo_len ||
+        config->orig_data_size != 2 * ctx->floats_total) {
+      return fail(ctx, "ERROR: float streams disagree on length\n");
+    }
+  } else if (ctx->num_streams == 2 && is_last) {
+    ctx->floats_total = config->orig_data_size;
+    if (ctx->float_sizes[0] != 3 * ctx->floats_total) {
+      return fail(ctx, "ERROR: float streams disagree on length\n");
+    }
+  } else if (ctx->num_streams == 3 && is_last) {
+    ctx->floats_total = ctx->float_sizes[1];
+    if (ctx->float_sizes[0] < (23 * ctx->floats_total + 7) / 8 ||
+        config->orig_data_size < (ctx->floats_total + 7) / 8) {
+      return fail(ctx, "ERROR: float streams disagree on length\n");
+    }
+  }
+
+  ctx->stored_left  = config->data_size;
+  ctx->decoded      = 0;
+  ctx->lfsr_state   = ctx->encryption_key;
+  ctx->has_key_hi   = false;
+  ctx->crc32c       = 0;
+  ctx->scratch_len  = 0;
+  ctx->scratch_pos  = 0;
+  ctx->block_pos    = 0;
+  ctx->block_index  = 0;
+  ctx->block_crc32c = 0;
+  ctx->table_entry_have      = 0;
+  ctx->table_entries_checked = 0;
+  ctx->block_dictionary_due  = false;
+  ctx->tail_prev             = 0;
+  ctx->tail_have             = 0;
+  checksum_init(&ctx->checksum);
+
+  // an empty stream may end right after its header, with no padding
+  if (config->data_size == 0 && block_table_len(config) == 0) {
+    return end_data(ctx);
+  }
+
+  // the data starts at the next boundary of the stream's layout after the header
+  ctx->padding_left        = stream_data_offset(config) - ctx->header_have;
+  ctx->phase               = PACKLAB_PHASE_PADDING;
+  ctx->phase_after_padding = PACKLAB_PHASE_DATA;
+  return PACKLAB_STREAM_OK;
+}
+
+// Decodes stored data into the current stream's destination until it runs out
+// of input or room. Returns with the phase unchanged when it needs more of either
+static packlab_stream_status_t decode_data(packlab_stream_t* ctx, uint8_t* output_data, size_t output_len,
+                                           size_t* output_produced) {
+  packlab_config_t* config = &ctx->config;
+
+  while (ctx->pending_pos == ctx->pending_len) {
+    // pick where decoded bytes go, and how many may go there
+    uint64_t stream_left = config->orig_data_size - ctx->decoded;
+    uint8_t* dst;
+    uint64_t space;
+    bool to_pending = false;
+    size_t max_run = config->has_long_runs ? LONG_RUN_MAX : MAX_RUN_LENGTH;
+    if (ctx->num_streams == 1 && config->is_compressed && output_len - *output_produced < max_run) {
+      // a run may not fit in what's left of the output; decode into pending instead
+      dst        = ctx->pending;
+      space      = min_u64(sizeof(ctx->pending), stream_left);
+      to_pending = true;
+    } else if (ctx->num_streams == 1) {
+      dst   = &output_data[*output_produced];
+      space = min_u64(output_len - *output_produced, stream_left);
+    } else if (!is_float_tail(ctx)) {
+      // keep room for a whole run, which can't be decoded in parts
+      ctx->float_streams[ctx->stream] = grow(ctx->float_streams[ctx->stream], &ctx->float_capacity[ctx->stream],
+                                             ctx->decoded + min_u64(max_run, stream_left), config->orig_data_size, 1);
+      dst   = &ctx->float_streams[ctx->stream][ctx->decoded];
+      space = min_u64(stream_left, ctx->float_capacity[ctx->stream] - ctx->decoded);
+    } else {
+      dst   = &ctx->tail[ctx->tail_have];
+      space = min_u64(PACKLAB_STREAM_TAIL_LEN - ctx->tail_have, stream_left);
+    }
+
+    size_t produced = 0;
+    if (ctx->stored_left == 0 && ctx->scratch_pos == ctx->scratch_len) {
+      return end_data(ctx);
+
+    } else if (!config->is_compressed) {
+      uint64_t take = min_u64(stored_takeable(ctx), space);
+      if (take == 0) {
+        return PACKLAB_STREAM_OK; // needs input, or room in the output
+      }
+      take_stored(ctx, dst, take);
+      produced = take;
+
+    } else {
+      size_t carried = ctx->scratch_len - ctx->scratch_pos;
+      bool is_final  = (ctx->stored_left == 0) ||
+                       (config->has_block_checksums && ctx->block_pos == 0);
+
+      // a block's dictionary update comes before any of its codes
+      if (ctx->block_dictionary_due && carried > 0) {
+        size_t dictionary_len = read_block_dictionary(&ctx->scratch[ctx->scratch_pos], carried,
+                                                      config->dictionary_data);
+        if (dictionary_len > 0) {
+          ctx->scratch_pos += dictionary_len;
+          ctx->block_dictionary_due = false;
+          continue;
+        }
+        if (is_final) {
+          return fail(ctx, "ERROR: block dictionary is cut off\n");
+        }
+      }
+
+      // fewer than MAX_CODE_LEN bytes starting with an escape may be a cut-off code
+      if (carried > 0 && !ctx->block_dictionary_due &&
+          (carried >= MAX_CODE_LEN || is_final || ctx->scratch[ctx->scratch_pos] != config->escape_byte)) {
+        size_t used = 0;
+        produced = decompress_data_resume(&ctx->scratch[ctx->scratch_pos], carried, dst, space,
+                                          config->dictionary_data, config->escape_byte, config->has_long_runs,
+                                          is_final, &used);
+        ctx->scratch_pos += used;
+        if (produced == 0 && used == 0) {
+          if (space == 0 && stream_left > 0) {
+            return PACKLAB_STREAM_OK; // needs room in the output
+          }
+          return fail(ctx, "ERROR: reconstructed stream is wrong length\n");
+        }
+      } else {
+        // only the start of a code (or nothing) is left: bring in more stored data
+        uint64_t take = min_u64(stored_takeable(ctx), PACKLAB_STREAM_SCRATCH_LEN);
+        if (take == 0) {
+          return PACKLAB_STREAM_OK;
+        }
+        if (config->has_block_dictionaries && ctx->block_pos == 0) {
+          ctx->block_dictionary_due = true; // everything before this block is decoded
+        }
+        memmove(ctx->scratch, &ctx->scratch[ctx->scratch_pos], carried);
+        take_stored(ctx, &ctx->scratch[carried], take);
+        ctx->scratch_len = carried + take;
+        ctx->scratch_pos = 0;
+        continue;
+      }
+    }
+
+    ctx->decoded += produced;
+    if (to_pending) {
+      ctx->pending_len = produced;
+      ctx->pending_pos = 0;
+    } else if (ctx->num_streams == 1) {
+      *output_produced += produced;
+      ctx->total_out   += produced;
+    } else if (is_float_tail(ctx) && produced > 0) {
+      join_tail(ctx, produced);
+    }
+  }
+  return PACKLAB_STREAM_OK;
+}
+
+// Compares the per-block checksum table against the CRC32Cs computed while decoding
+static packlab_stream_status_t check_table(packlab_stream_t* ctx) {
+  uint64_t num_blocks = block_count(&ctx->config);
+
+  while (ctx->table_entries_checked < num_blocks && ctx->avail_in > 0) {
+    size_t take = min_u64(BLOCK_ENTRY_LEN - ctx->table_entry_have, ctx->avail_in);
+    memcpy(&ctx->table_entry[ctx->table_entry_have], ctx->next_in, take);
+    consume(ctx, take);
+    ctx->table_entry_have += take;
+
+    if (ctx->table_entry_have == BLOCK_ENTRY_LEN) {
+      uint32_t expected_crc32c = 0;
+      uint32_t decoded_len     = 0;
+      read_block_entry(ctx->table_entry, 0, &expected_crc32c, &decoded_len);
+      if (expected_crc32c != ctx->block_crc32cs[ctx->table_entries_checked]) {
+        return fail(ctx, "ERROR: stream has corrupt blocks\n");
+      }
+      ctx->table_entries_checked++;
+      ctx->table_entry_have = 0;
+    }
+  }
+
+  if (ctx->table_entries_checked < num_blocks) {
+    return PACKLAB_STREAM_OK;
+  }
+  return finish_stream(ctx);
+}
+
+
+// --- public functions ---
+
+void packlab_stream_init(packlab_stream_t* ctx, uint16_t encryption_key) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->encryption_key = encryption_key;
+  ctx->phase          = PACKLAB_PHASE_HEADER;
+}
+
+void packlab_stream_feed(packlab_stream_t* ctx, uint8_t* input_data, size_t input_len) {
+  ctx->next_in  = input_data;
+  ctx->avail_in = (input_data != NULL) ? input_len : 0;
+}
+
+packlab_stream_status_t packlab_stream_drain(packlab_stream_t* ctx, uint8_t* output_data, size_t output_len,
+                                             size_t* output_produced) {
+  *output_produced = 0;
+  if (output_data == NULL) {
+    output_len = 0;
+  }
+
+  while (true) {
+    // joined float output waiting from last time goes out first
+    if (ctx->pending_pos < ctx->pending_len) {
+      size_t take = min_u64(ctx->pending_len - ctx->pending_pos, output_len - *output_produced);
+      memcpy(&output_data[*output_produced], &ctx->pending[ctx->pending_pos], take);
+      ctx->pending_pos += take;
+      *output_produced += take;
+      ctx->total_out   += take;
+      if (ctx->pending_pos < ctx->pending_len) {
+        return PACKLAB_STREAM_OK;
+      }
+    }
+
+    packlab_stream_phase_t phase = ctx->phase;
+    size_t avail_before = ctx->avail_in;
+    size_t produced_before = *output_produced;
+    packlab_stream_status_t status = PACKLAB_STREAM_OK;
+
+    switch (phase) {
+      case PACKLAB_PHASE_FAILED:
+        return PACKLAB_STREAM_ERROR;
+
+      case PACKLAB_PHASE_FINISHED:
+        // anything after the last stream is padding
+        consume(ctx, ctx->avail_in);
+        return PACKLAB_STREAM_END;
+
+      case PACKLAB_PHASE_HEADER: {
+        // how long a header is depends on its flags, so its fixed part (and
+        // extension flags) come in first; then exactly the rest, and it is
+        // parsed once
+        size_t needed = header_len_needed(ctx->header, ctx->header_have);
+        if (needed > MAX_HEADER_SIZE) {
+          status = fail(ctx, "ERROR: header is invalid\n");
+          break;
+        }
+        if (ctx->header_have < needed) {
+          size_t take = min_u64(needed - ctx->header_have, ctx->avail_in);
+          memcpy(&ctx->header[ctx->header_have], ctx->next_in, take);
+          consume(ctx, take);
+          ctx->header_have += take;
+          if (take == 0) {
+            return PACKLAB_STREAM_OK;
+          }
+          break;
+        }
+
+        memset(&ctx->config, 0, sizeof(ctx->config));
+        parse_header(ctx->header, ctx->header_have, &ctx->config);
+        if (ctx->config.is_valid) {
+          status = begin_stream(ctx);
+        } else {
+          status = fail(ctx, "ERROR: header is invalid\n");
+        }
+        break;
+      }
+
+      case PACKLAB_PHASE_PADDING: {
+        size_t take = min_u64(ctx->padding_left, ctx->avail_in);
+        consume(ctx, take);
+        ctx->padding_left -= take;
+        if (ctx->padding_left == 0) {
+          ctx->phase = ctx->phase_after_padding;
+        } else if (ctx->avail_in == 0) {
+          return PACKLAB_STREAM_OK;
+        }
+        break;
+      }
+
+      case PACKLAB_PHASE_DATA:
+        status = decode_data(ctx, output_data, output_len, output_produced);
+        break;
+
+      case PACKLAB_PHASE_TABLE:
+        status = check_table(ctx);
+        break;
+    }
+
+    if (status == PACKLAB_STREAM_ERROR) {
+      return status;
+    }
+
+    // stop once nothing moved: more input or output space is needed
+    bool progressed = ctx->phase != phase || ctx->avail_in != avail_before ||
+                      *output_produced != produced_before || ctx->pending_pos < ctx->pending_len;
+    if (!progressed) {
+      return PACKLAB_STREAM_OK;
+    }
+  }
+}
+
+packlab_stream_status_t packlab_stream_end(packlab_stream_t* ctx) {
+  packlab_stream_status_t status = PACKLAB_STREAM_END;
+  if (ctx->phase == PACKLAB_PHASE_FAILED) {
+    status = PACKLAB_STREAM_ERROR;
+  } else if (ctx->phase != PACKLAB_PHASE_FINISHED || ctx->pending_pos < ctx->pending_len) {
+    ctx->error = "ERROR: input ended before the whole file was decoded\n";
+    status = PACKLAB_STREAM_ERROR;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    free(ctx->float_streams[i]);
+    ctx->float_streams[i] = NULL;
+  }
+  free(ctx->block_crc32cs);
+  ctx->block_crc32cs = NULL;
+  ctx->block_crc32cs_capacity = 0;
+  return status;
+}
@@ -0,0 +1,129 @@
+// Incremental (push/pull) decoder for packed files that arrive in pieces
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+#include "unpack-utilities.h"
+
+// Definitions
+#define PACKLAB_STREAM_SCRATCH_LEN 4096 // decrypted bytes staged for decompression at a time
+#define PACKLAB_STREAM_TAIL_LEN    LONG_RUN_MAX // last-stream bytes of a float file joined at a time
+#define PACKLAB_STREAM_GROW_MIN    (64 * 1024)  // first size of buffers that grow as data arrives
+
+
+// What a call into the decoder left things at
+typedef enum {
+  PACKLAB_STREAM_OK,    // progress made; feed more input or drain into more output
+  PACKLAB_STREAM_END,   // the whole file has been decoded and drained
+  PACKLAB_STREAM_ERROR, // the input is not a valid packed file (see `error`)
+} packlab_stream_status_t;
+
+// Where the decoder is within the packed file
+typedef enum {
+  PACKLAB_PHASE_HEADER,   // collecting a stream header
+  PACKLAB_PHASE_PADDING,  // skipping alignment padding
+  PACKLAB_PHASE_DATA,     // decoding a stream's stored data
+  PACKLAB_PHASE_TABLE,    // checking a stream's per-block checksum table
+  PACKLAB_PHASE_FINISHED, // every stream has been decoded
+  PACKLAB_PHASE_FAILED,
+} packlab_stream_phase_t;
+
+// Decoder state
+// Everything needed to resume at any byte boundary lives here: partial
+// headers, LFSR state (including half-used key bytes), a pending escape byte,
+// and running checksums. Memory use is constant for single-stream files;
+// float files must keep all but their last stream, since those come first
+// (in buffers that grow as the data arrives, never sized by the header alone)
+typedef struct {
+  // input handed over by the last packlab_stream_feed() that is not used up yet
+  // it is read in place, so it must stay valid until avail_in reaches 0
+  uint8_t* next_in;
+  size_t avail_in;
+
+  // totals since init
+  uint64_t total_in;
+  uint64_t total_out;
+
+  // what the floats of a float file come out as; may be set after init, before the first feed
+  float_emit_t emit;
+
+  packlab_stream_phase_t phase;
+  packlab_stream_phase_t phase_after_padding;
+  const char* error;
+
+  uint16_t encryption_key;
+
+  // current stream
+  uint64_t stream;
+  uint64_t stream_start; // file offset of the stream's header
+  packlab_config_t config;
+  uint8_t header[MAX_HEADER_SIZE];
+  size_t header_have;
+  uint64_t padding_left;
+
+  // float layout, decided by the first header
+  uint64_t num_streams; // 1, 2 or 3
+  bool is_float64;      // whether the float streams hold doubles
+  uint8_t* float_streams[2];
+  uint64_t float_sizes[2];
+  uint64_t float_capacity[2]; // bytes allocated for each of float_streams
+  uint64_t floats_total;
+  uint64_t floats_done;
+  uint8_t tail_prev; // last exponent joined so far, to undo a float transform from
+
+  // decoding of the current stream's stored data
+  uint64_t stored_left;
+  uint64_t decoded;
+  uint16_t lfsr_state;
+  bool has_key_hi;  // the high key byte of the last LFSR step is still unused
+  uint8_t key_hi;
+  checksum_state_t checksum;
+  uint32_t crc32c;
+  // (plus room for a cut-off code, or block dictionary, carried over)
+  uint8_t scratch[PACKLAB_STREAM_SCRATCH_LEN + BLOCK_DICTIONARY_MAX_LEN];
+  size_t scratch_len;
+  size_t scratch_pos;
+
+  // per-block checksums of the current stream
+  uint64_t block_pos;    // stored bytes seen in the current block
+  uint64_t block_index;
+  uint32_t block_crc32c;
+  uint32_t* block_crc32cs;
+  uint64_t block_crc32cs_capacity;
+  uint8_t table_entry[BLOCK_ENTRY_LEN];
+  size_t table_entry_have;
+  uint64_t table_entries_checked;
+  bool block_dictionary_due; // the current block's dictionary update is not read yet
+                             // (config.dictionary_data is the current block's dictionary)
+
+  // last stream of a float file, decoded a bit at a time and then joined
+  uint8_t tail[PACKLAB_STREAM_TAIL_LEN];
+  size_t tail_have; // bytes of a last-stream value left over from the last join
+  uint8_t pending[4 * 8 * PACKLAB_STREAM_TAIL_LEN];
+  size_t pending_len;
+  size_t pending_pos;
+} packlab_stream_t;
+
+
+// Prepares a decoder. `encryption_key` is only used for encrypted streams
+// (see calculate_checksum() of the password)
+void packlab_stream_init(packlab_stream_t* ctx, uint16_t encryption_key);
+
+// Hands the decoder the next piece of the packed file
+// Only valid once the previous piece has been used up (avail_in == 0)
+void packlab_stream_feed(packlab_stream_t* ctx, uint8_t* input_data, size_t input_len);
+
+// Decodes as much of the fed input as fits into `output_data`
+// Writes the number of bytes produced into `output_produced`
+// Returns PACKLAB_STREAM_OK when it needs more input (avail_in == 0) or more
+// output space (output_produced == output_len)
+packlab_stream_status_t packlab_stream_drain(packlab_stream_t* ctx, uint8_t* output_data, size_t output_len,
+                                             size_t* output_produced);
+
+// Finishes decoding, freeing any memory the decoder holds
+// Returns PACKLAB_STREAM_END only if the whole file was decoded and drained
+packlab_stream_status_t packlab_stream_end(packlab_stream_t* ctx);
@@ -0,0 +1,75 @@
+// Unpacking small files whole, from a single read of the packed file
+// PackLab - CS213 - Northwestern University
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "header-catalog.h"
+#include "small-file.h"
+#include "stream-decoder.h"
+#include "unpack-utilities.h"
+
+
+// --- public functions ---
+
+bool small_file_eligible(uint64_t file_len, const archive_headers_t* headers) {
+  if (file_len > SMALL_FILE_LEN) {
+    return false;
+  }
+
+  uint64_t used = 0;
+  for (uint64_t stream = 0; stream < headers->num_streams; stream++) {
+    const packlab_config_t* config = &headers->streams[stream];
+    if (config->has_block_checksums || config->orig_data_size > SMALL_OUTPUT_LEN - used) {
+      return false;
+    }
+    used += config->orig_data_size;
+  }
+  return true;
+}
+
+const char* small_file_verify(uint8_t* file_data, archive_headers_t* headers) {
+  for (uint64_t stream = 0; stream < headers->num_streams; stream++) {
+    packlab_config_t* config = &headers->streams[stream];
+    uint8_t* stored_data = &file_data[headers->header_offsets[stream] + stream_data_offset(config)];
+
+    if (config->is_checksummed) {
+      checksum_state_t checksum;
+      checksum_init(&checksum);
+      checksum_update(&checksum, stored_data, config->data_size);
+      if (checksum_final(&checksum) != config->checksum_value) {
+        return "ERROR: checksum is invalid\n";
+      }
+    }
+    if (config->is_crc32c && crc32c_update(0, stored_data, config->data_size) != config->crc32c_value) {
+      return "ERROR: crc32c is invalid\n";
+    }
+  }
+  return NULL;
+}
+
+bool small_file_decode(uint8_t* file_data, archive_headers_t* headers, uint16_t encryption_key,
+                       const uint8_t* keystream, uint8_t* output_data, uint8_t** streams) {
+  uint64_t used = 0;
+  for (uint64_t stream = 0; stream < headers->num_streams; stream++) {
+    packlab_config_t* config = &headers->streams[stream];
+    stream_decoder_state_t state;
+    stream_decoder_init(&state, config, encryption_key);
+    if (config->is_encrypted) {
+      state.keystream = keystream;
+    }
+    // already verified, so the loop without checksums will do
+    stream_decoder_t decode = stream_decoder_select(config->is_compressed, config->is_encrypted, false);
+
+    uint8_t* stored_data = &file_data[headers->header_offsets[stream] + stream_data_offset(config)];
+    streams[stream] = &output_data[used];
+    size_t output_len = decode(stored_data, config->data_size, streams[stream], config->orig_data_size, &state);
+    if (!state.complete || output_len != config->orig_data_size) {
+      return false;
+    }
+    undo_float_transform(streams[stream], output_len, float_value_len(stream), config->float_transform, 0);
+    used += output_len;
+  }
+  return true;
+}
@@ -0,0 +1,39 @@
+// Unpacking small files whole, from a single read of the packed file
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+#include "header-catalog.h"
+#include "unpack-utilities.h"
+
+// Definitions
+// Inputs up to SMALL_FILE_LEN that unpack to at most SMALL_OUTPUT_LEN take
+// the small-file fast path
+#define SMALL_FILE_LEN   (64 * 1024)
+#define SMALL_OUTPUT_LEN (256 * 1024)
+
+
+// Whether the packed file with `headers`, `file_len` bytes long, can be
+// unpacked whole: no more than SMALL_FILE_LEN bytes, no stream with block
+// checksums, and all of its streams together no more than SMALL_OUTPUT_LEN
+// bytes once decoded
+// Decided from the headers alone, so before anything is asked for
+bool small_file_eligible(uint64_t file_len, const archive_headers_t* headers);
+
+// Checks the stored data of every stream of the packed file in `file_data`
+// against its checksum and CRC32C, if it has them
+// Returns NULL if they all match, or the error to report for the first that doesn't
+const char* small_file_verify(uint8_t* file_data, archive_headers_t* headers);
+
+// Decodes every stream of an eligible, verified packed file in `file_data`
+// one after another into `output_data` (SMALL_OUTPUT_LEN bytes), pointing
+// `streams` at where each one starts, and undoes any float transforms
+// `keystream` is optional (see keystream-cache.h). Encrypted data is
+// decrypted in place in `file_data`
+// Returns false if a stream does not decode to its length
+bool small_file_decode(uint8_t* file_data, archive_headers_t* headers, uint16_t encryption_key,
+                       const uint8_t* keystream, uint8_t* output_data, uint8_t** streams);
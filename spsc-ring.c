@@ -0,0 +1,130 @@
+// Lock-free single-producer/single-consumer rings for passing buffers between threads
+// PackLab - CS213 - Northwestern University
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "spsc-ring.h"
+#include "unpack-utilities.h"
+
+// Polls of a full/empty ring before going to sleep on it
+#define SPIN_LIMIT 64
+
+
+// --- helper functions ---
+
+// Whether a push (or pop) can go ahead right now
+static bool is_ready(spsc_ring_t* ring, bool to_push) {
+  size_t head = atomic_load(&ring->head);
+  size_t tail = atomic_load(&ring->tail);
+  return to_push ? (tail - head < ring->capacity) : (head != tail);
+}
+
+// Waits for the other side of a ring to make room (or add an item)
+// Spins briefly first, since the other thread is usually mid-way through one
+// buffer; after that, sleeps until the other side signals
+static void wait_for_other_side(spsc_ring_t* ring, bool to_push, unsigned* spins) {
+  if (*spins < SPIN_LIMIT) {
+    (*spins)++;
+    return;
+  }
+
+  pthread_mutex_lock(&ring->lock);
+  // counted before the last look at the ring, so a push or pop after that look
+  // sees the sleeper and signals; it can't signal before the wait starts, as
+  // that takes the lock
+  atomic_fetch_add(&ring->sleepers, 1);
+  while (!is_ready(ring, to_push)) {
+    pthread_cond_wait(&ring->wakeup, &ring->lock);
+  }
+  atomic_fetch_sub(&ring->sleepers, 1);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+// Wakes the other side of a ring after a push onto an empty ring (or a pop
+// from a full one), if it has gone to sleep waiting for exactly that
+static void wake_other_side(spsc_ring_t* ring, bool was_blocking) {
+  if (was_blocking && atomic_load(&ring->sleepers) > 0) {
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->wakeup);
+    pthread_mutex_unlock(&ring->lock);
+  }
+}
+
+
+// --- public functions ---
+
+void spsc_ring_init(spsc_ring_t* ring, size_t capacity) {
+  size_t rounded = 1;
+  while (rounded < capacity) {
+    rounded *= 2;
+  }
+
+  ring->slots    = malloc_and_check(rounded * sizeof(*ring->slots));
+  ring->capacity = rounded;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->sleepers, 0);
+  pthread_mutex_init(&ring->lock, NULL);
+  pthread_cond_init(&ring->wakeup, NULL);
+}
+
+void spsc_ring_free(spsc_ring_t* ring) {
+  free(ring->slots);
+  ring->slots = NULL;
+  pthread_mutex_destroy(&ring->lock);
+  pthread_cond_destroy(&ring->wakeup);
+}
+
+bool spsc_ring_try_push(spsc_ring_t* ring, void* item) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head == ring->capacity) {
+    return false;
+  }
+
+  ring->slots[tail & (ring->capacity - 1)] = item;
+  // publishes the slot contents along with the new tail
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+  // a sleeping consumer has popped everything up to here, so the ring was empty
+  atomic_thread_fence(memory_order_seq_cst);
+  wake_other_side(ring, atomic_load(&ring->head) == tail);
+  return true;
+}
+
+bool spsc_ring_try_pop(spsc_ring_t* ring, void** item) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head == tail) {
+    return false;
+  }
+
+  *item = ring->slots[head & (ring->capacity - 1)];
+  // hands the slot back to the producer only after it has been read
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+  // a sleeping producer has filled every slot, so the ring was full
+  atomic_thread_fence(memory_order_seq_cst);
+  wake_other_side(ring, atomic_load(&ring->tail) - head == ring->capacity);
+  return true;
+}
+
+void spsc_ring_push(spsc_ring_t* ring, void* item) {
+  unsigned spins = 0;
+  while (!spsc_ring_try_push(ring, item)) {
+    wait_for_other_side(ring, true, &spins);
+  }
+}
+
+void* spsc_ring_pop(spsc_ring_t* ring) {
+  void* item = NULL;
+  unsigned spins = 0;
+  while (!spsc_ring_try_pop(ring, &item)) {
+    wait_for_other_side(ring, false, &spins);
+  }
+  return item;
+}
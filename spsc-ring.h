@@ -0,0 +1,54 @@
+// Lock-free single-producer/single-consumer rings for passing buffers between threads
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+// Definitions
+#define SPSC_CACHE_LINE 64 // head and tail live on separate lines so the two threads don't false-share
+
+
+// A bounded queue of pointers
+// Exactly one thread may push and exactly one (other) thread may pop; while
+// both keep up, neither takes a lock. Each side only writes its own index and
+// reads the other's. A side left waiting on a full or empty ring sleeps until
+// the other side makes room or adds an item, so idle stages use no CPU
+typedef struct {
+  void** slots;
+  size_t capacity; // always a power of two
+
+  // next slot to pop, only written by the consumer
+  _Alignas(SPSC_CACHE_LINE) _Atomic size_t head;
+  // next slot to push, only written by the producer
+  _Alignas(SPSC_CACHE_LINE) _Atomic size_t tail;
+
+  // threads asleep in wakeup, so the other side knows to signal
+  _Alignas(SPSC_CACHE_LINE) _Atomic unsigned sleepers;
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+} spsc_ring_t;
+
+
+// Prepares an empty ring holding up to `capacity` items (rounded up to a power of two)
+void spsc_ring_init(spsc_ring_t* ring, size_t capacity);
+
+// Frees the ring's slots (not the items still in them)
+// Neither side may be waiting on the ring
+void spsc_ring_free(spsc_ring_t* ring);
+
+// Adds an item. Returns false without waiting if the ring is full
+bool spsc_ring_try_push(spsc_ring_t* ring, void* item);
+
+// Removes the oldest item into `item`. Returns false without waiting if the ring is empty
+bool spsc_ring_try_pop(spsc_ring_t* ring, void** item);
+
+// Adds an item, waiting for room if the ring is full
+void spsc_ring_push(spsc_ring_t* ring, void* item);
+
+// Removes the oldest item, waiting for one if the ring is empty
+void* spsc_ring_pop(spsc_ring_t* ring);
@@ -0,0 +1,152 @@
+// Cursors that decode one stream of a packed file a piece at a time
+// PackLab - CS213 - Northwestern University
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stream-cursor.h"
+#include "unpack-utilities.h"
+
+// A new chunk is only pulled in once fewer than MAX_CODE_LEN stored bytes are
+// left over (the start of a code cut off by the chunk end)
+#define CHUNK_CAPACITY   (CURSOR_CHUNK_LEN + MAX_CODE_LEN)
+// worst-case output could be MAX_RUN_LENGTH bytes for every two bytes
+// (long runs can outgrow that, but then the rest of the chunk is left over
+// for the next refill, which always has room for at least one long run)
+#define DECODED_CAPACITY ((MAX_RUN_LENGTH * CHUNK_CAPACITY) / 2 + MAX_RUN_LENGTH)
+
+
+// --- helper functions ---
+
+// Pulls the next chunk of stored bytes in and decodes as much of it as possible
+// Returns false once the stream has nothing more to give
+static bool refill(stream_cursor_t* cursor) {
+  packlab_config_t* config = &cursor->config;
+
+  while (true) {
+    uint64_t stored_left = config->data_size - cursor->stored_pos;
+    size_t carried = cursor->chunk_len - cursor->chunk_pos;
+    if (stored_left == 0 && carried == 0) {
+      return false;
+    }
+
+    // keep any bytes the decompressor could not use yet, then append new ones
+    // (unless they hold a whole code, which only needs room in the output)
+    memmove(cursor->chunk, &cursor->chunk[cursor->chunk_pos], carried);
+    size_t take = (stored_left < CURSOR_CHUNK_LEN) ? (size_t)stored_left : CURSOR_CHUNK_LEN;
+    if (carried >= MAX_CODE_LEN) {
+      take = 0;
+    }
+    uint8_t* stored = &cursor->stored_data[cursor->stored_pos];
+
+    if (config->is_checksummed) {
+      checksum_update(&cursor->checksum, stored, take);
+    }
+    if (config->is_crc32c) {
+      cursor->crc32c = crc32c_update(cursor->crc32c, stored, take);
+    }
+    if (config->is_encrypted) {
+      cursor->lfsr_state = decrypt_data_resume(stored, take, &cursor->chunk[carried], take,
+                                               cursor->lfsr_state);
+    } else {
+      memcpy(&cursor->chunk[carried], stored, take);
+    }
+
+    cursor->stored_pos += take;
+    cursor->chunk_len   = carried + take;
+    cursor->chunk_pos   = 0;
+
+    if (!config->is_compressed) {
+      cursor->decoded     = cursor->chunk;
+      cursor->decoded_len = cursor->chunk_len;
+      cursor->decoded_pos = 0;
+      cursor->chunk_pos   = cursor->chunk_len;
+    } else {
+      bool is_final = (cursor->stored_pos == config->data_size);
+      size_t used = 0;
+      cursor->decoded     = cursor->decoded_buffer;
+      cursor->decoded_len = decompress_data_resume(cursor->chunk, cursor->chunk_len,
+                                                   cursor->decoded_buffer, DECODED_CAPACITY,
+                                                   config->dictionary_data, config->escape_byte,
+                                                   config->has_long_runs, is_final, &used);
+      cursor->decoded_pos = 0;
+      cursor->chunk_pos   = used;
+
+      // a final chunk that can't be used up is corrupt, as is a whole code
+      // that decodes to nothing; stop rather than spin
+      if ((is_final || take == 0) && used == 0 && cursor->decoded_len == 0) {
+        cursor->chunk_pos = cursor->chunk_len;
+        return false;
+      }
+    }
+
+    if (cursor->decoded_len > 0) {
+      return true;
+    }
+  }
+}
+
+
+// --- public functions ---
+
+void stream_cursor_init(stream_cursor_t* cursor, packlab_config_t* config,
+                        uint8_t* stored_data, uint16_t encryption_key) {
+  memset(cursor, 0, sizeof(*cursor));
+  cursor->config      = *config;
+  cursor->stored_data = stored_data;
+  cursor->lfsr_state  = encryption_key;
+  checksum_init(&cursor->checksum);
+
+  cursor->chunk = malloc_and_check(CHUNK_CAPACITY);
+  if (config->is_compressed) {
+    cursor->decoded_buffer = malloc_and_check(DECODED_CAPACITY);
+  }
+}
+
+void stream_cursor_free(stream_cursor_t* cursor) {
+  free(cursor->chunk);
+  free(cursor->decoded_buffer);
+  cursor->chunk          = NULL;
+  cursor->decoded_buffer = NULL;
+}
+
+size_t stream_cursor_read(stream_cursor_t* cursor, uint8_t* output_data, size_t output_len) {
+  size_t copied = 0;
+
+  while (copied < output_len) {
+    if (cursor->decoded_pos == cursor->decoded_len && !refill(cursor)) {
+      break;
+    }
+
+    size_t available = cursor->decoded_len - cursor->decoded_pos;
+    size_t take = (output_len - copied < available) ? output_len - copied : available;
+    memcpy(&output_data[copied], &cursor->decoded[cursor->decoded_pos], take);
+    cursor->decoded_pos += take;
+    copied += take;
+  }
+
+  cursor->total_read += copied;
+  return copied;
+}
+
+bool stream_cursor_is_intact(stream_cursor_t* cursor) {
+  packlab_config_t* config = &cursor->config;
+
+  // everything stored must have been used, and nothing decoded left over
+  bool has_more = cursor->decoded_pos < cursor->decoded_len ||
+                  cursor->chunk_pos < cursor->chunk_len ||
+                  cursor->stored_pos < config->data_size;
+  if (has_more || cursor->total_read != config->orig_data_size) {
+    return false;
+  }
+
+  if (config->is_checksummed && checksum_final(&cursor->checksum) != config->checksum_value) {
+    return false;
+  }
+  if (config->is_crc32c && cursor->crc32c != config->crc32c_value) {
+    return false;
+  }
+  return true;
+}
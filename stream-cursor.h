@@ -0,0 +1,67 @@
+// Cursors that decode one stream of a packed file a piece at a time
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+#include "unpack-utilities.h"
+
+// Definitions
+#define CURSOR_CHUNK_LEN (128 * 1024) // stored bytes decrypted/decompressed per refill
+
+
+// Decoding state for one stream
+// Memory use is a fixed few hundred KB no matter how large the stream is
+typedef struct {
+  packlab_config_t config;
+
+  // the stream's stored data (e.g. inside a memory-mapped file) and how much
+  // of it has been pulled in so far
+  uint8_t* stored_data;
+  uint64_t stored_pos;
+
+  // running integrity checks over the stored bytes pulled in so far
+  checksum_state_t checksum;
+  uint32_t crc32c;
+
+  // LFSR state for the next stored byte (only used if encrypted)
+  uint16_t lfsr_state;
+
+  // stored bytes after decryption, waiting to be decompressed
+  // holds one chunk plus a carried-over escape byte from the previous chunk
+  uint8_t* chunk;
+  size_t chunk_len;
+  size_t chunk_pos;
+
+  // decoded bytes waiting to be read
+  // points into `decoded_buffer` if compressed, or straight into `chunk` if not
+  uint8_t* decoded_buffer;
+  uint8_t* decoded;
+  size_t decoded_len;
+  size_t decoded_pos;
+
+  // total decoded bytes handed out so far
+  uint64_t total_read;
+} stream_cursor_t;
+
+
+// Prepares a cursor over a stream whose header has been parsed into `config`
+// `stored_data` must hold the stream's config->data_size stored bytes
+// `encryption_key` is only used if the stream is encrypted
+void stream_cursor_init(stream_cursor_t* cursor, packlab_config_t* config,
+                        uint8_t* stored_data, uint16_t encryption_key);
+
+// Frees the cursor's buffers
+void stream_cursor_free(stream_cursor_t* cursor);
+
+// Copies the next `output_len` decoded bytes of the stream into `output_data`
+// Returns the number of bytes copied, which is less only at the end of the stream
+size_t stream_cursor_read(stream_cursor_t* cursor, uint8_t* output_data, size_t output_len);
+
+// Whether the stream was decoded completely, to exactly its original size,
+// and its checksum/CRC32C (if any) matched
+// Only meaningful once every byte has been read
+bool stream_cursor_is_intact(stream_cursor_t* cursor);
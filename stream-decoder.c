@@ -0,0 +1,192 @@
+// Decode loops specialized for each combination of stream flags
+// PackLab - CS213 - Northwestern University
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keystream-cache.h"
+#include "stream-decoder.h"
+#include "unpack-utilities.h"
+
+// Most output one input byte can turn into: a 2-byte code repeats up to 15 bytes
+#define MAX_EXPANSION ((MAX_RUN_LENGTH + 1) / 2)
+
+
+// --- helper functions ---
+
+// Decompresses one chunk, continuing a stream
+// When the output has room for the worst case, no code can overflow it, so
+// this skips the per-byte bounds checks of decompress_data_resume()
+// (long runs have no useful worst case, so streams with them always take the
+// checked loop; their cost is in the memsets anyway)
+// Long stretches of literals are copied a span at a time
+static inline size_t expand_chunk(uint8_t* input, size_t input_len, bool is_final,
+                                  uint8_t* output, size_t output_room,
+                                  stream_decoder_state_t* state, size_t* input_used) {
+  uint8_t* dictionary_data = state->dictionary_data;
+  uint8_t escape_byte      = state->escape_byte;
+  if (state->long_runs || output_room / MAX_EXPANSION < input_len) {
+    return decompress_data_resume(input, input_len, output, output_room,
+                                  dictionary_data, escape_byte, state->long_runs, is_final, input_used);
+  }
+
+  size_t out_pos  = 0;
+  size_t literals = 0; // in a row, just before input[i]
+  size_t i = 0;
+  while (i < input_len) {
+    uint8_t b = input[i];
+    if (b != escape_byte) {
+      output[out_pos++] = b;
+      i++;
+      if (++literals == LITERAL_SCAN_AFTER) {
+        size_t span = state->find_byte(&input[i], input_len - i, escape_byte);
+        memcpy(&output[out_pos], &input[i], span);
+        out_pos += span;
+        i += span;
+      }
+      continue;
+    }
+    literals = 0;
+    if (i == input_len - 1) {
+      // its code byte is in the next chunk, unless there is none
+      if (!is_final) {
+        break;
+      }
+      output[out_pos++] = escape_byte;
+      i++;
+    } else {
+      uint8_t code = input[i+1];
+      if (code == 0x00) {
+        output[out_pos++] = escape_byte;
+      } else {
+        uint8_t repeat_count = (uint8_t)((code >> 4) & 0x0Fu);
+        memset(&output[out_pos], dictionary_data[code & 0x0Fu], repeat_count);
+        out_pos += repeat_count;
+      }
+      i += 2;
+    }
+  }
+
+  *input_used = i;
+  return out_pos;
+}
+
+// Decrypts the chunk at `offset` of the stored data, from the cached keystream
+// if there is one (the keystream repeats, so it is indexed modulo its period)
+static inline void decrypt_chunk(stream_decoder_state_t* state, uint8_t* chunk, size_t chunk_len,
+                                 uint8_t* output, size_t offset) {
+  if (state->keystream == NULL) {
+    state->lfsr_state = decrypt_data_resume(chunk, chunk_len, output, chunk_len, state->lfsr_state);
+    return;
+  }
+
+  keystream_xor(state->keystream, offset, chunk, output, chunk_len);
+
+  // the last two keystream bytes used are the LFSR state to carry on from
+  size_t end = (offset + chunk_len + (chunk_len & 1)) % KEYSTREAM_PERIOD_LEN;
+  if (end == 0) {
+    end = KEYSTREAM_PERIOD_LEN;
+  }
+  state->lfsr_state = (uint16_t)(state->keystream[end - 2] | (state->keystream[end - 1] << 8));
+}
+
+// The one decode loop every specialization is made from
+// Each caller passes constant flags, so after inlining the compiler drops the
+// steps (and the tests for them) that the combination does not need
+static inline size_t decode_chunks(uint8_t* stored, size_t stored_len,
+                                   uint8_t* output, size_t output_len,
+                                   stream_decoder_state_t* state,
+                                   bool is_compressed, bool is_encrypted, bool verify) {
+  size_t out_pos = 0;
+  size_t in_pos  = 0; // first stored byte not yet decompressed
+  state->complete = false;
+
+  for (size_t offset = 0; offset < stored_len; offset += STREAM_DECODER_CHUNK_LEN) {
+    size_t chunk_len = stored_len - offset;
+    if (chunk_len > STREAM_DECODER_CHUNK_LEN) {
+      chunk_len = STREAM_DECODER_CHUNK_LEN;
+    }
+    uint8_t* chunk = &stored[offset];
+
+    if (verify) {
+      checksum_update(&state->checksum, chunk, chunk_len);
+      if (state->with_crc32c) {
+        state->crc32c = crc32c_update(state->crc32c, chunk, chunk_len);
+      }
+    }
+
+    if (is_compressed) {
+      if (is_encrypted) {
+        decrypt_chunk(state, chunk, chunk_len, chunk, offset);
+      }
+
+      size_t used = 0;
+      bool is_final = offset + chunk_len == stored_len;
+      out_pos += expand_chunk(&stored[in_pos], offset + chunk_len - in_pos, is_final,
+                              &output[out_pos], output_len - out_pos, state, &used);
+      in_pos += used;
+      if (in_pos < offset + chunk_len && (is_final || in_pos + MAX_CODE_LEN <= offset + chunk_len)) {
+        // the output is full (fewer bytes left over are a code cut off by the chunk end)
+        return out_pos;
+      }
+
+    } else {
+      if (chunk_len > output_len - out_pos) {
+        return out_pos;
+      }
+      if (is_encrypted) {
+        decrypt_chunk(state, chunk, chunk_len, &output[out_pos], offset);
+      } else if (&output[out_pos] != chunk) {
+        memcpy(&output[out_pos], chunk, chunk_len);
+      }
+      out_pos += chunk_len;
+    }
+  }
+
+  state->complete = true;
+  return out_pos;
+}
+
+// Instantiates the decode loop for one combination: c(ompressed), e(ncrypted), (chec)k(summed)
+#define DEFINE_STREAM_DECODER(suffix, is_compressed, is_encrypted, verify)                      \
+  static size_t decode_##suffix(uint8_t* stored, size_t stored_len,                               \
+                                uint8_t* output, size_t output_len,                               \
+                                stream_decoder_state_t* state) {                                  \
+    return decode_chunks(stored, stored_len, output, output_len, state,                           \
+                         is_compressed, is_encrypted, verify);                                    \
+  }
+
+DEFINE_STREAM_DECODER(none, false, false, false)
+DEFINE_STREAM_DECODER(c,    true,  false, false)
+DEFINE_STREAM_DECODER(e,    false, true,  false)
+DEFINE_STREAM_DECODER(k,    false, false, true)
+DEFINE_STREAM_DECODER(ce,   true,  true,  false)
+DEFINE_STREAM_DECODER(ck,   true,  false, true)
+DEFINE_STREAM_DECODER(ek,   false, true,  true)
+DEFINE_STREAM_DECODER(cek,  true,  true,  true)
+
+// Indexed by compressed << 2 | encrypted << 1 | verify
+static const stream_decoder_t decoders[8] = {
+  decode_none, decode_k, decode_e, decode_ek,
+  decode_c,    decode_ck, decode_ce, decode_cek,
+};
+
+
+// --- public functions ---
+
+void stream_decoder_init(stream_decoder_state_t* state, packlab_config_t* config, uint16_t encryption_key) {
+  memset(state, 0, sizeof(*state));
+  state->dictionary_data = config->dictionary_data;
+  state->escape_byte     = config->escape_byte;
+  state->long_runs       = config->has_long_runs;
+  state->find_byte       = kernels_for_isa(cpu_isa_active())->find_byte;
+  state->lfsr_state      = encryption_key;
+  state->with_crc32c     = config->is_crc32c;
+  checksum_init(&state->checksum);
+}
+
+stream_decoder_t stream_decoder_select(bool is_compressed, bool is_encrypted, bool verify) {
+  return decoders[(is_compressed ? 4 : 0) | (is_encrypted ? 2 : 0) | (verify ? 1 : 0)];
+}
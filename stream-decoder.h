@@ -0,0 +1,55 @@
+// Decode loops specialized for each combination of stream flags
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+#include "unpack-utilities.h"
+
+// Definitions
+#define STREAM_DECODER_CHUNK_LEN (64 * 1024) // stored bytes handled per step, small enough to stay in cache
+
+
+// Everything a decode loop carries from one chunk to the next
+typedef struct {
+  uint8_t* dictionary_data; // (only used if compressed)
+  uint8_t escape_byte;      // (only used if compressed)
+  bool long_runs;           // (only used if compressed)
+  size_t (*find_byte)(const uint8_t* data, size_t len, uint8_t value); // kernel that finds escapes
+  uint16_t lfsr_state;      // encryption key to start with (only used if encrypted)
+
+  // one period of precomputed keystream (optional, see keystream-cache.h)
+  // when set, chunks are decrypted by XOR with it instead of stepping the LFSR
+  const uint8_t* keystream;
+
+  // running checks over the stored data (only updated if verifying)
+  bool with_crc32c;
+  checksum_state_t checksum;
+  uint32_t crc32c;
+
+  // set when every stored byte was decoded into the output
+  // false means the output filled up first, i.e. the stream is longer than expected
+  bool complete;
+} stream_decoder_state_t;
+
+// A decode loop for one combination of flags
+// Walks `stored` a chunk at a time, and for each chunk verifies it (checksum
+// and, if `with_crc32c`, CRC32C), decrypts it, and decompresses it into
+// `output`, skipping the steps its flags do not call for. Compressed data is
+// decrypted in place in `stored` first. Without compression, `output` may be
+// `stored` itself to decrypt in place
+// Returns the length of valid data written to `output` (<= output_len)
+typedef size_t (*stream_decoder_t)(uint8_t* stored, size_t stored_len,
+                                   uint8_t* output, size_t output_len,
+                                   stream_decoder_state_t* state);
+
+
+// Starts the state for decoding one stream
+void stream_decoder_init(stream_decoder_state_t* state, packlab_config_t* config, uint16_t encryption_key);
+
+// Picks the decode loop for a stream, once, after its header is parsed
+// `verify` asks for the checksums to be computed along the way
+stream_decoder_t stream_decoder_select(bool is_compressed, bool is_encrypted, bool verify);
@@ -1,13 +1,30 @@
 // Application to test unpack utilities
 // PackLab - CS213 - Northwestern University
 
+#define _POSIX_C_SOURCE 200809L // mkstemp, st_mtim
+
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <time.h>
+#include <unistd.h>
+
+#include "async-io.h"
+#include "block-cache.h"
+#include "buffer-pool.h"
+#include "cpu-dispatch.h"
+#include "header-catalog.h"
+#include "keystream-cache.h"
+#include "packlab-stream.h"
+#include "small-file.h"
+#include "spsc-ring.h"
+#include "stream-cursor.h"
+#include "stream-decoder.h"
 #include "unpack-utilities.h"
+#include "unpackd.h"
 
 
 int test_lfsr_step(void) {
@@ -539,7 +556,7 @@ int test_decompress_handout_example(void) {
   // run decompression
   size_t out_len = decompress_data(input_data, sizeof(input_data),
                                    output_data, sizeof(output_data),
-                                   dict);
+                                   dict, ESCAPE_BYTE, false);
   // expected result
   uint8_t expected[] = {0x01, 0x32, 0x32, 0x32, 0x32};
 
@@ -569,7 +586,7 @@ int test_decompress_literal_escape(void) {
 
   size_t out_len = decompress_data(input_data, sizeof(input_data),
                                    output_data, sizeof(output_data),
-                                   dict);
+                                   dict, ESCAPE_BYTE, false);
 
   uint8_t expected[] = {0x07};
 
@@ -599,7 +616,7 @@ int test_decompress_trailing_escape_byte(void) {
 
   size_t out_len = decompress_data(input_data, sizeof(input_data),
                                    output_data, sizeof(output_data),
-                                   dict);
+                                   dict, ESCAPE_BYTE, false);
 
   uint8_t expected[] = {0xAA, 0x07};
 
@@ -629,7 +646,7 @@ int test_decompress_mixed_literals_and_run(void) {
 
   size_t out_len = decompress_data(input_data, sizeof(input_data),
                                    output_data, sizeof(output_data),
-                                   dict);
+                                   dict, ESCAPE_BYTE, false);
 
   uint8_t expected[] = {0x10, 0x31, 0x31, 0x20};
 
@@ -659,7 +676,7 @@ int test_decompress_repeat_count_zero(void) {
 
   size_t out_len = decompress_data(input_data, sizeof(input_data),
                                    output_data, sizeof(output_data),
-                                   dict);
+                                   dict, ESCAPE_BYTE, false);
 
   // Expect nothing written
   if (out_len != 0) {
@@ -681,7 +698,7 @@ int test_decompress_empty_input(void) {
 
   size_t out_len = decompress_data(&dummy, 0,
                                    output_data, sizeof(output_data),
-                                   dict);
+                                   dict, ESCAPE_BYTE, false);
 
   if (out_len != 0) {
     printf("FAIL test_decompress_empty_input: out_len got %lu expected 0\n",
@@ -931,126 +948,2096 @@ int test_float3_output_too_small(void) {
   return 0;
 }
 
+//------------------------------------------
+//          BLOCK CACHE TESTS:
+//-------------------------------------------
 
-int main(void) {
-  // Test the LFSR implementation
-  int result = test_lfsr_step();
-  if (result != 0) {
-    printf("Error when testing LFSR implementation\n");
+static block_cache_key_t demo_key(uint64_t block_number) {
+  block_cache_key_t key = {0};
+  key.device       = 1;
+  key.inode        = 42;
+  key.file_size    = 4096;
+  key.mtime_ns     = 1000;
+  key.block_number = block_number;
+  return key;
+}
+
+// insert then look up: first lookup of a different block misses, the inserted one hits
+int test_block_cache_hit_miss(void) {
+  block_cache_t* cache = block_cache_create(1 << 20);
+  uint8_t block[] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+  uint8_t out[16];
+  size_t out_len = 0;
+
+  block_cache_key_t key = demo_key(3);
+  block_cache_insert(cache, &key, block, sizeof(block));
+
+  block_cache_key_t other = demo_key(4);
+  if (block_cache_lookup(cache, &other, out, sizeof(out), &out_len)) {
+    printf("FAIL test_block_cache_hit_miss: unexpected hit for uncached block\n");
+    block_cache_destroy(cache);
     return 1;
   }
 
-  // // TODO - add tests here for other functionality
-  // // You can craft arbitrary array data as inputs to the functions
-  // // Parsing headers, checksumming, decryption, and decompressing are all testable
+  if (!block_cache_lookup(cache, &key, out, sizeof(out), &out_len) ||
+      out_len != sizeof(block) || memcmp(out, block, sizeof(block)) != 0) {
+    printf("FAIL test_block_cache_hit_miss: cached block not returned\n");
+    block_cache_destroy(cache);
+    return 1;
+  }
 
+  // a block decrypted under one key is never handed out under another
+  block_cache_key_t other_password = key;
+  other_password.encryption_key = 0x1337;
+  if (block_cache_lookup(cache, &other_password, out, sizeof(out), &out_len)) {
+    printf("FAIL test_block_cache_hit_miss: block returned for a different encryption key\n");
+    block_cache_destroy(cache);
+    return 1;
+  }
+  block_cache_insert(cache, &other_password, out, sizeof(block) - 1);
+  if (!block_cache_lookup(cache, &key, out, sizeof(out), &out_len) || out_len != sizeof(block)) {
+    printf("FAIL test_block_cache_hit_miss: a different key's block replaced this one\n");
+    block_cache_destroy(cache);
+    return 1;
+  }
 
-// Test checksum implementation
-  result = example_test();
-  if (result != 0) {
-    printf("ERROR: example_test_setup failed\n");
+  // same inode but a different mtime is a different file
+  key.mtime_ns++;
+  if (block_cache_lookup(cache, &key, out, sizeof(out), &out_len)) {
+    printf("FAIL test_block_cache_hit_miss: stale block returned for rewritten file\n");
+    block_cache_destroy(cache);
     return 1;
   }
-  result = test_checksum_empty();
-  if (result != 0) { printf("ERROR: test_checksum_empty failed\n"); return 1; }
 
-  result = test_checksum_single_byte();
-  if (result != 0) { printf("ERROR: test_checksum_single_byte failed\n"); return 1; }
-  
+  block_cache_stats_t stats = block_cache_get_stats(cache);
+  block_cache_destroy(cache);
+  if (stats.hits != 2 || stats.misses != 3 || stats.entries != 2 || stats.bytes_used != 2 * sizeof(block) - 1) {
+    printf("FAIL test_block_cache_hit_miss: counters wrong (hits %lu misses %lu)\n",
+           (unsigned long)stats.hits, (unsigned long)stats.misses);
+    return 1;
+  }
+  return 0;
+}
 
-  // Test parse_header implementation
-  result = test_parse_header();
-  if (result != 0) { printf("ERROR: test_parse_header failed\n"); return 1; }
+// inserting far more than the budget evicts, and never exceeds the budget
+int test_block_cache_eviction(void) {
+  size_t budget = BLOCK_CACHE_SHARDS * 100;
+  block_cache_t* cache = block_cache_create(budget);
+  uint8_t block[60];
+  uint8_t out[60];
+  size_t out_len = 0;
+
+  for (uint64_t i = 0; i < 256; i++) {
+    memset(block, (int)i, sizeof(block));
+    block_cache_key_t key = demo_key(i);
+    block_cache_insert(cache, &key, block, sizeof(block));
+  }
 
-  result = test_parse_header_minimal_20();
-  if (result != 0) { printf("ERROR: test_parse_header_minimal_20 failed\n"); return 1; }
+  block_cache_stats_t stats = block_cache_get_stats(cache);
+  if (stats.bytes_used > budget || stats.evictions == 0 || stats.insertions != 256) {
+    printf("FAIL test_block_cache_eviction: used %lu of %lu bytes with %lu evictions\n",
+           (unsigned long)stats.bytes_used, (unsigned long)budget, (unsigned long)stats.evictions);
+    block_cache_destroy(cache);
+    return 1;
+  }
 
-  result = test_parse_header_checksum_only_22();
-  if (result != 0) { printf("ERROR: test_parse_header_checksum_only_22 failed\n"); return 1; }
+  // the most recently inserted block is always still present
+  block_cache_key_t last = demo_key(255);
+  if (!block_cache_lookup(cache, &last, out, sizeof(out), &out_len) || out[0] != 255) {
+    printf("FAIL test_block_cache_eviction: most recent block was evicted\n");
+    block_cache_destroy(cache);
+    return 1;
+  }
 
-  result = test_parse_header_compression_only_36();
-  if (result != 0) { printf("ERROR: test_parse_header_compression_only_36 failed\n"); return 1; }
+  block_cache_invalidate_file(cache, &last);
+  stats = block_cache_get_stats(cache);
+  block_cache_destroy(cache);
+  if (stats.entries != 0 || stats.bytes_used != 0) {
+    printf("FAIL test_block_cache_eviction: invalidate left %lu entries\n", (unsigned long)stats.entries);
+    return 1;
+  }
+  return 0;
+}
 
-  result = test_parse_header_too_short();
-  if (result != 0) { printf("ERROR: test_parse_header_too_short failed\n"); return 1; }
+//------------------------------------------
+//          CRC32C TESTS:
+//-------------------------------------------
 
-  result = test_parse_header_wrong_magic();
-  if (result != 0) { printf("ERROR: test_parse_header_wrong_magic failed\n"); return 1; }
+// standard check value: CRC32C of the ASCII digits "123456789"
+int test_crc32c_check_value(void) {
+  uint8_t digits[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+  uint32_t got = crc32c_update(0, digits, sizeof(digits));
+  if (got != 0xE3069283u) {
+    printf("FAIL test_crc32c_check_value: got 0x%08X expected 0xE3069283\n", got);
+    return 1;
+  }
+  return 0;
+}
 
-  result = test_parse_header_wrong_version();
-  if (result != 0) { printf("ERROR: test_parse_header_wrong_version failed\n"); return 1; }
+// feeding a long buffer in odd-sized pieces must match feeding it at once
+// (the long single call goes through the interleaved hardware lanes when available)
+int test_crc32c_incremental(void) {
+  size_t len = 100000;
+  uint8_t* data = malloc_and_check(len);
+  uint16_t state = 0xACE1;
+  for (size_t i = 0; i < len; i++) {
+    state = lfsr_step(state);
+    data[i] = (uint8_t)state;
+  }
 
-  result = test_parse_header_compressed_but_short();
-  if (result != 0) { printf("ERROR: test_parse_header_compressed_but_short failed\n"); return 1; }
+  uint32_t whole = crc32c_update(0, data, len);
+  uint32_t pieces = 0;
+  size_t offset = 0;
+  size_t piece_len = 1;
+  while (offset < len) {
+    size_t n = (len - offset < piece_len) ? len - offset : piece_len;
+    pieces = crc32c_update(pieces, &data[offset], n);
+    offset += n;
+    piece_len = piece_len * 3 + 1;
+  }
+  free(data);
 
-  result = test_parse_header_checksummed_but_short();
-  if (result != 0) { printf("ERROR: test_parse_header_checksummed_but_short failed\n"); return 1; }
+  if (whole != pieces) {
+    printf("FAIL test_crc32c_incremental: whole 0x%08X pieces 0x%08X\n", whole, pieces);
+    return 1;
+  }
+  return 0;
+}
 
+// extension flags with CRC32C: header is 20 + 2 + 2 (checksum) + 4 (crc) bytes
+int test_parse_header_crc32c(void) {
+  uint8_t hdr[28] = {
+    0x02, 0x13, 0x03, 0x21,                          // checksummed + extended
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // orig=1
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // data=1
+    0x00, 0x01,                                      // extension flags: CRC32C
+    0xBE, 0xEF,                                      // checksum (big-endian)
+    0xDE, 0xAD, 0xBE, 0xEF                           // crc32c (big-endian)
+  };
 
-  // Test the decrypt data implementation
-  result = test_decrypt_4byte_example_in_handout();
-  if (result != 0) { printf("ERROR: test_decrypt_4byte_example_in_handout failed\n"); return 1; }
+  packlab_config_t cfg;
+  memset(&cfg, 0x5A, sizeof(cfg));
+  parse_header(hdr, sizeof(hdr), &cfg);
 
-  result = test_decrypt_1byte_example_in_handout();
-  if (result != 0) { printf("ERROR: test_decrypt_1byte_example_in_handout failed\n"); return 1; }
+  if (!cfg.is_valid || cfg.header_len != 28) {
+    printf("FAIL test_parse_header_crc32c: is_valid %d header_len %lu\n",
+           cfg.is_valid, (unsigned long)cfg.header_len);
+    return 1;
+  }
+  if (!cfg.is_crc32c || cfg.crc32c_value != 0xDEADBEEFu || cfg.checksum_value != 0xBEEF) {
+    printf("FAIL test_parse_header_crc32c: crc fields mismatch\n");
+    return 1;
+  }
 
-  result = test_decrypt_output_len_too_small();
-  if (result != 0) { printf("ERROR: test_decrypt_output_len_too_small failed\n"); return 1; }
+  // one byte short of the crc is invalid
+  parse_header(hdr, sizeof(hdr) - 1, &cfg);
+  if (cfg.is_valid) {
+    printf("FAIL test_parse_header_crc32c: truncated header accepted\n");
+    return 1;
+  }
+  return 0;
+}
 
-  //test decompress
-  result = test_decompress_handout_example();
-  if (result != 0) { printf("ERROR: test_decompress_handout_example failed\n"); return 1; }
+// extension flags with per-block checksums: header is 20 + 2 + 1 (block size) bytes
+int test_parse_header_block_checksums(void) {
+  uint8_t hdr[23] = {
+    0x02, 0x13, 0x03, 0x01,                          // extended only
+    0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // orig=12288
+    0x01, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // data=12289
+    0x00, 0x02,                                      // extension flags: block checksums
+    0x0C                                             // block size 2^12
+  };
 
-  result = test_decompress_literal_escape();
-  if (result != 0) { printf("ERROR: test_decompress_literal_escape failed\n"); return 1; }
+  packlab_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  parse_header(hdr, sizeof(hdr), &cfg);
 
-  result = test_decompress_trailing_escape_byte();
-  if (result != 0) { printf("ERROR: test_decompress_trailing_escape_byte failed\n"); return 1; }
+  if (!cfg.is_valid || cfg.header_len != 23 || !cfg.has_block_checksums || cfg.is_crc32c) {
+    printf("FAIL test_parse_header_block_checksums: flags or header_len mismatch\n");
+    return 1;
+  }
 
-  result = test_decompress_mixed_literals_and_run();
-  if (result != 0) { printf("ERROR: test_decompress_mixed_literals_and_run failed\n"); return 1; }
+  // 12289 bytes in 4096 byte blocks: 3 full blocks and 1 partial
+  if (cfg.block_size != 4096 || block_count(&cfg) != 4 || block_table_len(&cfg) != 4 * BLOCK_ENTRY_LEN) {
+    printf("FAIL test_parse_header_block_checksums: block size %lu count %lu\n",
+           (unsigned long)cfg.block_size, (unsigned long)block_count(&cfg));
+    return 1;
+  }
 
-  result = test_decompress_repeat_count_zero();
-  if (result != 0) { printf("ERROR: test_decompress_repeat_count_zero failed\n"); return 1; }
+  // block sizes below 4 KiB are not allowed
+  hdr[22] = 0x04;
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (cfg.is_valid) {
+    printf("FAIL test_parse_header_block_checksums: tiny block size accepted\n");
+    return 1;
+  }
+  return 0;
+}
 
-  result = test_decompress_empty_input();
-  if (result != 0) { printf("ERROR: test_decompress_empty_input failed\n"); return 1; }
+// extension flags this decoder doesn't know make the header invalid
+int test_parse_header_unknown_ext_flags(void) {
+  uint8_t hdr[22] = {
+    0x02, 0x13, 0x03, 0x01,                          // extended only
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // orig=1
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // data=1
+    0x00, 0x00                                       // extension flags: none
+  };
 
-  // test two-stream floating point
-    result = test_join_float_single_300();
-  if (result != 0) { printf("ERROR: test_join_float_single_300 failed\n"); return 1; }
+  packlab_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (!cfg.is_valid || cfg.header_len != 22) {
+    printf("FAIL test_parse_header_unknown_ext_flags: header without extensions rejected\n");
+    return 1;
+  }
 
-  result = test_join_float_single_deadbeef();
-  if (result != 0) { printf("ERROR: test_join_float_single_deadbeef failed\n"); return 1; }
+  for (int bit = 8; bit < 16; bit++) {
+    hdr[20] = (uint8_t)((1u << bit) >> 8);
+    parse_header(hdr, sizeof(hdr), &cfg);
+    if (cfg.is_valid) {
+      printf("FAIL test_parse_header_unknown_ext_flags: accepted extension flag 0x%04X\n", 1u << bit);
+      return 1;
+    }
+  }
+  return 0;
+}
 
-  //result = test_join_float_two_values();
-  //if (result != 0) { printf("ERROR: test_join_float_two_values failed\n"); return 1; }
+// table entries are a big-endian crc followed by a little-endian length
+int test_read_block_entry(void) {
+  uint8_t table[2 * BLOCK_ENTRY_LEN] = {
+    0x11, 0x22, 0x33, 0x44, 0x00, 0x10, 0x00, 0x00,
+    0xDE, 0xAD, 0xBE, 0xEF, 0x05, 0x00, 0x00, 0x00
+  };
+  uint32_t crc = 0;
+  uint32_t len = 0;
 
-  result = test_join_float_empty();
-  if (result != 0) { printf("ERROR: test_join_float_empty failed\n"); return 1; }
+  read_block_entry(table, 1, &crc, &len);
+  if (crc != 0xDEADBEEFu || len != 5) {
+    printf("FAIL test_read_block_entry: got crc 0x%08X len %u\n", crc, len);
+    return 1;
+  }
 
-  result = test_join_float_length_mismatch();
-  if (result != 0) { printf("ERROR: test_join_float_length_mismatch failed\n"); return 1; }
+  read_block_entry(table, 0, &crc, &len);
+  if (crc != 0x11223344u || len != 4096) {
+    printf("FAIL test_read_block_entry: got crc 0x%08X len %u\n", crc, len);
+    return 1;
+  }
+  return 0;
+}
 
-  result = test_join_float_output_too_small();
-  if (result != 0) { printf("ERROR: test_join_float_output_too_small failed\n"); return 1; }
-  
+//------------------------------------------
+//          INCREMENTAL CHECKSUM TESTS:
+//-------------------------------------------
 
-  // test tri-stream floating point
-  result = test_float3_single_pos1();
-  if (result != 0) { printf("ERROR: test_float3_single_pos1 failed\n"); return 1; }
+// pieces summed separately (as if on different threads) and combined in any
+// order must match the one-shot checksum
+int test_checksum_incremental_combine(void) {
+  uint8_t data[1000];
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t)(i * 37 + 11);
+  }
+  uint16_t expected = calculate_checksum(data, sizeof(data));
+
+  checksum_state_t first, second, third;
+  checksum_init(&first);
+  checksum_init(&second);
+  checksum_init(&third);
+  checksum_update(&first, data, 333);
+  checksum_update(&second, &data[333], 1);
+  checksum_update(&second, &data[334], 400);
+  checksum_update(&third, &data[734], sizeof(data) - 734);
+
+  checksum_combine(&third, &first);
+  checksum_combine(&third, &second);
+  uint16_t got = checksum_final(&third);
+  if (got != expected) {
+    printf("FAIL test_checksum_incremental_combine: got 0x%04X expected 0x%04X\n", got, expected);
+    return 1;
+  }
 
-  result = test_float3_single_neg1();
-  if (result != 0) {printf("ERROR: test_float3_single_neg1 failed\n"); return 1; }
+  // an untouched state is the checksum of nothing
+  checksum_state_t empty;
+  checksum_init(&empty);
+  if (checksum_final(&empty) != 0) {
+    printf("FAIL test_checksum_incremental_combine: empty state is not 0\n");
+    return 1;
+  }
+  return 0;
+}
 
-  result = test_float3_two_values();
-  if (result != 0) { printf("ERROR: test_float3_two_values failed\n"); return 1; }
+// the sum wraps at 16 bits no matter how it is split
+int test_checksum_incremental_overflow(void) {
+  size_t len = 70000;
+  uint8_t* data = malloc_and_check(len);
+  memset(data, 0xFF, len);
+
+  checksum_state_t state;
+  checksum_init(&state);
+  checksum_update(&state, data, len / 2);
+  checksum_update(&state, &data[len / 2], len - len / 2);
+  uint16_t got = checksum_final(&state);
+  free(data);
+
+  uint16_t expected = (uint16_t)(0xFFu * 70000u);
+  if (got != expected) {
+    printf("FAIL test_checksum_incremental_overflow: got 0x%04X expected 0x%04X\n", got, expected);
+    return 1;
+  }
+  return 0;
+}
 
-  result = test_float3_zero_length();
-  if (result != 0) { printf("ERROR: test_float3_zero_length failed\n"); return 1; }
+// an escape pair split across two pieces decodes the same as in one piece
+int test_decompress_resume_split_escape(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+  uint8_t input[] = { 0x41, ESCAPE_BYTE, 0x35, 0x42 };
+  uint8_t whole[32];
+  uint8_t pieces[32];
+  size_t whole_len = decompress_data(input, sizeof(input), whole, sizeof(whole), dict, ESCAPE_BYTE, false);
+
+  // first piece ends on the escape byte, which must be left for later
+  size_t used = 0;
+  size_t out_len = decompress_data_resume(input, 2, pieces, sizeof(pieces), dict, ESCAPE_BYTE, false, false, &used);
+  if (used != 1 || out_len != 1) {
+    printf("FAIL test_decompress_resume_split_escape: used %lu wrote %lu\n",
+           (unsigned long)used, (unsigned long)out_len);
+    return 1;
+  }
 
-  result = test_float3_output_too_small();
-  if (result != 0) { printf("ERROR: test_float3_output_too_small failed\n"); return 1; }
+  out_len += decompress_data_resume(&input[used], sizeof(input) - used, &pieces[out_len],
+                                    sizeof(pieces) - out_len, dict, ESCAPE_BYTE, false, true, &used);
+  if (out_len != whole_len || memcmp(whole, pieces, whole_len) != 0 || used != sizeof(input) - 1) {
+    printf("FAIL test_decompress_resume_split_escape: pieces don't match one-shot decode\n");
+    return 1;
+  }
+  return 0;
+}
+
+// a run that doesn't fit in the output is left unconsumed rather than cut short
+int test_decompress_resume_output_full(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+  uint8_t input[] = { 0x41, ESCAPE_BYTE, 0x51 };
+  uint8_t out[4];
+  size_t used = 0;
+
+  size_t out_len = decompress_data_resume(input, sizeof(input), out, sizeof(out), dict, ESCAPE_BYTE, false, true, &used);
+  if (out_len != 1 || used != 1) {
+    printf("FAIL test_decompress_resume_output_full: used %lu wrote %lu\n",
+           (unsigned long)used, (unsigned long)out_len);
+    return 1;
+  }
+  return 0;
+}
+
+// a cursor over an encrypted, compressed, checksummed stream hands out the same
+// bytes as decoding it all at once, however small the reads
+int test_stream_cursor_matches_whole_decode(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+  uint8_t plain[] = { 0x41, ESCAPE_BYTE, 0x35, ESCAPE_BYTE, 0x00, 0x42, ESCAPE_BYTE, 0xF1, 0x43 };
+  uint8_t expected[64];
+  size_t expected_len = decompress_data(plain, sizeof(plain), expected, sizeof(expected), dict, ESCAPE_BYTE, false);
+
+  // encryption is an XOR, so encrypting is the same as decrypting
+  uint16_t key = 0x1337;
+  uint8_t stored[sizeof(plain)];
+  decrypt_data(plain, sizeof(plain), stored, sizeof(stored), key);
+
+  packlab_config_t config = {0};
+  config.is_valid       = true;
+  config.is_compressed  = true;
+  config.is_encrypted   = true;
+  config.is_checksummed = true;
+  config.checksum_value = calculate_checksum(stored, sizeof(stored));
+  config.orig_data_size = expected_len;
+  config.data_size      = sizeof(stored);
+  config.escape_byte    = ESCAPE_BYTE;
+  memcpy(config.dictionary_data, dict, DICTIONARY_LENGTH);
+
+  stream_cursor_t cursor;
+  stream_cursor_init(&cursor, &config, stored, key);
+  uint8_t got[64];
+  size_t got_len = 0;
+  while (stream_cursor_read(&cursor, &got[got_len], 1) == 1) {
+    got_len++;
+  }
+  bool intact = stream_cursor_is_intact(&cursor);
+  stream_cursor_free(&cursor);
+
+  if (got_len != expected_len || memcmp(got, expected, expected_len) != 0 || !intact) {
+    printf("FAIL test_stream_cursor_matches_whole_decode: got %lu bytes, intact %d\n",
+           (unsigned long)got_len, intact);
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          INCREMENTAL DECODER TESTS:
+//----------------------------------------------------------------------------
+
+// Builds a single-stream packed file (compressed, encrypted, checksummed)
+// Returns its length
+static size_t build_stream_test_file(uint8_t* file, size_t file_len, uint8_t* expected, size_t* expected_len,
+                                     uint16_t key) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+  uint8_t plain[] = { 0x41, ESCAPE_BYTE, 0x35, ESCAPE_BYTE, 0x00, 0x42, ESCAPE_BYTE, 0xF1, 0x43, ESCAPE_BYTE };
+  *expected_len = decompress_data(plain, sizeof(plain), expected, 64, dict, ESCAPE_BYTE, false);
+
+  memset(file, 0, file_len);
+  uint8_t* stored = &file[DATA_ALIGN];
+  decrypt_data(plain, sizeof(plain), stored, sizeof(plain), key);
+  uint16_t checksum = calculate_checksum(stored, sizeof(plain));
+
+  uint8_t header[] = { 0x02, 0x13, 0x03, 0xE0 };
+  memcpy(file, header, sizeof(header));
+  for (int i = 0; i < 8; i++) {
+    file[4 + i]  = (uint8_t)((uint64_t)*expected_len >> (8 * i));
+    file[12 + i] = (uint8_t)((uint64_t)sizeof(plain) >> (8 * i));
+  }
+  memcpy(&file[20], dict, DICTIONARY_LENGTH);
+  file[36] = (uint8_t)(checksum >> 8);
+  file[37] = (uint8_t)(checksum & 0xFF);
+  return DATA_ALIGN + sizeof(plain);
+}
+
+int test_packlab_stream_byte_at_a_time(void) {
+  static uint8_t file[DATA_ALIGN + 64];
+  uint8_t expected[64];
+  size_t expected_len = 0;
+  uint16_t key = 0x1337;
+  size_t file_len = build_stream_test_file(file, sizeof(file), expected, &expected_len, key);
+
+  // one byte in, at most one byte out, at every step
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  packlab_stream_init(ctx, key);
+  uint8_t got[64];
+  size_t got_len = 0;
+  packlab_stream_status_t status = PACKLAB_STREAM_OK;
+  for (size_t i = 0; i < file_len && status == PACKLAB_STREAM_OK; i++) {
+    packlab_stream_feed(ctx, &file[i], 1);
+    size_t produced = 0;
+    do {
+      status = packlab_stream_drain(ctx, &got[got_len], 1, &produced);
+      got_len += produced;
+    } while (status == PACKLAB_STREAM_OK && produced == 1 && got_len < sizeof(got));
+  }
+  status = packlab_stream_end(ctx);
+  free(ctx);
+
+  if (status != PACKLAB_STREAM_END || got_len != expected_len || memcmp(got, expected, expected_len) != 0) {
+    printf("FAIL test_packlab_stream_byte_at_a_time: status %d, got %lu bytes (expected %lu)\n",
+           (int)status, (unsigned long)got_len, (unsigned long)expected_len);
+    return 1;
+  }
+  return 0;
+}
+
+int test_packlab_stream_detects_bad_input(void) {
+  static uint8_t file[DATA_ALIGN + 64];
+  uint8_t expected[64];
+  size_t expected_len = 0;
+  uint16_t key = 0x1337;
+  size_t file_len = build_stream_test_file(file, sizeof(file), expected, &expected_len, key);
+  uint8_t got[64];
+  size_t produced = 0;
+
+  // truncated: everything fed decodes, but the file never finishes
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  packlab_stream_init(ctx, key);
+  packlab_stream_feed(ctx, file, file_len - 1);
+  packlab_stream_status_t drained = packlab_stream_drain(ctx, got, sizeof(got), &produced);
+  packlab_stream_status_t truncated = packlab_stream_end(ctx);
+
+  // corrupted: the checksum no longer matches
+  file[DATA_ALIGN] ^= 0x01;
+  packlab_stream_init(ctx, key);
+  packlab_stream_feed(ctx, file, file_len);
+  packlab_stream_status_t corrupted = packlab_stream_drain(ctx, got, sizeof(got), &produced);
+  packlab_stream_end(ctx);
+  free(ctx);
+
+  if (drained != PACKLAB_STREAM_OK || truncated != PACKLAB_STREAM_ERROR || corrupted != PACKLAB_STREAM_ERROR) {
+    printf("FAIL test_packlab_stream_detects_bad_input: drained %d, truncated %d, corrupted %d\n",
+           (int)drained, (int)truncated, (int)corrupted);
+    return 1;
+  }
+  return 0;
+}
+
+int test_packlab_stream_untrusted_float_size(void) {
+  static uint8_t file[DATA_ALIGN + 64];
+  uint8_t expected[64];
+  size_t expected_len = 0;
+  uint16_t key = 0x1337;
+  size_t file_len = build_stream_test_file(file, sizeof(file), expected, &expected_len, key);
+
+  // the first stream of a float file claiming to expand to 2^50 bytes: only
+  // what actually decodes is held, and the stream is rejected for its length
+  file[3] |= 0x10;
+  file[10] = 0x04;
+
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  packlab_stream_init(ctx, key);
+  packlab_stream_feed(ctx, file, file_len);
+  uint8_t got[64];
+  size_t produced = 0;
+  packlab_stream_status_t drained = packlab_stream_drain(ctx, got, sizeof(got), &produced);
+  uint64_t capacity = ctx->float_capacity[0];
+  packlab_stream_status_t ended = packlab_stream_end(ctx);
+  free(ctx);
+
+  if (drained == PACKLAB_STREAM_END || ended != PACKLAB_STREAM_ERROR || produced != 0 ||
+      capacity > PACKLAB_STREAM_GROW_MIN) {
+    printf("FAIL test_packlab_stream_untrusted_float_size: status %d then %d, %lu bytes held\n",
+           (int)drained, (int)ended, (unsigned long)capacity);
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          SPSC RING TESTS:
+//----------------------------------------------------------------------------
+
+#define RING_TEST_ITEMS 100000
+
+static void* ring_test_producer(void* arg) {
+  spsc_ring_t* ring = (spsc_ring_t*)arg;
+  for (uintptr_t i = 1; i <= RING_TEST_ITEMS; i++) {
+    spsc_ring_push(ring, (void*)i);
+  }
+  return NULL;
+}
+
+int test_spsc_ring_keeps_order_across_threads(void) {
+  // a tiny ring, so the producer is constantly waiting for room
+  spsc_ring_t ring;
+  spsc_ring_init(&ring, 3);
+  void* item = NULL;
+  bool empty_at_start = !spsc_ring_try_pop(&ring, &item);
+
+  pthread_t producer;
+  pthread_create(&producer, NULL, ring_test_producer, &ring);
+  uintptr_t out_of_order = 0;
+  for (uintptr_t i = 1; i <= RING_TEST_ITEMS; i++) {
+    uintptr_t got = (uintptr_t)spsc_ring_pop(&ring);
+    if (got != i && out_of_order == 0) {
+      out_of_order = i;
+    }
+  }
+  pthread_join(producer, NULL);
+  bool empty_at_end = !spsc_ring_try_pop(&ring, &item);
+  size_t capacity = ring.capacity;
+  spsc_ring_free(&ring);
+
+  if (!empty_at_start || !empty_at_end || out_of_order != 0 || capacity != 4) {
+    printf("FAIL test_spsc_ring_keeps_order_across_threads: first bad item %lu, capacity %lu\n",
+           (unsigned long)out_of_order, (unsigned long)capacity);
+    return 1;
+  }
+  return 0;
+}
+
+#define RING_TEST_IDLE_NS (200 * 1000 * 1000)
+
+static void* ring_test_idle_consumer(void* arg) {
+  spsc_ring_t* ring = (spsc_ring_t*)arg;
+  struct timespec start, end;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  spsc_ring_pop(ring);
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+  uintptr_t cpu_ns = (uintptr_t)((end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec));
+  return (void*)cpu_ns;
+}
+
+int test_spsc_ring_sleeps_while_idle(void) {
+  spsc_ring_t ring;
+  spsc_ring_init(&ring, 4);
+
+  // the consumer waits on an empty ring for a while before anything arrives
+  pthread_t consumer;
+  pthread_create(&consumer, NULL, ring_test_idle_consumer, &ring);
+  struct timespec idle = { 0, RING_TEST_IDLE_NS };
+  nanosleep(&idle, NULL);
+  spsc_ring_push(&ring, &ring);
+  void* cpu_ns = NULL;
+  pthread_join(consumer, &cpu_ns);
+  spsc_ring_free(&ring);
+
+  // it should have been asleep, not polling, for nearly all of that time
+  if ((uintptr_t)cpu_ns > RING_TEST_IDLE_NS / 4) {
+    printf("FAIL test_spsc_ring_sleeps_while_idle: consumer used %lu ns of CPU waiting\n",
+           (unsigned long)(uintptr_t)cpu_ns);
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          ASYNC IO TESTS:
+//----------------------------------------------------------------------------
+
+int test_async_io_round_trip(void) {
+  // both backends: io_uring (if the kernel allows it) and pread/pwrite
+  for (int allow_io_uring = 0; allow_io_uring <= 1; allow_io_uring++) {
+    FILE* file = tmpfile();
+    if (file == NULL) {
+      printf("FAIL test_async_io_round_trip: could not create a temporary file\n");
+      return 1;
+    }
+    int fd = fileno(file);
+
+    static uint8_t written[16 * DATA_ALIGN];
+    static uint8_t read_back[16 * DATA_ALIGN];
+    for (size_t i = 0; i < sizeof(written); i++) {
+      written[i] = (uint8_t)(i * 131 + allow_io_uring);
+    }
+    memset(read_back, 0, sizeof(read_back));
+
+    // more chunks than the queue is deep, completing in any order
+    async_io_t io;
+    async_io_init(&io, 4, allow_io_uring);
+    async_io_register_buffer(&io, written, sizeof(written));
+    bool ok = true;
+    int64_t result = 0;
+    for (int pass = 0; pass < 2; pass++) {
+      for (size_t chunk = 0; chunk < 16; chunk++) {
+        if (!async_io_can_submit(&io)) {
+          ok = ok && async_io_wait(&io, &result) != NULL && result == DATA_ALIGN;
+        }
+        if (pass == 0) {
+          async_io_submit_write(&io, fd, &written[chunk * DATA_ALIGN], DATA_ALIGN, chunk * DATA_ALIGN, &written);
+        } else {
+          async_io_submit_read(&io, fd, &read_back[chunk * DATA_ALIGN], DATA_ALIGN, chunk * DATA_ALIGN, &read_back);
+        }
+      }
+      while (io.in_flight > 0) {
+        ok = ok && async_io_wait(&io, &result) != NULL && result == DATA_ALIGN;
+      }
+    }
+
+    // reading past the end comes back short
+    async_io_submit_read(&io, fd, read_back, DATA_ALIGN, sizeof(written) - 10, NULL);
+    async_io_wait(&io, &result);
+    bool short_at_end = (result == 10);
+    async_io_free(&io);
+    fclose(file);
+
+    if (!ok || !short_at_end || memcmp(written, &read_back[DATA_ALIGN], sizeof(written) - DATA_ALIGN) != 0) {
+      printf("FAIL test_async_io_round_trip: io_uring allowed %d, ok %d, short read %d\n",
+             allow_io_uring, ok, short_at_end);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          BUFFER POOL TESTS:
+//----------------------------------------------------------------------------
+
+int test_buffer_pool_reuse_and_peak(void) {
+  buffer_pool_t* pool = buffer_pool_create(8 * BUFFER_POOL_GRANULE, 0);
+
+  uint8_t* a = buffer_pool_get(pool, 3 * BUFFER_POOL_GRANULE);
+  uint8_t* b = buffer_pool_get(pool, 1000);
+  bool aligned = ((uintptr_t)a % DATA_ALIGN) == 0 && ((uintptr_t)b % DATA_ALIGN) == 0;
+  memset(a, 0xAB, 3 * BUFFER_POOL_GRANULE);
+  buffer_pool_put(pool, a);
+
+  // a slightly smaller request reuses the same buffer, a much smaller one doesn't
+  uint8_t* c = buffer_pool_get(pool, 3 * BUFFER_POOL_GRANULE - 5);
+  uint8_t* d = buffer_pool_get(pool, BUFFER_POOL_GRANULE);
+  buffer_pool_put(pool, b);
+  buffer_pool_put(pool, c);
+  buffer_pool_put(pool, d);
+  buffer_pool_put(pool, NULL);
+
+  buffer_pool_stats_t stats = buffer_pool_get_stats(pool);
+  buffer_pool_destroy(pool);
+
+  uint64_t expected_peak = 4 * BUFFER_POOL_GRANULE + BUFFER_POOL_MIN_LEN;
+  if (!aligned || c != a || d == a || stats.gets != 4 || stats.reuses != 1 || stats.maps != 3 ||
+      stats.bytes_in_use != 0 || stats.peak_bytes_in_use != expected_peak) {
+    printf("FAIL test_buffer_pool_reuse_and_peak: reuses %lu, maps %lu, peak %lu (expected %lu)\n",
+           (unsigned long)stats.reuses, (unsigned long)stats.maps,
+           (unsigned long)stats.peak_bytes_in_use, (unsigned long)expected_peak);
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          IN-PLACE TESTS:
+//----------------------------------------------------------------------------
+
+int test_decrypt_in_place(void) {
+  uint8_t plain[] = { 0x10, 0x20, 0x30, 0x40, 0x50 };
+  uint8_t expected[sizeof(plain)];
+  decrypt_data(plain, sizeof(plain), expected, sizeof(expected), 0x1337);
+
+  uint8_t buffer[sizeof(plain)];
+  memcpy(buffer, plain, sizeof(plain));
+  decrypt_data(buffer, sizeof(buffer), buffer, sizeof(buffer), 0x1337);
+
+  if (memcmp(buffer, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_decrypt_in_place: in-place result differs\n");
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          SPECIALIZED DECODER TESTS:
+//----------------------------------------------------------------------------
+
+int test_stream_decoders_match_kernels(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+
+  // spans three chunks, with a run code split across the first boundary
+  size_t stored_len = 2 * STREAM_DECODER_CHUNK_LEN + 1000;
+  uint8_t* plain = malloc_and_check(stored_len);
+  uint32_t seed = 213;
+  for (size_t i = 0; i < stored_len; i++) {
+    seed = seed * 1103515245u + 12345u;
+    plain[i] = (uint8_t)(seed >> 16);
+  }
+  plain[STREAM_DECODER_CHUNK_LEN - 1] = ESCAPE_BYTE;
+  plain[STREAM_DECODER_CHUNK_LEN]     = 0xF3;
+  plain[stored_len - 1]               = ESCAPE_BYTE;
+
+  size_t output_cap = stored_len * 8;
+  uint8_t* expected = malloc_and_check(output_cap);
+  uint8_t* stored   = malloc_and_check(stored_len);
+  uint8_t* output   = malloc_and_check(output_cap);
+  packlab_config_t config = {0};
+  memcpy(config.dictionary_data, dict, DICTIONARY_LENGTH);
+  config.escape_byte = ESCAPE_BYTE;
+  config.is_crc32c   = true;
+
+  int failed = 0;
+  for (int flags = 0; flags < 8 && !failed; flags++) {
+    bool is_compressed = (flags & 4) != 0;
+    bool is_encrypted  = (flags & 2) != 0;
+    bool verify        = (flags & 1) != 0;
+
+    size_t expected_len = stored_len;
+    if (is_compressed) {
+      expected_len = decompress_data(plain, stored_len, expected, output_cap, dict, ESCAPE_BYTE, false);
+    } else {
+      memcpy(expected, plain, stored_len);
+    }
+    // decryption is its own inverse
+    if (is_encrypted) {
+      decrypt_data(plain, stored_len, stored, stored_len, 0x1337);
+    } else {
+      memcpy(stored, plain, stored_len);
+    }
+    uint16_t expected_checksum = calculate_checksum(stored, stored_len);
+    uint32_t expected_crc32c   = crc32c_update(0, stored, stored_len);
+
+    stream_decoder_state_t state;
+    stream_decoder_init(&state, &config, 0x1337);
+    stream_decoder_t decode = stream_decoder_select(is_compressed, is_encrypted, verify);
+    size_t got_len = decode(stored, stored_len, output, expected_len, &state);
+
+    if (!state.complete || got_len != expected_len || memcmp(output, expected, expected_len) != 0) {
+      printf("FAIL test_stream_decoders_match_kernels: flags %d decoded wrong\n", flags);
+      failed = 1;
+    } else if (verify && (checksum_final(&state.checksum) != expected_checksum ||
+                          state.crc32c != expected_crc32c)) {
+      printf("FAIL test_stream_decoders_match_kernels: flags %d checksummed wrong\n", flags);
+      failed = 1;
+    }
+
+    // one byte short of room must be reported as incomplete (decoding used up `stored`)
+    if (!failed) {
+      if (is_encrypted) {
+        decrypt_data(plain, stored_len, stored, stored_len, 0x1337);
+      } else {
+        memcpy(stored, plain, stored_len);
+      }
+      stream_decoder_init(&state, &config, 0x1337);
+      decode(stored, stored_len, output, expected_len - 1, &state);
+      if (state.complete) {
+        printf("FAIL test_stream_decoders_match_kernels: flags %d overflow not reported\n", flags);
+        failed = 1;
+      }
+    }
+  }
+
+  free(plain);
+  free(expected);
+  free(stored);
+  free(output);
+  return failed;
+}
+
+//----------------------------------------------------------------------------
+//          CPU DISPATCH TESTS:
+//----------------------------------------------------------------------------
+
+int test_cpu_isa_names(void) {
+  for (int level = 0; level < CPU_ISA_COUNT; level++) {
+    cpu_isa_t parsed = CPU_ISA_COUNT;
+    if (!cpu_isa_parse(cpu_isa_name((cpu_isa_t)level), &parsed) || parsed != (cpu_isa_t)level) {
+      printf("FAIL test_cpu_isa_names: %s does not parse back\n", cpu_isa_name((cpu_isa_t)level));
+      return 1;
+    }
+  }
+  cpu_isa_t parsed = CPU_ISA_SCALAR;
+  if (cpu_isa_parse("mmx", &parsed) || cpu_isa_active() > cpu_isa_detect()) {
+    printf("FAIL test_cpu_isa_names: bad level accepted\n");
+    return 1;
+  }
+  return 0;
+}
+
+int test_kernels_match_scalar(void) {
+  // random lengths and misalignments, around every kernel's block sizes
+  enum { MAX_FLOATS = 1000, TRIALS = 200 };
+  uint8_t* input  = malloc_and_check(4 * MAX_FLOATS + 64);
+  uint8_t* expect = malloc_and_check(4 * MAX_FLOATS);
+  uint8_t* got    = malloc_and_check(4 * MAX_FLOATS);
+  const kernel_table_t* scalar = kernels_for_isa(CPU_ISA_SCALAR);
+
+  uint32_t seed = 213;
+  int failed = 0;
+  for (int level = CPU_ISA_SCALAR + 1; level <= (int)cpu_isa_detect() && !failed; level++) {
+    const kernel_table_t* kernels = kernels_for_isa((cpu_isa_t)level);
+
+    for (int trial = 0; trial < TRIALS && !failed; trial++) {
+      for (size_t i = 0; i < 4 * MAX_FLOATS + 64; i++) {
+        seed = seed * 1103515245u + 12345u;
+        input[i] = (uint8_t)(seed >> 16);
+      }
+      seed = seed * 1103515245u + 12345u;
+      size_t n = (seed >> 8) % MAX_FLOATS;
+      size_t skew = (seed >> 4) % 16;
+      uint8_t* data = &input[skew];
+
+      if (kernels->byte_sum(data, 4 * n) != scalar->byte_sum(data, 4 * n) ||
+          kernels->crc32c(~0u, data, 4 * n) != scalar->crc32c(~0u, data, 4 * n)) {
+        printf("FAIL test_kernels_match_scalar: %s checksum differs for %lu bytes\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)(4 * n));
+        failed = 1;
+        break;
+      }
+
+      // a byte from somewhere in the data (or past it), so matches land at every offset
+      uint8_t needle = data[(seed >> 20) % (4 * n + 16)];
+      if (kernels->find_byte(data, 4 * n, needle) != scalar->find_byte(data, 4 * n, needle)) {
+        printf("FAIL test_kernels_match_scalar: %s byte search differs for %lu bytes\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)(4 * n));
+        failed = 1;
+        break;
+      }
+
+      // running sums and XORs, from a carried-in byte, on copies of the data
+      uint8_t prev = data[4 * n];
+      memcpy(expect, data, 4 * n);
+      memcpy(got, data, 4 * n);
+      bool prefix_ok = scalar->prefix_sum(expect, 4 * n, prev) == kernels->prefix_sum(got, 4 * n, prev) &&
+                       memcmp(got, expect, 4 * n) == 0 &&
+                       scalar->prefix_xor(expect, 4 * n, prev) == kernels->prefix_xor(got, 4 * n, prev) &&
+                       memcmp(got, expect, 4 * n) == 0;
+      if (!prefix_ok) {
+        printf("FAIL test_kernels_match_scalar: %s prefix scan differs for %lu bytes\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)(4 * n));
+        failed = 1;
+        break;
+      }
+
+      scalar->join_float(data, &data[3 * n], expect, n);
+      kernels->join_float(data, &data[3 * n], got, n);
+      if (memcmp(got, expect, 4 * n) != 0) {
+        printf("FAIL test_kernels_match_scalar: %s join differs for %lu floats\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)n);
+        failed = 1;
+        break;
+      }
+
+      // fraction bits, then exponents, then sign bits
+      size_t frac_len = (23 * n + 7) / 8;
+      scalar->join_float3(data, &data[frac_len], &data[frac_len + n], expect, n);
+      kernels->join_float3(data, &data[frac_len], &data[frac_len + n], got, n);
+      if (memcmp(got, expect, 4 * n) != 0) {
+        printf("FAIL test_kernels_match_scalar: %s three-stream join differs for %lu floats\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)n);
+        failed = 1;
+        break;
+      }
+
+      // random bits cover NaNs, infinities, subnormals and rounding ties
+      scalar->narrow_bf16(data, expect, n);
+      kernels->narrow_bf16(data, got, n);
+      bool narrow_ok = memcmp(got, expect, 2 * n) == 0;
+      scalar->narrow_fp16(data, expect, n);
+      kernels->narrow_fp16(data, got, n);
+      narrow_ok = narrow_ok && memcmp(got, expect, 2 * n) == 0;
+      if (!narrow_ok) {
+        printf("FAIL test_kernels_match_scalar: %s narrowing differs for %lu floats\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)n);
+        failed = 1;
+        break;
+      }
+
+      // doubles take 8 bytes each, so half as many fit in the same data
+      size_t n_doubles = n / 2;
+      scalar->join_double(data, &data[6 * n_doubles], expect, n_doubles);
+      kernels->join_double(data, &data[6 * n_doubles], got, n_doubles);
+      if (memcmp(got, expect, 8 * n_doubles) != 0) {
+        printf("FAIL test_kernels_match_scalar: %s double join differs for %lu doubles\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)n_doubles);
+        failed = 1;
+        break;
+      }
+      scalar->join_double3(data, &data[4 * n_doubles], &data[6 * n_doubles], expect, n_doubles);
+      kernels->join_double3(data, &data[4 * n_doubles], &data[6 * n_doubles], got, n_doubles);
+      if (memcmp(got, expect, 8 * n_doubles) != 0) {
+        printf("FAIL test_kernels_match_scalar: %s three-stream double join differs for %lu doubles\n",
+               cpu_isa_name((cpu_isa_t)level), (unsigned long)n_doubles);
+        failed = 1;
+      }
+    }
+  }
+
+  free(input);
+  free(expect);
+  free(got);
+  return failed;
+}
+
+//----------------------------------------------------------------------------
+//          DAEMON TESTS:
+//----------------------------------------------------------------------------
+
+int test_keystream_cache_matches_lfsr(void) {
+  // a little over one period, to check where the keystream starts repeating
+  size_t len = KEYSTREAM_PERIOD_LEN + 1001;
+  uint8_t* zeros    = malloc_and_check(len);
+  uint8_t* expected = malloc_and_check(len);
+  memset(zeros, 0, len);
+  keystream_cache_t* cache = keystream_cache_create();
+
+  int failed = 0;
+  uint16_t keys[] = { 0x1337, 0xBEEF, 0x1337 };
+  for (int k = 0; k < 3 && !failed; k++) {
+    // decrypting zeros gives the keystream itself
+    decrypt_data(zeros, len, expected, len, keys[k]);
+
+    const uint8_t* keystream = keystream_cache_get(cache, keys[k]);
+    for (size_t i = 0; i < len; i++) {
+      if (keystream[i % KEYSTREAM_PERIOD_LEN] != expected[i]) {
+        printf("FAIL test_keystream_cache_matches_lfsr: keystream for key %04x differs at byte %lu\n",
+               keys[k], (unsigned long)i);
+        failed = 1;
+        break;
+      }
+    }
+  }
+
+  keystream_cache_destroy(cache);
+  free(zeros);
+  free(expected);
+  return failed;
+}
+
+int test_stream_decoder_keystream_wraps(void) {
+  // longer than a keystream period, so one chunk is decrypted across the wrap
+  size_t stored_len = 3 * STREAM_DECODER_CHUNK_LEN + 3;
+  uint8_t* plain    = malloc_and_check(stored_len);
+  uint8_t* stored   = malloc_and_check(stored_len);
+  uint8_t* output   = malloc_and_check(stored_len);
+  for (size_t i = 0; i < stored_len; i++) {
+    plain[i] = (uint8_t)(i * 7);
+  }
+  decrypt_data(plain, stored_len, stored, stored_len, 0x1337);
+
+  keystream_cache_t* cache = keystream_cache_create();
+  packlab_config_t config = {0};
+  stream_decoder_state_t state;
+  stream_decoder_init(&state, &config, 0x1337);
+  state.keystream = keystream_cache_get(cache, 0x1337);
+  size_t got_len = stream_decoder_select(false, true, false)(stored, stored_len, output, stored_len, &state);
+
+  int failed = 0;
+  if (!state.complete || got_len != stored_len || memcmp(output, plain, stored_len) != 0) {
+    printf("FAIL test_stream_decoder_keystream_wraps: decrypted data differs\n");
+    failed = 1;
+  }
+
+  keystream_cache_destroy(cache);
+  free(plain);
+  free(stored);
+  free(output);
+  return failed;
+}
+
+int test_unpackd_args_round_trip(void) {
+  char arg0[] = "unpack", arg1[] = "--range=0:10", arg2[] = "fd:3", arg3[] = "/tmp/out";
+  char* args[] = { arg0, arg1, arg2, arg3 };
+  char buffer[64];
+  size_t len = unpackd_pack_args(4, args, buffer, sizeof(buffer));
+
+  char* unpacked[8];
+  int argc = unpackd_unpack_args(buffer, len, unpacked, 8);
+  if (argc != 4) {
+    printf("FAIL test_unpackd_args_round_trip: got %d arguments back\n", argc);
+    return 1;
+  }
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(unpacked[i], args[i]) != 0) {
+      printf("FAIL test_unpackd_args_round_trip: argument %d is \"%s\"\n", i, unpacked[i]);
+      return 1;
+    }
+  }
+
+  if (unpackd_pack_args(4, args, buffer, 10) != 0) {
+    printf("FAIL test_unpackd_args_round_trip: arguments too long for the buffer were packed\n");
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          HEADER CATALOG TESTS:
+//----------------------------------------------------------------------------
+
+int test_read_archive_headers(void) {
+  static uint8_t file[DATA_ALIGN + 64];
+  uint8_t expected[64];
+  size_t expected_len = 0;
+  size_t file_len = build_stream_test_file(file, sizeof(file), expected, &expected_len, 0x1337);
+
+  FILE* temp = tmpfile();
+  if (temp == NULL || fwrite(file, 1, file_len, temp) != file_len || fflush(temp) != 0) {
+    printf("FAIL test_read_archive_headers: could not create a temporary file\n");
+    return 1;
+  }
+
+  int failed = 0;
+  archive_headers_t headers;
+  const char* error = read_archive_headers(fileno(temp), file_len, &headers);
+  if (error != NULL || headers.num_streams != 1 || !headers.streams[0].is_compressed ||
+      !headers.streams[0].is_encrypted || headers.streams[0].orig_data_size != expected_len ||
+      headers.streams[0].data_size != file_len - DATA_ALIGN) {
+    printf("FAIL test_read_archive_headers: headers of a valid file were read wrong\n");
+    failed = 1;
+  }
+
+  // the stream data must be inside the file
+  if (read_archive_headers(fileno(temp), file_len - 1, &headers) == NULL) {
+    printf("FAIL test_read_archive_headers: accepted a file shorter than its stream\n");
+    failed = 1;
+  }
+
+  // the same file, already in memory
+  archive_headers_t parsed;
+  read_archive_headers(fileno(temp), file_len, &headers);
+  if (parse_archive_headers(file, file_len, &parsed) != NULL || memcmp(&parsed, &headers, sizeof(parsed)) != 0) {
+    printf("FAIL test_read_archive_headers: headers parsed from memory differ\n");
+    failed = 1;
+  }
+  if (parse_archive_headers(file, file_len - 1, &parsed) == NULL) {
+    printf("FAIL test_read_archive_headers: accepted a buffer shorter than its stream\n");
+    failed = 1;
+  }
+
+  fclose(temp);
+  return failed;
+}
+
+int test_header_catalog_round_trip(void) {
+  char path[] = "/tmp/test-catalog-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    printf("FAIL test_header_catalog_round_trip: could not create a temporary file\n");
+    return 1;
+  }
+  close(fd);
+
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  st.st_dev  = 7;
+  st.st_ino  = 1234;
+  st.st_size = 5000;
+  st.st_mtim.tv_sec = 1700000000;
+
+  archive_headers_t headers;
+  memset(&headers, 0, sizeof(headers));
+  headers.num_streams = 1;
+  headers.streams[0].is_valid       = true;
+  headers.streams[0].orig_data_size = 9000;
+  headers.streams[0].data_size      = 4000;
+
+  // an empty (not yet written) catalog file is not one, so it starts empty
+  unlink(path);
+  header_catalog_t* catalog = header_catalog_load(path);
+  header_catalog_insert(catalog, &st, &headers);
+  bool saved = header_catalog_save(catalog, path);
+  header_catalog_destroy(catalog);
+
+  int failed = 0;
+  catalog = header_catalog_load(path);
+  archive_headers_t found;
+  if (!saved || !header_catalog_lookup(catalog, &st, &found) || found.num_streams != 1 ||
+      found.streams[0].orig_data_size != 9000 || found.streams[0].data_size != 4000) {
+    printf("FAIL test_header_catalog_round_trip: saved entry was not found again\n");
+    failed = 1;
+  }
+
+  // a file rewritten since must be read again
+  st.st_mtim.tv_nsec = 1;
+  if (header_catalog_lookup(catalog, &st, &found)) {
+    printf("FAIL test_header_catalog_round_trip: entry of a modified file was used\n");
+    failed = 1;
+  }
+
+  header_catalog_destroy(catalog);
+  unlink(path);
+  return failed;
+}
+
+//----------------------------------------------------------------------------
+//          COMPACT LAYOUT TESTS:
+//----------------------------------------------------------------------------
+
+int test_parse_header_compact_layouts(void) {
+  // checksummed stream (22-byte header) of 40 bytes, in each layout
+  uint8_t versions[] = { HEADER_VERSION, HEADER_VERSION_COMPACT, HEADER_VERSION_COMPACT64 };
+  uint64_t data_offsets[] = { 4096, 22, 64 };
+  uint64_t next_headers[] = { 8192, 62, 128 };
+
+  for (int i = 0; i < 3; i++) {
+    uint8_t hdr[22] = {
+      0x02, 0x13, versions[i], 0x20,
+      0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // orig=40
+      0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // data=40
+      0xBE, 0xEF
+    };
+
+    packlab_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    parse_header(hdr, sizeof(hdr), &cfg);
+    if (!cfg.is_valid || cfg.header_len != 22) {
+      printf("FAIL test_parse_header_compact_layouts: version %d header did not parse\n", versions[i]);
+      return 1;
+    }
+    if (stream_data_offset(&cfg) != data_offsets[i] || next_header_offset(&cfg, 0) != next_headers[i]) {
+      printf("FAIL test_parse_header_compact_layouts: version %d data at %lu, next header at %lu\n",
+             versions[i], stream_data_offset(&cfg), next_header_offset(&cfg, 0));
+      return 1;
+    }
+  }
+
+  // a compact header need not start on a page
+  uint8_t hdr[20] = { 0x02, 0x13, HEADER_VERSION_COMPACT64, 0x00 };
+  hdr[12] = 0x41; // data=65
+  packlab_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (!cfg.is_valid || next_header_offset(&cfg, 128) != 128 + 64 + 128) {
+    printf("FAIL test_parse_header_compact_layouts: next header after one at 128 is wrong\n");
+    return 1;
+  }
+
+  // unknown versions are still rejected
+  hdr[2] = 0x06;
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (cfg.is_valid) {
+    printf("FAIL test_parse_header_compact_layouts: accepted version 6\n");
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          SMALL FILE TESTS:
+//----------------------------------------------------------------------------
+
+int test_small_file_round_trip(void) {
+  static uint8_t file[DATA_ALIGN + 64];
+  static uint8_t output[SMALL_OUTPUT_LEN];
+  uint8_t expected[64];
+  size_t expected_len = 0;
+  uint16_t key = 0x1337;
+  size_t file_len = build_stream_test_file(file, sizeof(file), expected, &expected_len, key);
+
+  archive_headers_t headers;
+  const char* error = parse_archive_headers(file, file_len, &headers);
+  if (error != NULL || !small_file_eligible(file_len, &headers)) {
+    printf("FAIL test_small_file_round_trip: a small file was not taken (%s)\n", error ? error : "not eligible");
+    return 1;
+  }
+
+  // a damaged copy is caught from the stored data alone, before any key is needed
+  static uint8_t damaged[sizeof(file)];
+  memcpy(damaged, file, file_len);
+  damaged[DATA_ALIGN + 2] ^= 0x01;
+  if (small_file_verify(damaged, &headers) == NULL) {
+    printf("FAIL test_small_file_round_trip: a damaged stream passed verification\n");
+    return 1;
+  }
+
+  uint8_t* streams[HEADER_CATALOG_MAX_STREAMS];
+  error = small_file_verify(file, &headers);
+  bool decoded = (error == NULL) && small_file_decode(file, &headers, key, NULL, output, streams);
+  if (!decoded || streams[0] != output || memcmp(output, expected, expected_len) != 0) {
+    printf("FAIL test_small_file_round_trip: verified %d, decoded %d\n", error == NULL, decoded);
+    return 1;
+  }
+  return 0;
+}
+
+int test_small_file_falls_back(void) {
+  static uint8_t file[DATA_ALIGN + 64];
+  uint8_t expected[64];
+  size_t expected_len = 0;
+  size_t file_len = build_stream_test_file(file, sizeof(file), expected, &expected_len, 0x1337);
+  archive_headers_t headers;
+  parse_archive_headers(file, file_len, &headers);
+
+  // too big to read in one go
+  bool too_long = small_file_eligible(SMALL_FILE_LEN + 1, &headers);
+
+  // block checksums
+  archive_headers_t blocked = headers;
+  blocked.streams[0].has_block_checksums = true;
+  bool with_blocks = small_file_eligible(file_len, &blocked);
+
+  // more than SMALL_OUTPUT_LEN of output, from one stream or from all of them together
+  archive_headers_t large = headers;
+  large.streams[0].orig_data_size = SMALL_OUTPUT_LEN + 1;
+  bool one_large = small_file_eligible(file_len, &large);
+  large = headers;
+  large.num_streams = 2;
+  large.streams[1] = large.streams[0];
+  large.streams[1].orig_data_size = SMALL_OUTPUT_LEN - expected_len + 1;
+  bool all_large = small_file_eligible(file_len, &large);
+  large.streams[1].orig_data_size--;
+  bool all_fit = small_file_eligible(file_len, &large);
+
+  if (too_long || with_blocks || one_large || all_large || !all_fit) {
+    printf("FAIL test_small_file_falls_back: took too long %d, blocks %d, one large %d, all large %d; "
+           "skipped exactly full %d\n", too_long, with_blocks, one_large, all_large, !all_fit);
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          LONG RUN TESTS:
+//----------------------------------------------------------------------------
+
+int test_decompress_long_run(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+
+  // 'A', 3000 x 0x00 (varint B8 17), then an escaped escape
+  uint8_t input[] = { 0x41, ESCAPE_BYTE, LONG_RUN_CODE, 0x00, 0xB8, 0x17, ESCAPE_BYTE, 0x00 };
+  static uint8_t output[LONG_RUN_MAX];
+  memset(output, 0xAA, sizeof(output));
+
+  size_t out_len = decompress_data(input, sizeof(input), output, sizeof(output), dict, ESCAPE_BYTE, true);
+  if (out_len != 3002 || output[0] != 0x41 || output[1] != 0x00 || output[3000] != 0x00 ||
+      output[3001] != ESCAPE_BYTE) {
+    printf("FAIL test_decompress_long_run: got %lu bytes\n", (unsigned long)out_len);
+    return 1;
+  }
+
+  // without the extension flag, the same code is a run of 0
+  out_len = decompress_data(input, 5, output, sizeof(output), dict, ESCAPE_BYTE, false);
+  if (out_len != 3 || output[1] != 0x00 || output[2] != 0xB8) {
+    printf("FAIL test_decompress_long_run: long run decoded without the flag\n");
+    return 1;
+  }
+
+  // lengths of 0, or past LONG_RUN_MAX, are invalid
+  uint8_t zero_len[] = { ESCAPE_BYTE, LONG_RUN_CODE, 0x00, 0x00 };
+  uint8_t too_long[] = { ESCAPE_BYTE, LONG_RUN_CODE, 0x00, 0x81, 0x20 };
+  if (decompress_data(zero_len, sizeof(zero_len), output, sizeof(output), dict, ESCAPE_BYTE, true) != 0 ||
+      decompress_data(too_long, sizeof(too_long), output, sizeof(output), dict, ESCAPE_BYTE, true) != 0) {
+    printf("FAIL test_decompress_long_run: accepted an invalid run length\n");
+    return 1;
+  }
+  return 0;
+}
+
+int test_decompress_resume_split_long_run(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+
+  uint8_t input[] = { 0x41, ESCAPE_BYTE, LONG_RUN_CODE, 0x5A, 0xC8, 0x01, 0x42 };
+  static uint8_t output[512];
+
+  // every split inside the code leaves it whole for the next piece
+  for (size_t split = 2; split < 6; split++) {
+    size_t used = 0;
+    size_t out_len = decompress_data_resume(input, split, output, sizeof(output), dict, ESCAPE_BYTE, true, false, &used);
+    if (out_len != 1 || used != 1) {
+      printf("FAIL test_decompress_resume_split_long_run: split at %lu used %lu bytes\n",
+             (unsigned long)split, (unsigned long)used);
+      return 1;
+    }
+    out_len += decompress_data_resume(&input[used], sizeof(input) - used, &output[out_len],
+                                      sizeof(output) - out_len, dict, ESCAPE_BYTE, true, true, &used);
+    if (out_len != 202 || output[1] != 0x5A || output[200] != 0x5A || output[201] != 0x42) {
+      printf("FAIL test_decompress_resume_split_long_run: split at %lu gave %lu bytes\n",
+             (unsigned long)split, (unsigned long)out_len);
+      return 1;
+    }
+  }
+
+  // a run that does not fit waits for more output
+  size_t used = 0;
+  size_t out_len = decompress_data_resume(&input[1], 5, output, 199, dict, ESCAPE_BYTE, true, true, &used);
+  if (out_len != 0 || used != 0) {
+    printf("FAIL test_decompress_resume_split_long_run: wrote part of a run\n");
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          BLOCK DICTIONARY TESTS:
+//----------------------------------------------------------------------------
+
+int test_read_block_dictionary(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+  uint8_t before[DICTIONARY_LENGTH];
+  memcpy(before, dict, sizeof(dict));
+
+  // entries 0 and 15 change
+  uint8_t update[] = { 0x80, 0x01, 0x11, 0x22, 0x41 };
+  if (read_block_dictionary(update, sizeof(update), dict) != 4 || dict[0] != 0x11 || dict[15] != 0x22 ||
+      memcmp(&dict[1], &before[1], DICTIONARY_LENGTH - 2) != 0) {
+    printf("FAIL test_read_block_dictionary: partial update\n");
+    return 1;
+  }
+
+  // cut off before the last changed entry: nothing changes
+  memcpy(dict, before, sizeof(dict));
+  if (read_block_dictionary(update, 3, dict) != 0 || read_block_dictionary(update, 1, dict) != 0 ||
+      memcmp(dict, before, sizeof(dict)) != 0) {
+    printf("FAIL test_read_block_dictionary: cut-off update applied\n");
+    return 1;
+  }
+
+  // a full mask replaces the whole dictionary
+  uint8_t full[BLOCK_DICTIONARY_MAX_LEN] = { 0xFF, 0xFF };
+  for (int i = 0; i < DICTIONARY_LENGTH; i++) {
+    full[BLOCK_DICTIONARY_MASK_LEN + i] = (uint8_t)(0xA0 + i);
+  }
+  if (read_block_dictionary(full, sizeof(full), dict) != BLOCK_DICTIONARY_MAX_LEN ||
+      dict[0] != 0xA0 || dict[15] != 0xAF) {
+    printf("FAIL test_read_block_dictionary: full update\n");
+    return 1;
+  }
+  return 0;
+}
+
+// two 4 KiB blocks, each switching the dictionary, fed to the incremental
+// decoder in pieces that split the second block's update
+int test_packlab_stream_block_dictionaries(void) {
+  static uint8_t file[3 * DATA_ALIGN];
+  static uint8_t expected[2 * DATA_ALIGN];
+  static uint8_t got[2 * DATA_ALIGN];
+  memset(file, 0, sizeof(file));
+
+  // block 0: entry 0 becomes 0x5A, then a run of 3 of it and 4091 literals
+  uint8_t* stored = &file[DATA_ALIGN];
+  uint8_t block0[] = { 0x00, 0x01, 0x5A, ESCAPE_BYTE, 0x30 };
+  memcpy(stored, block0, sizeof(block0));
+  memset(&stored[sizeof(block0)], 0x41, DATA_ALIGN - sizeof(block0));
+  memset(expected, 0x5A, 3);
+  memset(&expected[3], 0x41, DATA_ALIGN - sizeof(block0));
+  size_t expected_len = 3 + DATA_ALIGN - sizeof(block0);
+
+  // block 1: entries 0 and 15 change, then runs of each
+  uint8_t block1[] = { 0x80, 0x01, 0x11, 0x22, ESCAPE_BYTE, 0x40, ESCAPE_BYTE, 0x5F, 0x43 };
+  memcpy(&stored[DATA_ALIGN], block1, sizeof(block1));
+  uint8_t decoded1[] = { 0x11, 0x11, 0x11, 0x11, 0x22, 0x22, 0x22, 0x22, 0x22, 0x43 };
+  memcpy(&expected[expected_len], decoded1, sizeof(decoded1));
+  expected_len += sizeof(decoded1);
+  size_t stored_len = DATA_ALIGN + sizeof(block1);
+
+  uint8_t header[] = { 0x02, 0x13, 0x03, 0x81 };
+  memcpy(file, header, sizeof(header));
+  for (int i = 0; i < 8; i++) {
+    file[4 + i]  = (uint8_t)((uint64_t)expected_len >> (8 * i));
+    file[12 + i] = (uint8_t)((uint64_t)stored_len >> (8 * i));
+  }
+  file[20] = 0x00;
+  file[21] = EXT_FLAG_BLOCK_CHECKSUMS | EXT_FLAG_BLOCK_DICTIONARIES;
+  demo_dictionary(&file[22]);
+  file[38] = MIN_BLOCK_SIZE_LOG2;
+
+  uint8_t* table = &stored[stored_len];
+  uint32_t crcs[2] = { crc32c_update(0, stored, DATA_ALIGN),
+                       crc32c_update(0, &stored[DATA_ALIGN], sizeof(block1)) };
+  uint32_t lens[2] = { DATA_ALIGN - 2, sizeof(decoded1) };
+  for (int block = 0; block < 2; block++) {
+    for (int i = 0; i < 4; i++) {
+      table[block * BLOCK_ENTRY_LEN + i]     = (uint8_t)(crcs[block] >> (24 - 8 * i));
+      table[block * BLOCK_ENTRY_LEN + 4 + i] = (uint8_t)(lens[block] >> (8 * i));
+    }
+  }
+  size_t file_len = DATA_ALIGN + stored_len + 2 * BLOCK_ENTRY_LEN;
+
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  packlab_stream_init(ctx, 0);
+  size_t got_len = 0;
+  packlab_stream_status_t status = PACKLAB_STREAM_OK;
+  for (size_t pos = 0; pos < file_len && status == PACKLAB_STREAM_OK; pos += 3) {
+    packlab_stream_feed(ctx, &file[pos], (file_len - pos < 3) ? file_len - pos : 3);
+    size_t produced = 0;
+    status = packlab_stream_drain(ctx, &got[got_len], sizeof(got) - got_len, &produced);
+    got_len += produced;
+  }
+  status = packlab_stream_end(ctx);
+  free(ctx);
+
+  if (status != PACKLAB_STREAM_END || got_len != expected_len || memcmp(got, expected, expected_len) != 0) {
+    printf("FAIL test_packlab_stream_block_dictionaries: status %d, got %lu bytes (expected %lu)\n",
+           (int)status, (unsigned long)got_len, (unsigned long)expected_len);
+    return 1;
+  }
+
+  // the update needs compression and per-block checksums to go with it
+  packlab_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  file[21] = EXT_FLAG_BLOCK_DICTIONARIES;
+  parse_header(file, 38, &cfg);
+  if (cfg.is_valid) {
+    printf("FAIL test_packlab_stream_block_dictionaries: accepted without blocks\n");
+    return 1;
+  }
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+//          ESCAPE BYTE TESTS:
+//----------------------------------------------------------------------------
+
+// extension flags with an escape byte: header is 20 + 2 + 16 (dictionary) + 1 bytes
+int test_parse_header_escape_byte(void) {
+  uint8_t hdr[39] = {
+    0x02, 0x13, 0x03, 0x81,                          // compressed, extended
+    0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // orig=12288
+    0x01, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // data=12289
+    0x00, 0x10,                                      // extension flags: escape byte
+  };
+  hdr[38] = 0xF3;
+
+  packlab_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (!cfg.is_valid || cfg.header_len != 39 || cfg.escape_byte != 0xF3) {
+    printf("FAIL test_parse_header_escape_byte: header_len %lu escape 0x%02X\n",
+           (unsigned long)cfg.header_len, cfg.escape_byte);
+    return 1;
+  }
+
+  // without the field, streams keep the fixed escape byte
+  hdr[21] = 0x00;
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (!cfg.is_valid || cfg.header_len != 38 || cfg.escape_byte != ESCAPE_BYTE) {
+    printf("FAIL test_parse_header_escape_byte: default escape 0x%02X\n", cfg.escape_byte);
+    return 1;
+  }
+  return 0;
+}
+
+int test_decompress_escape_byte(void) {
+  uint8_t dict[DICTIONARY_LENGTH];
+  demo_dictionary(dict);
+
+  // with 0xFF as the escape, 0x07 is an ordinary literal
+  uint8_t input[] = { 0x07, 0x07, 0xFF, 0x35, 0x07, 0xFF, 0x00, 0x07 };
+  uint8_t expected[] = { 0x07, 0x07, dict[5], dict[5], dict[5], 0x07, 0xFF, 0x07 };
+  uint8_t output[64];
+  size_t out_len = decompress_data(input, sizeof(input), output, sizeof(output), dict, 0xFF, false);
+  if (out_len != sizeof(expected) || memcmp(output, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_decompress_escape_byte: got %lu bytes\n", (unsigned long)out_len);
+    return 1;
+  }
+
+  // an escape of 0x00: long literal spans, a run, and an escaped 0x00 at the end
+  uint8_t zero_input[40];
+  memset(zero_input, 0x41, sizeof(zero_input));
+  zero_input[33] = 0x00;
+  zero_input[34] = 0x21;
+  zero_input[38] = 0x00;
+  zero_input[39] = 0x00;
+  out_len = decompress_data(zero_input, sizeof(zero_input), output, sizeof(output), dict, 0x00, false);
+  if (out_len != 39 || output[32] != 0x41 || output[33] != dict[1] || output[34] != dict[1] ||
+      output[35] != 0x41 || output[38] != 0x00) {
+    printf("FAIL test_decompress_escape_byte: zero escape gave %lu bytes\n", (unsigned long)out_len);
+    return 1;
+  }
+  return 0;
+}
+
+int test_parse_header_float_transform(void) {
+  uint8_t hdr[22] = {
+    0x02, 0x13, 0x03, 0x09,                          // floats, extended
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // orig=16
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // data=16
+    0x00, 0x20,                                      // extension flags: float delta
+  };
+
+  packlab_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (!cfg.is_valid || cfg.float_transform != FLOAT_TRANSFORM_DELTA) {
+    printf("FAIL test_parse_header_float_transform: delta not parsed\n");
+    return 1;
+  }
+
+  hdr[21] = 0x40;
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (!cfg.is_valid || cfg.float_transform != FLOAT_TRANSFORM_XOR) {
+    printf("FAIL test_parse_header_float_transform: xor not parsed\n");
+    return 1;
+  }
+
+  // both at once, or on a stream that isn't a float one, is invalid
+  hdr[21] = 0x60;
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (cfg.is_valid) {
+    printf("FAIL test_parse_header_float_transform: accepted both transforms\n");
+    return 1;
+  }
+  hdr[3]  = 0x01;
+  hdr[21] = 0x20;
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (cfg.is_valid) {
+    printf("FAIL test_parse_header_float_transform: accepted a transform outside of float\n");
+    return 1;
+  }
+  return 0;
+}
+
+int test_undo_float_transform(void) {
+  // exponents 127, 128, 128, 126, 130 as deltas (mod 256) and as XORs
+  uint8_t deltas[] = { 127, 1, 0, 254, 4 };
+  uint8_t xors[]   = { 127, 255, 0, 254, 252 };
+  uint8_t expected[] = { 127, 128, 128, 126, 130 };
+
+  uint8_t last = undo_float_transform(deltas, 2, 1, FLOAT_TRANSFORM_DELTA, 0);
+  last = undo_float_transform(&deltas[2], 3, 1, FLOAT_TRANSFORM_DELTA, last);
+  if (last != 130 || memcmp(deltas, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_undo_float_transform: deltas not undone\n");
+    return 1;
+  }
+  last = undo_float_transform(xors, sizeof(xors), 1, FLOAT_TRANSFORM_XOR, 0);
+  if (last != 130 || memcmp(xors, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_undo_float_transform: XORs not undone\n");
+    return 1;
+  }
+
+  // sign|fraction values: only the top byte of each is transformed
+  uint8_t signfrac[]    = { 0x11, 0x22, 0x40, 0x33, 0x44, 0x01, 0x55, 0x66, 0xFF };
+  uint8_t signfrac_out[] = { 0x11, 0x22, 0x40, 0x33, 0x44, 0x41, 0x55, 0x66, 0x40 };
+  last = undo_float_transform(signfrac, sizeof(signfrac), 3, FLOAT_TRANSFORM_DELTA, 0);
+  if (last != 0x40 || memcmp(signfrac, signfrac_out, sizeof(signfrac_out)) != 0) {
+    printf("FAIL test_undo_float_transform: sign|fraction values not undone\n");
+    return 1;
+  }
+  return 0;
+}
+
+int test_join_double_array(void) {
+  // -1.5 is 0xBFF8000000000000, pi is 0x400921FB54442D18
+  uint8_t mantissa[]  = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x18, 0x2D, 0x44, 0x54, 0xFB, 0x21 };
+  uint8_t signexp[]   = { 0xF8, 0xBF, 0x09, 0x40 };
+  uint8_t expected[]  = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF8, 0xBF,
+                          0x18, 0x2D, 0x44, 0x54, 0xFB, 0x21, 0x09, 0x40 };
+  uint8_t out[16];
+
+  memset(out, 0xAA, sizeof(out));
+  join_double_array(mantissa, sizeof(mantissa), signexp, sizeof(signexp), out, sizeof(out));
+  if (memcmp(out, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_join_double_array: 2-stream doubles are wrong\n");
+    return 1;
+  }
+
+  // the same doubles, with their mantissas split into low and high streams
+  uint8_t mantissa_lo[] = { 0x00, 0x00, 0x00, 0x00, 0x18, 0x2D, 0x44, 0x54 };
+  uint8_t mantissa_hi[] = { 0x00, 0x00, 0xFB, 0x21 };
+  memset(out, 0xAA, sizeof(out));
+  join_double_array_three_stream(mantissa_lo, sizeof(mantissa_lo), signexp, sizeof(signexp),
+                                 mantissa_hi, sizeof(mantissa_hi), out, sizeof(out));
+  if (memcmp(out, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_join_double_array: 3-stream doubles are wrong\n");
+    return 1;
+  }
+
+  // streams that disagree on the count, or too little room, write nothing
+  memset(out, 0xAA, sizeof(out));
+  join_double_array(mantissa, sizeof(mantissa) - 6, signexp, sizeof(signexp), out, sizeof(out));
+  join_double_array(mantissa, sizeof(mantissa), signexp, sizeof(signexp), out, sizeof(out) - 1);
+  for (size_t i = 0; i < sizeof(out); i++) {
+    if (out[i] != 0xAA) {
+      printf("FAIL test_join_double_array: wrote output for mismatched streams\n");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int test_parse_header_float64(void) {
+  uint8_t hdr[22] = {
+    0x02, 0x13, 0x03, 0x19,                          // continues, floats, extended
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // orig=16
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // data=16
+    0x00, 0x80,                                      // extension flags: doubles
+  };
+
+  packlab_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (!cfg.is_valid || !cfg.is_float64 || float_value_count(&cfg) != 8 || float_output_len(&cfg) != 64) {
+    printf("FAIL test_parse_header_float64: doubles not parsed\n");
+    return 1;
+  }
+
+  // doubles are only a float layout, and take no float transforms
+  if (float_transform_allowed(1, &cfg)) {
+    printf("FAIL test_parse_header_float64: allowed a float transform on doubles\n");
+    return 1;
+  }
+  hdr[3] = 0x01;
+  parse_header(hdr, sizeof(hdr), &cfg);
+  if (cfg.is_valid) {
+    printf("FAIL test_parse_header_float64: accepted doubles outside of float\n");
+    return 1;
+  }
+  return 0;
+}
+
+int test_packlab_stream_doubles_byte_at_a_time(void) {
+  // a 2-stream file of doubles in the compact layout (no padding), with
+  // every byte fed on its own, so sign and exponent values arrive split
+  enum { N_DOUBLES = 5, HEADER_LEN = 22 };
+  double values[N_DOUBLES] = { -1.5, 3.14159, 0.0, 1e300, -2.5e-300 };
+  uint8_t expected[8 * N_DOUBLES];
+  memcpy(expected, values, sizeof(expected));
+
+  uint8_t file[2 * HEADER_LEN + 8 * N_DOUBLES];
+  size_t stream_lens[2] = { FLOAT64_MANTISSA_LEN * N_DOUBLES, FLOAT64_SIGNEXP_LEN * N_DOUBLES };
+  uint8_t flags[2] = { 0x19, 0x09 }; // floats, extended (and continues, for stream 0)
+  size_t offset = 0;
+  for (int stream = 0; stream < 2; stream++) {
+    uint8_t header[HEADER_LEN] = { 0x02, 0x13, HEADER_VERSION_COMPACT, flags[stream] };
+    for (int i = 0; i < 8; i++) {
+      header[4 + i]  = (uint8_t)((uint64_t)stream_lens[stream] >> (8 * i));
+      header[12 + i] = (uint8_t)((uint64_t)stream_lens[stream] >> (8 * i));
+    }
+    header[21] = (uint8_t)EXT_FLAG_FLOAT64;
+    memcpy(&file[offset], header, HEADER_LEN);
+    offset += HEADER_LEN;
+    for (int i = 0; i < N_DOUBLES; i++) {
+      size_t first = (stream == 0) ? 0 : FLOAT64_MANTISSA_LEN;
+      memcpy(&file[offset], &expected[8 * i + first], (stream == 0) ? FLOAT64_MANTISSA_LEN : FLOAT64_SIGNEXP_LEN);
+      offset += (stream == 0) ? FLOAT64_MANTISSA_LEN : FLOAT64_SIGNEXP_LEN;
+    }
+  }
+
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  packlab_stream_init(ctx, 0);
+  uint8_t got[8 * N_DOUBLES];
+  size_t got_len = 0;
+  packlab_stream_status_t status = PACKLAB_STREAM_OK;
+  for (size_t i = 0; i < offset && status == PACKLAB_STREAM_OK; i++) {
+    packlab_stream_feed(ctx, &file[i], 1);
+    size_t produced = 0;
+    do {
+      status = packlab_stream_drain(ctx, &got[got_len], sizeof(got) - got_len, &produced);
+      got_len += produced;
+    } while (status == PACKLAB_STREAM_OK && produced > 0);
+  }
+  status = packlab_stream_end(ctx);
+  free(ctx);
+
+  if (status != PACKLAB_STREAM_END || got_len != sizeof(expected) || memcmp(got, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_packlab_stream_doubles_byte_at_a_time: status %d, got %lu bytes\n",
+           (int)status, (unsigned long)got_len);
+    return 1;
+  }
+  return 0;
+}
+
+int test_narrow_float_array(void) {
+  // 1.0, two bfloat16 ties (one rounds down to even, one up), the largest
+  // half, a float that rounds past it, the smallest subnormal half, -0 and a NaN
+  uint32_t bits[8] = { 0x3F800000, 0x3F808000, 0x3F818000, 0x477FE000, 0x477FF000, 0x33800000, 0x80000000,
+                       0x7FC00001 };
+  uint16_t bf16[8] = { 0x3F80, 0x3F80, 0x3F82, 0x4780, 0x4780, 0x3380, 0x8000, 0x7FC0 };
+  uint16_t fp16[8] = { 0x3C00, 0x3C04, 0x3C0C, 0x7BFF, 0x7C00, 0x0001, 0x8000, 0x7E00 };
+  uint8_t input[32];
+  uint8_t output[32];
+
+  memcpy(input, bits, sizeof(input));
+  narrow_float_array(input, 8, output, FLOAT_EMIT_BF16);
+  if (memcmp(output, bf16, sizeof(bf16)) != 0) {
+    printf("FAIL test_narrow_float_array: bfloat16 values are wrong\n");
+    return 1;
+  }
+  narrow_float_array(input, 8, output, FLOAT_EMIT_FP16);
+  if (memcmp(output, fp16, sizeof(fp16)) != 0) {
+    printf("FAIL test_narrow_float_array: half precision values are wrong\n");
+    return 1;
+  }
+
+  // narrowing in place
+  narrow_float_array(input, 8, input, FLOAT_EMIT_FP16);
+  if (memcmp(input, fp16, sizeof(fp16)) != 0) {
+    printf("FAIL test_narrow_float_array: narrowing in place went wrong\n");
+    return 1;
+  }
+  return 0;
+}
+
+int test_packlab_stream_emit_fp16(void) {
+  // a 2-stream float file in the compact layout, fed a byte at a time and
+  // narrowed to half precision as it goes
+  enum { N_FLOATS = 4, HEADER_LEN = 20 };
+  uint32_t bits[N_FLOATS] = { 0x3F800000, 0xC0200000, 0x477FF000, 0x33800000 }; // 1, -2.5, past the largest half, tiny
+  uint16_t expected[N_FLOATS] = { 0x3C00, 0xC100, 0x7C00, 0x0001 };
+
+  uint8_t file[2 * HEADER_LEN + 4 * N_FLOATS];
+  size_t stream_lens[2] = { 3 * N_FLOATS, N_FLOATS };
+  uint8_t flags[2] = { 0x18, 0x08 }; // floats (and continues, for stream 0)
+  size_t offset = 0;
+  for (int stream = 0; stream < 2; stream++) {
+    uint8_t header[HEADER_LEN] = { 0x02, 0x13, HEADER_VERSION_COMPACT, flags[stream] };
+    for (int i = 0; i < 8; i++) {
+      header[4 + i]  = (uint8_t)((uint64_t)stream_lens[stream] >> (8 * i));
+      header[12 + i] = (uint8_t)((uint64_t)stream_lens[stream] >> (8 * i));
+    }
+    memcpy(&file[offset], header, HEADER_LEN);
+    offset += HEADER_LEN;
+    for (int i = 0; i < N_FLOATS; i++) {
+      // sign and fraction bits in stream 0, exponents in stream 1
+      uint32_t sign_frac = (bits[i] & 0x7FFFFF) | ((bits[i] >> 31) << 23);
+      if (stream == 0) {
+        for (int b = 0; b < 3; b++) {
+          file[offset++] = (uint8_t)(sign_frac >> (8 * b));
+        }
+      } else {
+        file[offset++] = (uint8_t)(bits[i] >> 23);
+      }
+    }
+  }
+
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  packlab_stream_init(ctx, 0);
+  ctx->emit = FLOAT_EMIT_FP16;
+  uint8_t got[2 * N_FLOATS];
+  size_t got_len = 0;
+  packlab_stream_status_t status = PACKLAB_STREAM_OK;
+  for (size_t i = 0; i < offset && status == PACKLAB_STREAM_OK; i++) {
+    packlab_stream_feed(ctx, &file[i], 1);
+    size_t produced = 0;
+    do {
+      status = packlab_stream_drain(ctx, &got[got_len], sizeof(got) - got_len, &produced);
+      got_len += produced;
+    } while (status == PACKLAB_STREAM_OK && produced > 0);
+  }
+  status = packlab_stream_end(ctx);
+  free(ctx);
+
+  if (status != PACKLAB_STREAM_END || got_len != sizeof(expected) || memcmp(got, expected, sizeof(expected)) != 0) {
+    printf("FAIL test_packlab_stream_emit_fp16: status %d, got %lu bytes\n", (int)status, (unsigned long)got_len);
+    return 1;
+  }
+  return 0;
+}
+
+
+int main(void) {
+  // Test the LFSR implementation
+  int result = test_lfsr_step();
+  if (result != 0) {
+    printf("Error when testing LFSR implementation\n");
+    return 1;
+  }
+
+  // // TODO - add tests here for other functionality
+  // // You can craft arbitrary array data as inputs to the functions
+  // // Parsing headers, checksumming, decryption, and decompressing are all testable
+
+
+// Test checksum implementation
+  result = example_test();
+  if (result != 0) {
+    printf("ERROR: example_test_setup failed\n");
+    return 1;
+  }
+  result = test_checksum_empty();
+  if (result != 0) { printf("ERROR: test_checksum_empty failed\n"); return 1; }
+
+  result = test_checksum_single_byte();
+  if (result != 0) { printf("ERROR: test_checksum_single_byte failed\n"); return 1; }
+  
+
+  // Test parse_header implementation
+  result = test_parse_header();
+  if (result != 0) { printf("ERROR: test_parse_header failed\n"); return 1; }
+
+  result = test_parse_header_minimal_20();
+  if (result != 0) { printf("ERROR: test_parse_header_minimal_20 failed\n"); return 1; }
+
+  result = test_parse_header_checksum_only_22();
+  if (result != 0) { printf("ERROR: test_parse_header_checksum_only_22 failed\n"); return 1; }
+
+  result = test_parse_header_compression_only_36();
+  if (result != 0) { printf("ERROR: test_parse_header_compression_only_36 failed\n"); return 1; }
+
+  result = test_parse_header_too_short();
+  if (result != 0) { printf("ERROR: test_parse_header_too_short failed\n"); return 1; }
+
+  result = test_parse_header_wrong_magic();
+  if (result != 0) { printf("ERROR: test_parse_header_wrong_magic failed\n"); return 1; }
+
+  result = test_parse_header_wrong_version();
+  if (result != 0) { printf("ERROR: test_parse_header_wrong_version failed\n"); return 1; }
+
+  result = test_parse_header_compressed_but_short();
+  if (result != 0) { printf("ERROR: test_parse_header_compressed_but_short failed\n"); return 1; }
+
+  result = test_parse_header_checksummed_but_short();
+  if (result != 0) { printf("ERROR: test_parse_header_checksummed_but_short failed\n"); return 1; }
+
+
+  // Test the decrypt data implementation
+  result = test_decrypt_4byte_example_in_handout();
+  if (result != 0) { printf("ERROR: test_decrypt_4byte_example_in_handout failed\n"); return 1; }
+
+  result = test_decrypt_1byte_example_in_handout();
+  if (result != 0) { printf("ERROR: test_decrypt_1byte_example_in_handout failed\n"); return 1; }
+
+  result = test_decrypt_output_len_too_small();
+  if (result != 0) { printf("ERROR: test_decrypt_output_len_too_small failed\n"); return 1; }
+
+  //test decompress
+  result = test_decompress_handout_example();
+  if (result != 0) { printf("ERROR: test_decompress_handout_example failed\n"); return 1; }
+
+  result = test_decompress_literal_escape();
+  if (result != 0) { printf("ERROR: test_decompress_literal_escape failed\n"); return 1; }
+
+  result = test_decompress_trailing_escape_byte();
+  if (result != 0) { printf("ERROR: test_decompress_trailing_escape_byte failed\n"); return 1; }
+
+  result = test_decompress_mixed_literals_and_run();
+  if (result != 0) { printf("ERROR: test_decompress_mixed_literals_and_run failed\n"); return 1; }
+
+  result = test_decompress_repeat_count_zero();
+  if (result != 0) { printf("ERROR: test_decompress_repeat_count_zero failed\n"); return 1; }
+
+  result = test_decompress_empty_input();
+  if (result != 0) { printf("ERROR: test_decompress_empty_input failed\n"); return 1; }
+
+  // test two-stream floating point
+    result = test_join_float_single_300();
+  if (result != 0) { printf("ERROR: test_join_float_single_300 failed\n"); return 1; }
+
+  result = test_join_float_single_deadbeef();
+  if (result != 0) { printf("ERROR: test_join_float_single_deadbeef failed\n"); return 1; }
+
+  //result = test_join_float_two_values();
+  //if (result != 0) { printf("ERROR: test_join_float_two_values failed\n"); return 1; }
+
+  result = test_join_float_empty();
+  if (result != 0) { printf("ERROR: test_join_float_empty failed\n"); return 1; }
+
+  result = test_join_float_length_mismatch();
+  if (result != 0) { printf("ERROR: test_join_float_length_mismatch failed\n"); return 1; }
+
+  result = test_join_float_output_too_small();
+  if (result != 0) { printf("ERROR: test_join_float_output_too_small failed\n"); return 1; }
+  
+
+  // test tri-stream floating point
+  result = test_float3_single_pos1();
+  if (result != 0) { printf("ERROR: test_float3_single_pos1 failed\n"); return 1; }
+
+  result = test_float3_single_neg1();
+  if (result != 0) {printf("ERROR: test_float3_single_neg1 failed\n"); return 1; }
+
+  result = test_float3_two_values();
+  if (result != 0) { printf("ERROR: test_float3_two_values failed\n"); return 1; }
+
+  result = test_float3_zero_length();
+  if (result != 0) { printf("ERROR: test_float3_zero_length failed\n"); return 1; }
+
+  result = test_float3_output_too_small();
+  if (result != 0) { printf("ERROR: test_float3_output_too_small failed\n"); return 1; }
+
+
+  result = test_block_cache_hit_miss();
+  if (result != 0) { printf("ERROR: test_block_cache_hit_miss failed\n"); return 1; }
+
+  result = test_block_cache_eviction();
+  if (result != 0) { printf("ERROR: test_block_cache_eviction failed\n"); return 1; }
+
+
+  result = test_crc32c_check_value();
+  if (result != 0) { printf("ERROR: test_crc32c_check_value failed\n"); return 1; }
+
+  result = test_crc32c_incremental();
+  if (result != 0) { printf("ERROR: test_crc32c_incremental failed\n"); return 1; }
+
+  result = test_parse_header_crc32c();
+  if (result != 0) { printf("ERROR: test_parse_header_crc32c failed\n"); return 1; }
+
+
+  result = test_parse_header_block_checksums();
+  if (result != 0) { printf("ERROR: test_parse_header_block_checksums failed\n"); return 1; }
+
+  result = test_parse_header_unknown_ext_flags();
+  if (result != 0) { printf("ERROR: test_parse_header_unknown_ext_flags failed\n"); return 1; }
+
+  result = test_read_block_entry();
+  if (result != 0) { printf("ERROR: test_read_block_entry failed\n"); return 1; }
+
+
+  result = test_checksum_incremental_combine();
+  if (result != 0) { printf("ERROR: test_checksum_incremental_combine failed\n"); return 1; }
+
+  result = test_checksum_incremental_overflow();
+  if (result != 0) { printf("ERROR: test_checksum_incremental_overflow failed\n"); return 1; }
+
+
+  result = test_decompress_resume_split_escape();
+  if (result != 0) { printf("ERROR: test_decompress_resume_split_escape failed\n"); return 1; }
+
+  result = test_decompress_resume_output_full();
+  if (result != 0) { printf("ERROR: test_decompress_resume_output_full failed\n"); return 1; }
+
+  result = test_stream_cursor_matches_whole_decode();
+  if (result != 0) { printf("ERROR: test_stream_cursor_matches_whole_decode failed\n"); return 1; }
+
+
+  result = test_packlab_stream_byte_at_a_time();
+  if (result != 0) { printf("ERROR: test_packlab_stream_byte_at_a_time failed\n"); return 1; }
+
+  result = test_packlab_stream_detects_bad_input();
+  if (result != 0) { printf("ERROR: test_packlab_stream_detects_bad_input failed\n"); return 1; }
+
+  result = test_packlab_stream_untrusted_float_size();
+  if (result != 0) { printf("ERROR: test_packlab_stream_untrusted_float_size failed\n"); return 1; }
+
+
+  result = test_spsc_ring_keeps_order_across_threads();
+  if (result != 0) { printf("ERROR: test_spsc_ring_keeps_order_across_threads failed\n"); return 1; }
+
+  result = test_spsc_ring_sleeps_while_idle();
+  if (result != 0) { printf("ERROR: test_spsc_ring_sleeps_while_idle failed\n"); return 1; }
+
+
+  result = test_async_io_round_trip();
+  if (result != 0) { printf("ERROR: test_async_io_round_trip failed\n"); return 1; }
+
+
+  result = test_buffer_pool_reuse_and_peak();
+  if (result != 0) { printf("ERROR: test_buffer_pool_reuse_and_peak failed\n"); return 1; }
+
+
+  result = test_decrypt_in_place();
+  if (result != 0) { printf("ERROR: test_decrypt_in_place failed\n"); return 1; }
+
+
+  result = test_stream_decoders_match_kernels();
+  if (result != 0) { printf("ERROR: test_stream_decoders_match_kernels failed\n"); return 1; }
+
+
+  result = test_cpu_isa_names();
+  if (result != 0) { printf("ERROR: test_cpu_isa_names failed\n"); return 1; }
+
+  result = test_kernels_match_scalar();
+  if (result != 0) { printf("ERROR: test_kernels_match_scalar failed\n"); return 1; }
+
+
+  result = test_keystream_cache_matches_lfsr();
+  if (result != 0) { printf("ERROR: test_keystream_cache_matches_lfsr failed\n"); return 1; }
+
+  result = test_stream_decoder_keystream_wraps();
+  if (result != 0) { printf("ERROR: test_stream_decoder_keystream_wraps failed\n"); return 1; }
+
+  result = test_unpackd_args_round_trip();
+  if (result != 0) { printf("ERROR: test_unpackd_args_round_trip failed\n"); return 1; }
+
+
+  result = test_read_archive_headers();
+  if (result != 0) { printf("ERROR: test_read_archive_headers failed\n"); return 1; }
+
+  result = test_header_catalog_round_trip();
+  if (result != 0) { printf("ERROR: test_header_catalog_round_trip failed\n"); return 1; }
+
+
+  result = test_parse_header_compact_layouts();
+  if (result != 0) { printf("ERROR: test_parse_header_compact_layouts failed\n"); return 1; }
+
+  result = test_small_file_round_trip();
+  if (result != 0) { printf("ERROR: test_small_file_round_trip failed\n"); return 1; }
+
+  result = test_small_file_falls_back();
+  if (result != 0) { printf("ERROR: test_small_file_falls_back failed\n"); return 1; }
+
+
+  result = test_decompress_long_run();
+  if (result != 0) { printf("ERROR: test_decompress_long_run failed\n"); return 1; }
+
+  result = test_decompress_resume_split_long_run();
+  if (result != 0) { printf("ERROR: test_decompress_resume_split_long_run failed\n"); return 1; }
+
+
+  result = test_read_block_dictionary();
+  if (result != 0) { printf("ERROR: test_read_block_dictionary failed\n"); return 1; }
+
+  result = test_packlab_stream_block_dictionaries();
+  if (result != 0) { printf("ERROR: test_packlab_stream_block_dictionaries failed\n"); return 1; }
+
+
+  result = test_parse_header_escape_byte();
+  if (result != 0) { printf("ERROR: test_parse_header_escape_byte failed\n"); return 1; }
+
+  result = test_decompress_escape_byte();
+  if (result != 0) { printf("ERROR: test_decompress_escape_byte failed\n"); return 1; }
+
+
+  result = test_parse_header_float_transform();
+  if (result != 0) { printf("ERROR: test_parse_header_float_transform failed\n"); return 1; }
+
+  result = test_undo_float_transform();
+  if (result != 0) { printf("ERROR: test_undo_float_transform failed\n"); return 1; }
+
+
+  result = test_join_double_array();
+  if (result != 0) { printf("ERROR: test_join_double_array failed\n"); return 1; }
+
+  result = test_parse_header_float64();
+  if (result != 0) { printf("ERROR: test_parse_header_float64 failed\n"); return 1; }
+
+
+  result = test_packlab_stream_doubles_byte_at_a_time();
+  if (result != 0) { printf("ERROR: test_packlab_stream_doubles_byte_at_a_time failed\n"); return 1; }
+
+
+  result = test_narrow_float_array();
+  if (result != 0) { printf("ERROR: test_narrow_float_array failed\n"); return 1; }
+
+  result = test_packlab_stream_emit_fp16();
+  if (result != 0) { printf("ERROR: test_packlab_stream_emit_fp16 failed\n"); return 1; }
 
 
   printf("All tests passed successfully!\n");
@@ -0,0 +1,64 @@
+#!/usr/bin/perl -w
+
+# Measures per-file unpack latency (p50 and p99 of many runs) on the packed
+# files in example_files, for one or more builds
+# Used by `make latency-report`; the report is also saved as report.txt in work_dir
+
+use Time::HiRes qw(time);
+
+$#ARGV>=2 or die "usage: latency_report.pl work_dir runs binary...\n";
+
+($dir,$runs,@binaries)=@ARGV;
+$runs>=1 or die "runs must be at least 1\n";
+
+$ENV{PACKLAB_PASSWORD}="cs213";
+
+# latency of each run, in milliseconds, sorted
+sub run_times {
+    my ($binary,$packed,$out)=@_;
+    my @times;
+    for (my $i=0;$i<$runs;$i++) {
+        my $start=time();
+        system("$binary $packed $out >/dev/null")==0 or die "$binary failed on $packed\n";
+        push(@times,(time()-$start)*1000);
+    }
+    return sort { $a <=> $b } @times;
+}
+
+# value below which `fraction` of the sorted times fall
+sub percentile {
+    my ($fraction,@times)=@_;
+    my $index=int($fraction*$#times+0.5);
+    return $times[$index];
+}
+
+system("mkdir -p $dir")==0 or die "cannot create $dir\n";
+open(REPORT,">$dir/report.txt") or die "cannot open report file\n";
+
+$header = sprintf("%-30s %9s", "input", "bytes");
+foreach $b (@binaries) {
+    ($label=$b) =~ s/^.*\///;
+    $header .= sprintf(" %20s %8s", "$label p50 ms", "p99 ms");
+}
+print "$header\n";
+print REPORT "$header\n";
+
+foreach $packed (sort glob("example_files/*.pack")) {
+    ($original=$packed) =~ s/\.[a-z]+\.pack$//;
+    ($name=$packed) =~ s/^example_files\///;
+
+    $line = sprintf("%-30s %9d", $name, -s $packed);
+    foreach $b (@binaries) {
+        @times = run_times($b, $packed, "$dir/unpacked");
+        if (system "cmp -s $dir/unpacked $original") {
+            die "$b did not round-trip $packed\n";
+        }
+        $line .= sprintf(" %20.3f %8.3f", percentile(0.50,@times), percentile(0.99,@times));
+    }
+    print "$line\n";
+    print REPORT "$line\n";
+}
+unlink("$dir/unpacked");
+
+close(REPORT);
+exit 0;
@@ -0,0 +1,53 @@
+#!/usr/bin/perl -w
+
+# Runs an instrumented unpack over generated inputs packed with every flag
+# combination, so its profile covers all the decode paths
+# Used by `make release`
+
+$#ARGV==1 or die "usage: pgo_train.pl unpack_binary work_dir\n";
+
+($unpack,$dir)=@ARGV;
+
+@flagcombos = (
+    "", "-c", "-e", "-k", "-c -e", "-c -k", "-e -k", "-c -e -k",
+    "-f", "-f -c", "-f -e", "-f -k", "-f -c -e", "-f -c -k", "-f -e -k", "-f -c -e -k",
+    "-g", "-g -c", "-g -e", "-g -k", "-g -c -e", "-g -c -k", "-g -e -k", "-g -c -e -k"
+    );
+
+# random words, and smooth float data (which compresses), small and large
+@corpora = (
+    ["rands_small", "tools/gen_rands 213 1024"],
+    ["rands_large", "tools/gen_rands 214 1048576"],
+    ["floats_small", "tools/gen_floats -1:0.001:1"],
+    ["floats_large", "tools/gen_floats -500:0.001:500"],
+    );
+
+# the ways unpack decodes a file in memory, batch by batch, and through threads
+@modes = ("", "--low-memory", "--pipeline");
+
+$ENV{PACKLAB_PASSWORD}="cs213";
+
+system("mkdir -p $dir")==0 or die "cannot create $dir\n";
+
+foreach $c (@corpora) {
+    ($name,$gen)=@$c;
+    system("$gen $dir/$name.raw >/dev/null")==0 or die "failed to generate $name\n";
+
+    foreach $f (@flagcombos) {
+        if (system "./pack $f $dir/$name.raw $dir/$name.packed >/dev/null") {
+            die "failed to pack $name with flags \"$f\"\n";
+        }
+        foreach $m (@modes) {
+            if (system "$unpack $m $dir/$name.packed $dir/$name.unpacked >/dev/null") {
+                die "training run failed on $name with flags \"$f\" $m\n";
+            }
+            if (system "cmp -s $dir/$name.unpacked $dir/$name.raw") {
+                die "training run on $name with flags \"$f\" $m did not round-trip\n";
+            }
+        }
+    }
+    print "trained on $name\n";
+}
+
+system "rm -rf $dir";
+exit 0;
@@ -0,0 +1,69 @@
+#!/usr/bin/perl -w
+
+# Compares unpack throughput of two builds (normally debug vs release) on
+# generated inputs packed with each flag combination
+# Used by `make release-report`; the report is also saved as report.txt in work_dir
+
+use Time::HiRes qw(time);
+
+$#ARGV>=2 or die "usage: release_report.pl debug_binary release_binary work_dir [runs]\n";
+
+($debug,$release,$dir,$runs)=@ARGV;
+$runs = 3 if !defined($runs);
+
+@flagcombos = (
+    "", "-c", "-e", "-k", "-c -e", "-c -k", "-e -k", "-c -e -k",
+    "-f -c -e -k", "-g -c -e -k"
+    );
+
+@corpora = (
+    ["rands", "tools/gen_rands 213 4194304"],
+    ["floats", "tools/gen_floats -2000:0.001:2000"],
+    );
+
+$ENV{PACKLAB_PASSWORD}="cs213";
+
+# best wall-clock time of several runs, in seconds
+sub best_time {
+    my ($binary,$packed,$out)=@_;
+    my $best;
+    for (my $i=0;$i<$runs;$i++) {
+        my $start=time();
+        system("$binary $packed $out >/dev/null")==0 or die "$binary failed on $packed\n";
+        my $elapsed=time()-$start;
+        $best=$elapsed if !defined($best) || $elapsed<$best;
+    }
+    return $best;
+}
+
+system("mkdir -p $dir")==0 or die "cannot create $dir\n";
+open(REPORT,">$dir/report.txt") or die "cannot open report file\n";
+
+$header = sprintf("%-8s %-14s %9s %12s %12s %8s\n", "input", "flags", "size MB", "debug MB/s", "release MB/s", "speedup");
+print $header;
+print REPORT $header;
+
+foreach $c (@corpora) {
+    ($name,$gen)=@$c;
+    system("$gen $dir/$name.raw >/dev/null")==0 or die "failed to generate $name\n";
+    $mb = (-s "$dir/$name.raw") / (1024*1024);
+
+    foreach $f (@flagcombos) {
+        system("./pack $f $dir/$name.raw $dir/$name.packed >/dev/null")==0 or die "failed to pack $name with flags \"$f\"\n";
+
+        $debug_time   = best_time($debug, "$dir/$name.packed", "$dir/$name.unpacked");
+        $release_time = best_time($release, "$dir/$name.packed", "$dir/$name.unpacked");
+        if (system "cmp -s $dir/$name.unpacked $dir/$name.raw") {
+            die "$release did not round-trip $name with flags \"$f\"\n";
+        }
+
+        $line = sprintf("%-8s %-14s %9.1f %12.1f %12.1f %7.1fx\n", $name, ($f eq "") ? "(none)" : $f, $mb,
+                        $mb/$debug_time, $mb/$release_time, $debug_time/$release_time);
+        print $line;
+        print REPORT $line;
+    }
+    unlink("$dir/$name.raw", "$dir/$name.packed", "$dir/$name.unpacked");
+}
+
+close(REPORT);
+exit 0;
@@ -1,12 +1,20 @@
 // Utilities for unpacking files
 // PackLab - CS213 - Northwestern University
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h> // SSE2 through AVX-512, BMI2, and the SSE4.2 crc32
+#endif
+
+#include "cpu-dispatch.h"
 #include "unpack-utilities.h"
 
 
@@ -38,16 +46,21 @@ void parse_header(uint8_t* input_data, size_t input_len, packlab_config_t* confi
   // or input_len (length of the input_data) is shorter than expected
 
   // magic bytes: always = 0x0213 => first 2 BYTES (B-E): offset 0 and 1
-  // vresion: always = 0x03 => next 1 BYTE: offset 2
+  // vresion: 0x03 => next 1 BYTE: offset 2 (0x04/0x05 for the compact layouts)
   // FLAGS: => next 1 BYTE => map it to 7 BIT flag-fields: offset 3
-    // minimum len of header = 20 BYTES: 0 flags 
-    // maximun le of header = 38 BYTES: flags included
-      // no compression/checksum: header_len = 20 + 0 + 0 = 20 BYTES (min)
-      // if compression only: header_len = 20 + 16 bytes (dict val) = 36 BYTES
-      // if checksummed only: header_len = 20 + 2 bytes (16-bits B-E checksum val) = 22 BYTES
-      // if compression + checksum: header_len = 20 + 16 + 2 = 38 BYTES (max)
   // original file length: 8 BYTES (L-E): offset 4 - 11
   // data stream length: 8 BYTES (L-E): offset 12 - 19
+  // then, each only if its flag is set, in this order (no fixed offsets):
+    // extension flags: 2 BYTES (B-E), if flags bit 0 => offset 20 - 21
+    // dictionary: 16 BYTES, if compressed
+    // checksum: 2 BYTES (B-E), if checksummed
+    // crc32c: 4 BYTES (B-E), if EXT_FLAG_CRC32C
+    // block size: 1 BYTE (log2), if EXT_FLAG_BLOCK_CHECKSUMS
+    // escape byte: 1 BYTE, if EXT_FLAG_ESCAPE_BYTE
+  // minimum len of header = 20 BYTES: no flags
+  // maximum len of header = 20 + 2 + 16 + 2 + 4 + 1 + 1 = 46 BYTES (MAX_HEADER_SIZE)
+  // the other extension flags (long runs, block dictionaries, float
+  // transforms, doubles) change how the data is read, not the header
 
 
   if (config == NULL) return;
@@ -71,7 +84,16 @@ void parse_header(uint8_t* input_data, size_t input_len, packlab_config_t* confi
   if (magic != 0x0213) {
     return;
   }
-  if (version != 0x03) {
+  if (version == HEADER_VERSION) {
+    config->header_align = HEADER_ALIGN;
+    config->data_align   = DATA_ALIGN;
+  } else if (version == HEADER_VERSION_COMPACT) {
+    config->header_align = 1;
+    config->data_align   = 1;
+  } else if (version == HEADER_VERSION_COMPACT64) {
+    config->header_align = COMPACT_ALIGN;
+    config->data_align   = COMPACT_ALIGN;
+  } else {
     return;
   }
 
@@ -91,22 +113,31 @@ void parse_header(uint8_t* input_data, size_t input_len, packlab_config_t* confi
   config->should_float = ((flags >> 3) & 1u) ? true : false;
   // bit 2: float3?
   config->should_float3 = ((flags >> 2) & 1u) ? true : false;
-  // bit 1 and 0 unused
-
-  //determine how many more bytes need to be read from the header
-  // base header = 20bytes
-  size_t header_len = MIN_HEADER_LEN;
-  
-  //if compressed? + 16bytes
-  if (config->is_compressed) {
-    header_len += DICTIONARY_LENGTH;
+  // bit 1 unused
+  // bit 0: extension flags follow the size fields?
+  bool is_extended = (flags & 1u) ? true : false;
+
+  // extension flags: 2 bytes (BE) after the size fields, if extended
+  uint16_t ext_flags = 0;
+  if (is_extended) {
+    if (input_len < MIN_HEADER_LEN + 2) {
+      return;
+    }
+    ext_flags = (uint16_t)((uint16_t)input_data[MIN_HEADER_LEN] << 8 | (uint16_t)input_data[MIN_HEADER_LEN + 1]);
   }
-
-  //if cheksummed? + 2 bytes
-  if (config->is_checksummed) {
-    header_len += 2;
+  // an extension from a newer packer would decode to the wrong bytes
+  if (ext_flags & ~EXT_FLAG_KNOWN) {
+    return;
   }
-
+  config->extension_flags = ext_flags;
+  config->is_crc32c = (ext_flags & EXT_FLAG_CRC32C) ? true : false;
+  config->has_block_checksums = (ext_flags & EXT_FLAG_BLOCK_CHECKSUMS) ? true : false;
+  config->has_long_runs = (ext_flags & EXT_FLAG_LONG_RUNS) ? true : false;
+  config->has_block_dictionaries = (ext_flags & EXT_FLAG_BLOCK_DICTIONARIES) ? true : false;
+  bool has_escape_byte = (ext_flags & EXT_FLAG_ESCAPE_BYTE) ? true : false;
+
+  // the flags decide how many more bytes the header has
+  size_t header_len = header_len_needed(input_data, input_len);
   if (header_len > MAX_HEADER_SIZE) {
     return;
   }
@@ -139,8 +170,8 @@ void parse_header(uint8_t* input_data, size_t input_len, packlab_config_t* confi
   config->data_size = packed_len;
 
 // Pull out the compression dictionary for this stream if Compression? is enabled
-// dict starts immediately after the minimum 20 bytes: offset 20-36
-size_t offset = MIN_HEADER_LEN;
+// dict starts immediately after the minimum 20 bytes (and extension flags, if any): offset 20-35 (22-37 if extended)
+size_t offset = MIN_HEADER_LEN + (is_extended ? 2 : 0);
 if (config->is_compressed) {
   // copy 16 dic bytes here
   for (int i = 0; i < DICTIONARY_LENGTH; i++) {
@@ -151,19 +182,114 @@ if (config->is_compressed) {
 }
 
 // Pull out the checksum value for this stream if Checksummed? is enabled
-// checksum = 16bit unsigned = 2bytes BE
-// offset: 37-38
+// checksum = 16bit unsigned = 2bytes BE, right after the dictionary (if any)
 if (config->is_checksummed) {
   uint16_t csum = (uint16_t)((uint16_t)input_data[offset] << 8) | (uint16_t)input_data[offset + 1];
 
   config->checksum_value = csum;
   offset += 2;
 }
+
+// Pull out the CRC32C for this stream if the CRC32C extension is enabled
+// crc = 32bit unsigned = 4bytes BE
+if (config->is_crc32c) {
+  uint32_t crc = 0;
+  for (int i = 0; i < 4; i++) {
+    crc = (crc << 8) | (uint32_t)input_data[offset + (size_t)i];
+  }
+  config->crc32c_value = crc;
+  offset += 4;
+}
+
+// Pull out the block size if the block checksum extension is enabled
+// stored as a power of two: block size = 1 << byte
+if (config->has_block_checksums) {
+  uint8_t block_size_log2 = input_data[offset];
+  if (block_size_log2 < MIN_BLOCK_SIZE_LOG2 || block_size_log2 > MAX_BLOCK_SIZE_LOG2) {
+    return;
+  }
+  config->block_size = (uint64_t)1 << block_size_log2;
+  offset += 1;
+}
+
+// Pull out the escape byte if the stream chose its own
+config->escape_byte = ESCAPE_BYTE;
+if (has_escape_byte) {
+  config->escape_byte = input_data[offset];
+  offset += 1;
+}
+
+// Per-block dictionaries update the header's, one block at a time
+if (config->has_block_dictionaries && (!config->is_compressed || !config->has_block_checksums)) {
+  return;
+}
+
+// Float transforms: one at most, and only on float streams
+bool float_delta = (ext_flags & EXT_FLAG_FLOAT_DELTA) ? true : false;
+bool float_xor   = (ext_flags & EXT_FLAG_FLOAT_XOR) ? true : false;
+if ((float_delta && float_xor) || ((float_delta || float_xor) && !config->should_float)) {
+  return;
+}
+config->float_transform = float_delta ? FLOAT_TRANSFORM_DELTA :
+                          float_xor   ? FLOAT_TRANSFORM_XOR : FLOAT_TRANSFORM_NONE;
+
+// Doubles are a float layout too
+config->is_float64 = (ext_flags & EXT_FLAG_FLOAT64) ? true : false;
+if (config->is_float64 && !config->should_float) {
+  return;
+}
 // done decoding: set header as valid:
 config->is_valid = true;
 }
 
 
+size_t header_len_needed(uint8_t* input_data, size_t input_len) {
+  // base header = 20 bytes: magic, version, flags and the two sizes
+  const size_t MIN_HEADER_LEN = 4 + 8 + 8;
+  if (input_data == NULL || input_len < MIN_HEADER_LEN) {
+    return MIN_HEADER_LEN;
+  }
+  uint8_t flags = input_data[3];
+  size_t header_len = MIN_HEADER_LEN;
+
+  // if extended? + 2 bytes of extension flags (BE), which we need before we
+  // can tell how long the rest of the header is
+  uint16_t ext_flags = 0;
+  if (flags & 1u) {
+    header_len += 2;
+    if (input_len < header_len) {
+      return header_len;
+    }
+    ext_flags = (uint16_t)((uint16_t)input_data[MIN_HEADER_LEN] << 8 | (uint16_t)input_data[MIN_HEADER_LEN + 1]);
+  }
+
+  //if compressed? + 16bytes
+  if ((flags >> 7) & 1u) {
+    header_len += DICTIONARY_LENGTH;
+  }
+
+  //if cheksummed? + 2 bytes
+  if ((flags >> 5) & 1u) {
+    header_len += 2;
+  }
+
+  //if crc32c? + 4 bytes
+  if (ext_flags & EXT_FLAG_CRC32C) {
+    header_len += 4;
+  }
+
+  //if block checksums? + 1 byte of block size (log2)
+  if (ext_flags & EXT_FLAG_BLOCK_CHECKSUMS) {
+    header_len += 1;
+  }
+
+  //if escape byte? + 1 byte
+  if (ext_flags & EXT_FLAG_ESCAPE_BYTE) {
+    header_len += 1;
+  }
+  return header_len;
+}
+
 
 uint16_t calculate_checksum(uint8_t* input_data, size_t input_len) {
 
@@ -181,11 +307,314 @@ uint16_t calculate_checksum(uint8_t* input_data, size_t input_len) {
   // if there's no data pointer, we can't read bytes
   if (input_data == NULL) return 0;
 
-  uint16_t checksum = 0;
-  for (size_t i = 0; i < input_len; i++) {
-    checksum = (uint16_t)(checksum + (uint16_t)input_data[i]); // input data is uint8_t, we cast to uint16_t => 16bits world
+  checksum_state_t state;
+  checksum_init(&state);
+  checksum_update(&state, input_data, input_len);
+  return checksum_final(&state);
+}
+
+// Kernels for the level picked for this CPU (or forced through CPU_ISA_ENV)
+static const kernel_table_t* active_kernels(void) {
+  return kernels_for_isa(cpu_isa_active());
+}
+
+// Byte sums: the plain loop sums into a wide counter and only wraps to 16 bits
+// at the end. A 64-bit counter can't overflow (at most 255 per byte)
+static uint64_t byte_sum_scalar(const uint8_t* data, size_t len) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < len; i++) {
+    sum += data[i];
   }
-  return checksum;
+  return sum;
+}
+
+#if defined(__x86_64__)
+// psadbw against zero adds each group of 8 bytes into one 64-bit lane
+__attribute__((target("sse2")))
+static uint64_t byte_sum_sse2(const uint8_t* data, size_t len) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc  = zero;
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(const void*)&data[i]);
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(bytes, zero));
+  }
+
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i*)(void*)lanes, acc);
+  return lanes[0] + lanes[1] + byte_sum_scalar(&data[i], len - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t byte_sum_avx2(const uint8_t* data, size_t len) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i acc  = zero;
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)(const void*)&data[i]);
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, zero));
+  }
+
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)(void*)lanes, acc);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + byte_sum_scalar(&data[i], len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static uint64_t byte_sum_avx512(const uint8_t* data, size_t len) {
+  __m512i zero = _mm512_setzero_si512();
+  __m512i acc  = zero;
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i bytes = _mm512_loadu_si512((const void*)&data[i]);
+    acc = _mm512_add_epi64(acc, _mm512_sad_epu8(bytes, zero));
+  }
+  return (uint64_t)_mm512_reduce_add_epi64(acc) + byte_sum_scalar(&data[i], len - i);
+}
+#endif
+
+// Byte search: finds the next escape byte, so the literals before it can be
+// copied in one go. The vector variants compare a whole register against the
+// byte and take the first set bit of the match mask
+static size_t find_byte_scalar(const uint8_t* data, size_t len, uint8_t value) {
+  size_t i = 0;
+  while (i < len && data[i] != value) {
+    i++;
+  }
+  return i;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse2")))
+static size_t find_byte_sse2(const uint8_t* data, size_t len, uint8_t value) {
+  __m128i needle = _mm_set1_epi8((char)value);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(const void*)&data[i]);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle));
+    if (mask != 0) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+  return i + find_byte_scalar(&data[i], len - i, value);
+}
+
+__attribute__((target("avx2")))
+static size_t find_byte_avx2(const uint8_t* data, size_t len, uint8_t value) {
+  __m256i needle = _mm256_set1_epi8((char)value);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)(const void*)&data[i]);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle));
+    if (mask != 0) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+  return i + find_byte_sse2(&data[i], len - i, value);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t find_byte_avx512(const uint8_t* data, size_t len, uint8_t value) {
+  __m512i needle = _mm512_set1_epi8((char)value);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    __m512i bytes = _mm512_loadu_si512((const void*)&data[i]);
+    uint64_t mask = _mm512_cmpeq_epi8_mask(bytes, needle);
+    if (mask != 0) {
+      return i + (size_t)__builtin_ctzll(mask);
+    }
+  }
+  return i + find_byte_avx2(&data[i], len - i, value);
+}
+#endif
+
+void checksum_init(checksum_state_t* state) {
+  state->sum = 0;
+}
+
+void checksum_update(checksum_state_t* state, uint8_t* input_data, size_t input_len) {
+  if (state == NULL || input_data == NULL) return;
+
+  // a sum mod 2^16, so the full sum can be wrapped once at the end
+  uint64_t sum = state->sum + active_kernels()->byte_sum(input_data, input_len);
+  state->sum = (uint16_t)sum;
+}
+
+void checksum_combine(checksum_state_t* state, checksum_state_t* other) {
+  state->sum = (uint16_t)(state->sum + other->sum);
+}
+
+uint16_t checksum_final(checksum_state_t* state) {
+  return state->sum;
+}
+
+uint64_t block_count(packlab_config_t* config) {
+  if (config == NULL || !config->has_block_checksums || config->block_size == 0) {
+    return 0;
+  }
+  // round up: a partial block at the end still gets an entry
+  return (config->data_size + config->block_size - 1) / config->block_size;
+}
+
+uint64_t block_table_len(packlab_config_t* config) {
+  return block_count(config) * BLOCK_ENTRY_LEN;
+}
+
+uint64_t stream_data_offset(packlab_config_t* config) {
+  return ((config->header_len + config->data_align - 1) / config->data_align) * config->data_align;
+}
+
+uint64_t next_header_offset(packlab_config_t* config, uint64_t header_offset) {
+  uint64_t data_end = header_offset + stream_data_offset(config) + config->data_size + block_table_len(config);
+  return ((data_end + config->header_align - 1) / config->header_align) * config->header_align;
+}
+
+void read_block_entry(uint8_t* table, uint64_t block, uint32_t* crc32c_value, uint32_t* decoded_len) {
+  uint8_t* entry = &table[block * BLOCK_ENTRY_LEN];
+
+  // crc32c: 4 bytes BE, like the header's checksums
+  uint32_t crc = 0;
+  for (int i = 0; i < 4; i++) {
+    crc = (crc << 8) | (uint32_t)entry[i];
+  }
+
+  // decoded length: 4 bytes LE, like the header's sizes
+  uint32_t len = 0;
+  for (int i = 0; i < 4; i++) {
+    len |= (uint32_t)entry[4 + i] << (8 * i);
+  }
+
+  *crc32c_value = crc;
+  *decoded_len  = len;
+}
+
+// --- CRC32C ---
+
+#define CRC32C_POLY     0x82F63B78u // Castagnoli polynomial, bit-reflected
+#define CRC32C_LANE_LEN 4096        // bytes per lane in the interleaved hardware kernel
+
+// Slicing-by-8 tables for the portable kernel
+static uint32_t crc32c_table[8][256];
+
+// Advances a CRC register over CRC32C_LANE_LEN zero bytes, one table per register byte
+// Used to stitch together the independent lanes of the hardware kernel
+static uint32_t crc32c_lane_shift[4][256];
+
+
+// Portable kernel: works on the raw CRC register (no pre/post inversion)
+static uint32_t crc32c_portable(uint32_t crc, const uint8_t* data, size_t len) {
+  while (len >= 8) {
+    uint32_t lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 |
+                         (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+    uint32_t hi = (uint32_t)data[4] | (uint32_t)data[5] << 8 |
+                  (uint32_t)data[6] << 16 | (uint32_t)data[7] << 24;
+    crc = crc32c_table[7][lo & 0xFFu] ^ crc32c_table[6][(lo >> 8) & 0xFFu] ^
+          crc32c_table[5][(lo >> 16) & 0xFFu] ^ crc32c_table[4][lo >> 24] ^
+          crc32c_table[3][hi & 0xFFu] ^ crc32c_table[2][(hi >> 8) & 0xFFu] ^
+          crc32c_table[1][(hi >> 16) & 0xFFu] ^ crc32c_table[0][hi >> 24];
+    data += 8;
+    len  -= 8;
+  }
+  while (len > 0) {
+    crc = crc32c_table[0][(crc ^ *data) & 0xFFu] ^ (crc >> 8);
+    data++;
+    len--;
+  }
+  return crc;
+}
+
+static uint32_t crc32c_shift_lane(uint32_t crc) {
+  return crc32c_lane_shift[0][crc & 0xFFu] ^ crc32c_lane_shift[1][(crc >> 8) & 0xFFu] ^
+         crc32c_lane_shift[2][(crc >> 16) & 0xFFu] ^ crc32c_lane_shift[3][crc >> 24];
+}
+
+#if defined(__x86_64__)
+// Hardware kernel: the crc32 instruction has a latency of 3 cycles but can
+// issue every cycle, so three independent lanes keep it saturated. The lanes
+// are then merged by shifting the earlier ones past the later ones
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, size_t len) {
+  uint64_t crc0 = crc;
+
+  while (len >= 3 * CRC32C_LANE_LEN) {
+    uint64_t crc1 = 0;
+    uint64_t crc2 = 0;
+    for (size_t i = 0; i < CRC32C_LANE_LEN; i += 8) {
+      uint64_t word0, word1, word2;
+      memcpy(&word0, &data[i], 8);
+      memcpy(&word1, &data[i + CRC32C_LANE_LEN], 8);
+      memcpy(&word2, &data[i + 2 * CRC32C_LANE_LEN], 8);
+      crc0 = _mm_crc32_u64(crc0, word0);
+      crc1 = _mm_crc32_u64(crc1, word1);
+      crc2 = _mm_crc32_u64(crc2, word2);
+    }
+    crc0 = crc32c_shift_lane((uint32_t)crc0) ^ (uint32_t)crc1;
+    crc0 = crc32c_shift_lane((uint32_t)crc0) ^ (uint32_t)crc2;
+    data += 3 * CRC32C_LANE_LEN;
+    len  -= 3 * CRC32C_LANE_LEN;
+  }
+
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, data, 8);
+    crc0 = _mm_crc32_u64(crc0, word);
+    data += 8;
+    len  -= 8;
+  }
+  while (len > 0) {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *data);
+    data++;
+    len--;
+  }
+  return (uint32_t)crc0;
+}
+#endif
+
+static void crc32c_init(void) {
+  for (uint32_t n = 0; n < 256; n++) {
+    uint32_t crc = n;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1u) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    crc32c_table[0][n] = crc;
+  }
+  for (int k = 1; k < 8; k++) {
+    for (int n = 0; n < 256; n++) {
+      uint32_t prev = crc32c_table[k - 1][n];
+      crc32c_table[k][n] = (prev >> 8) ^ crc32c_table[0][prev & 0xFFu];
+    }
+  }
+
+  // shifting is linear, so shift each register bit once and combine per byte value
+  static const uint8_t zeros[CRC32C_LANE_LEN] = {0};
+  uint32_t bit_shift[32];
+  for (int bit = 0; bit < 32; bit++) {
+    bit_shift[bit] = crc32c_portable(1u << bit, zeros, sizeof(zeros));
+  }
+  for (int byte = 0; byte < 4; byte++) {
+    for (int n = 0; n < 256; n++) {
+      uint32_t shifted = 0;
+      for (int bit = 0; bit < 8; bit++) {
+        if ((n >> bit) & 1) {
+          shifted ^= bit_shift[8 * byte + bit];
+        }
+      }
+      crc32c_lane_shift[byte][n] = shifted;
+    }
+  }
+}
+
+uint32_t crc32c_update(uint32_t crc, uint8_t* input_data, size_t input_len) {
+  if (input_data == NULL) return crc;
+
+  return ~active_kernels()->crc32c(~crc, input_data, input_len);
+}
+
+uint64_t mix64(uint64_t hash, uint64_t value) {
+  uint64_t x = hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2));
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
 }
 
 uint16_t lfsr_step(uint16_t oldstate) {
@@ -233,14 +662,22 @@ void decrypt_data(uint8_t* input_data, size_t input_len,
       // step the LFSR once
       // XOR input at first psn with LSB
 
+  // LFSR initial state => encryption key
+  decrypt_data_resume(input_data, input_len, output_data, output_len, encryption_key);
+}
+
+uint16_t decrypt_data_resume(uint8_t* input_data, size_t input_len,
+                             uint8_t* output_data, size_t output_len,
+                             uint16_t lfsr_state) {
+
   // bad pointers
-  if (input_data == NULL || output_data == NULL) return;
+  if (input_data == NULL || output_data == NULL) return lfsr_state;
   
   // we should nevre write past out put data:
-  if (output_len < input_len) return;
+  if (output_len < input_len) return lfsr_state;
 
-  // LFSR initial state => encryption key
-  uint16_t state = encryption_key;
+  // pick up where the previous piece left off
+  uint16_t state = lfsr_state;
 
   // process pairs of bytes
   size_t i = 0;
@@ -274,6 +711,7 @@ void decrypt_data(uint8_t* input_data, size_t input_len,
 
   }
 
+  return state;
 }
 
 // Decompresses input data, creating output data
@@ -282,7 +720,7 @@ void decrypt_data(uint8_t* input_data, size_t input_len,
 // Writes uncompressed data directly into `output_data`
 size_t decompress_data(uint8_t* input_data, size_t input_len,
                        uint8_t* output_data, size_t output_len,
-                       uint8_t* dictionary_data) {
+                       uint8_t* dictionary_data, uint8_t escape_byte, bool long_runs) {
 
   // TODO
   // Decompress input_data and write result to output_data
@@ -303,21 +741,81 @@ size_t decompress_data(uint8_t* input_data, size_t input_len,
         // output repeated bytes, from index dict-index; repeat-count times
         // i += 2
       // track output_len so we dont write beyond it
+  // the whole input is here, so a trailing escape byte is a literal
+  size_t input_used = 0;
+  return decompress_data_resume(input_data, input_len, output_data, output_len,
+                                dictionary_data, escape_byte, long_runs, true, &input_used);
+}
+
+size_t read_long_run(uint8_t* input_data, size_t input_len, uint8_t* value, size_t* run_len) {
+  // escape, LONG_RUN_CODE, the byte to repeat, then at least one length byte
+  if (input_len < 4) {
+    return 0;
+  }
+  *value = input_data[2];
+
+  size_t len = 0;
+  for (size_t i = 0; i < LONG_RUN_LEN_BYTES && 3 + i < input_len; i++) {
+    uint8_t b = input_data[3 + i];
+    len |= (size_t)(b & 0x7Fu) << (7 * i);
+    if ((b & 0x80u) == 0) {
+      if (len == 0 || len > LONG_RUN_MAX) {
+        return 0;
+      }
+      *run_len = len;
+      return 3 + i + 1;
+    }
+  }
+  return 0;
+}
+
+size_t read_block_dictionary(uint8_t* input_data, size_t input_len, uint8_t* dictionary_data) {
+  if (input_len < BLOCK_DICTIONARY_MASK_LEN) {
+    return 0;
+  }
+  uint16_t mask = (uint16_t)((uint16_t)input_data[0] << 8 | (uint16_t)input_data[1]);
+
+  // one byte per changed entry follows the mask
+  size_t len = BLOCK_DICTIONARY_MASK_LEN;
+  for (int i = 0; i < DICTIONARY_LENGTH; i++) {
+    len += (mask >> i) & 1u;
+  }
+  if (input_len < len) {
+    return 0;
+  }
+
+  size_t pos = BLOCK_DICTIONARY_MASK_LEN;
+  for (int i = 0; i < DICTIONARY_LENGTH; i++) {
+    if ((mask >> i) & 1u) {
+      dictionary_data[i] = input_data[pos++];
+    }
+  }
+  return len;
+}
+
+size_t decompress_data_resume(uint8_t* input_data, size_t input_len,
+                              uint8_t* output_data, size_t output_len,
+                              uint8_t* dictionary_data, uint8_t escape_byte, bool long_runs,
+                              bool is_final, size_t* input_used) {
+  *input_used = 0;
   if (input_data == NULL || output_data == NULL || dictionary_data == NULL){
     return 0;}
   size_t out_pos = 0;
+  const kernel_table_t* kernels = active_kernels();
+  size_t literals = 0; // in a row, just before input_data[i]
 
   // walk through output buffer
+  // each time we stop early, i is left at the first input byte not yet used
   size_t i = 0;
   while (i < input_len) {
     // read the curr input byte
     uint8_t b = input_data[i];
 
     // normal case
-    if (b != ESCAPE_BYTE) {
+    if (b != escape_byte) {
       // don't write past buffer
       if (out_pos >= output_len) {
-        return out_pos;
+        break;
       }
       // copy literal byte directly to output
       output_data[out_pos] = b;
@@ -325,17 +823,31 @@ size_t decompress_data(uint8_t* input_data, size_t input_len,
 
       // move to next input byte
       i++;
+
+      // a long stretch of literals: find the next escape with the byte search
+      // kernel and copy everything up to it at once
+      if (++literals == LITERAL_SCAN_AFTER) {
+        size_t span = kernels->find_byte(&input_data[i], input_len - i, escape_byte);
+        if (span > output_len - out_pos) {
+          span = output_len - out_pos;
+        }
+        memcpy(&output_data[out_pos], &input_data[i], span);
+        out_pos += span;
+        i += span;
+      }
       continue;
     }
+    literals = 0;
 
-    // if we get here; escape byte = 0x07
+    // if we get here; b is the escape byte (0x07 unless the stream chose another)
     // if the escape byte is the very last byte, treat as a normal literal
+    // (unless more input is coming, in which case its code byte is in the next piece)
     if (i == input_len - 1) {
-      if (out_pos >= output_len) {
-        return out_pos;
+      if (!is_final || out_pos >= output_len) {
+        break;
       }
 
-      output_data[out_pos] = ESCAPE_BYTE;
+      output_data[out_pos] = escape_byte;
       out_pos++;
       i++; // this is the last byte
       continue;
@@ -347,16 +859,31 @@ size_t decompress_data(uint8_t* input_data, size_t input_len,
     // case: [0x07, 0x00]
     if (code == 0x00){
       if (out_pos >= output_len) {
-        return out_pos;
+        break;
       }
 
-      output_data[out_pos] = ESCAPE_BYTE;
+      output_data[out_pos] = escape_byte;
       out_pos++;
 
       i += 2; // pass both input bytes
       continue;
     }
 
+    // long run: [0x07, LONG_RUN_CODE, value, length...], written with one memset
+    if (code == LONG_RUN_CODE && long_runs) {
+      uint8_t value = 0;
+      size_t run_len = 0;
+      size_t code_len = read_long_run(&input_data[i], input_len - i, &value, &run_len);
+      // a cut-off code waits for the next piece; a broken one goes no further
+      if (code_len == 0 || run_len > output_len - out_pos) {
+        break;
+      }
+      memset(&output_data[out_pos], value, run_len);
+      out_pos += run_len;
+      i += code_len;
+      continue;
+    }
+
     // compressed run encoding is [0x07, code]
       // low 4 bits = dict-index
       // high 4 bits = repeat-count
@@ -364,25 +891,25 @@ size_t decompress_data(uint8_t* input_data, size_t input_len,
     uint8_t repeat_count = (uint8_t)((code >> 4) & 0x0Fu); // extract the upper 4  bits
 
     if (dict_index >= DICTIONARY_LENGTH) {
-      return out_pos;
+      break;
     }
 
     if (repeat_count >= MAX_RUN_LENGTH) {
-      return out_pos;
+      break;
+    }
+
+    // only take the run if all of it fits, so a resumed call never has to
+    // remember a half-written run
+    if (repeat_count > output_len - out_pos) {
+      break;
     }
 
     // get the byte to repeat from dictionary
     uint8_t value_to_repeat = dictionary_data[dict_index];
 
     // write this value to output repeat-count times
-    for (uint8_t r=0; r<repeat_count; r++) {
-      if (out_pos >= output_len){
-        return out_pos;
-      }
-
-      output_data[out_pos] = value_to_repeat;
-      out_pos++;
-    }
+    memset(&output_data[out_pos], value_to_repeat, repeat_count);
+    out_pos += repeat_count;
 
     // pass both input bytes 
     i += 2;
@@ -390,10 +917,126 @@ size_t decompress_data(uint8_t* input_data, size_t input_len,
   }
 
   // return how many bytes wrote to output-data
-
+  *input_used = i;
   return out_pos;
 }
 
+// Two-stream join kernels
+// Every variant takes n_floats 3-byte sign|fraction values and n_floats exponents
+static void join_float_scalar(const uint8_t* input_signfrac, const uint8_t* input_exp,
+                              uint8_t* output_data, size_t n_floats) {
+  for (size_t i = 0; i < n_floats; i++) {
+    // Read the 3 signfrac bytes for float i
+      // [ sign ][ exp7 exp6 exp5 exp4 exp3 exp2 exp1 exp0 ][ frac22 ... frac0 ]
+      // signfrac is little-endian:
+        // byte0 = frac0  frac1  frac2  frac3  frac4  frac5  frac6  frac7 (lowest adrress)
+        // byte1 = frac0  frac1  frac2  frac3  frac4  frac5  frac6  frac7
+        // byte2 = frac16 frac17 frac18 frac19 frac20 frac21 frac22 exp0
+        // byte3 = exp1 exp2 exp3 exp4 exp5 exp6 exp7 sign (highest address)
+      // out[0] = fraction bits 0..7     = signfrac[0]
+      // out[1] = fraction bits 8..15    = signfrac[1]
+      // out[2] = fraction bits 16..22 + exponent bit0
+      // out[3] = exponent bits 1..7 + sign bit
+
+    uint8_t b0 = input_signfrac[3 * i + 0];
+    uint8_t b1 = input_signfrac[3 * i + 1];
+    uint8_t b2 = input_signfrac[3 * i + 2];
+
+    // Read exponent byte for float i
+    uint8_t exp = input_exp[i];
+
+    //Extract sign bit (1 bit) from b2's MSb: sign = 0 or 1
+    uint8_t sign = (uint8_t)((b2 >> 7) & 0x01u);
+
+    // Extract the top 7 fraction bits from b2 (bits0..6)
+    uint8_t frac_hi7 = (uint8_t)(b2 & 0x7Fu);
+
+    // final IEEE-754 float bytes in little-endian order:
+      // output[0] = b0
+      // output[1] = b1
+      //
+      // output[2]:
+          // bits0..6 = frac_hi7
+          // bit7     = exponent bit0
+      //
+      // output[3]:
+          // bits0..6 = exponent bits1..7  (that's exp >> 1)
+          // bit7     = sign
+
+    // exponent bit0 is the least significant bit of exp
+    uint8_t exp_bit0 = (uint8_t)(exp & 0x01u);
+
+    // exponent bits1..7 become a 7-bit value (exp shifted right by 1)
+    uint8_t exp_hi7 = (uint8_t)(exp >> 1);
+
+    // Construct byte2 (fraction hi7 + exponent bit0 in MSB)
+    uint8_t out2 = (uint8_t)(frac_hi7 | (uint8_t)(exp_bit0 << 7));
+
+    // Construct byte3 (exponent hi7 + sign in MSB)
+    uint8_t out3 = (uint8_t)(exp_hi7 | (uint8_t)(sign << 7));
+
+  // Write the 4 bytes into output
+    output_data[4 * i + 0] = b0;
+    output_data[4 * i + 1] = b1;
+    output_data[4 * i + 2] = out2;
+    output_data[4 * i + 3] = out3;
+  }
+}
+
+#if defined(__x86_64__)
+// Spreads 4 packed 3-byte sign|fraction values into the low 3 bytes of 4 words
+// and shifts the exponent in under the sign, 4 floats per step
+__attribute__((target("ssse3")))
+static void join_float_ssse3(const uint8_t* input_signfrac, const uint8_t* input_exp,
+                             uint8_t* output_data, size_t n_floats) {
+  const __m128i spread    = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m128i exp_top   = _mm_setr_epi8(-1, -1, -1, 0, -1, -1, -1, 1, -1, -1, -1, 2, -1, -1, -1, 3);
+  const __m128i frac_mask = _mm_set1_epi32(0x007FFFFF);
+  const __m128i sign_mask = _mm_set1_epi32(0x00800000);
+
+  // each step loads 16 sign|fraction bytes but uses 12, so stop while that stays in bounds
+  size_t i = 0;
+  for (; 3 * i + 16 <= 3 * n_floats; i += 4) {
+    __m128i signfrac = _mm_loadu_si128((const __m128i*)(const void*)&input_signfrac[3 * i]);
+    signfrac = _mm_shuffle_epi8(signfrac, spread);
+    int32_t exps;
+    memcpy(&exps, &input_exp[i], 4);
+    __m128i exp = _mm_shuffle_epi8(_mm_cvtsi32_si128(exps), exp_top);
+
+    __m128i word = _mm_or_si128(_mm_and_si128(signfrac, frac_mask),
+                                _mm_slli_epi32(_mm_and_si128(signfrac, sign_mask), 8));
+    word = _mm_or_si128(word, _mm_srli_epi32(exp, 1));
+    _mm_storeu_si128((__m128i*)(void*)&output_data[4 * i], word);
+  }
+  join_float_scalar(&input_signfrac[3 * i], &input_exp[i], &output_data[4 * i], n_floats - i);
+}
+
+// Same as the SSSE3 kernel, 8 floats per step
+__attribute__((target("avx2")))
+static void join_float_avx2(const uint8_t* input_signfrac, const uint8_t* input_exp,
+                            uint8_t* output_data, size_t n_floats) {
+  const __m256i spread    = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                             0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m256i frac_mask = _mm256_set1_epi32(0x007FFFFF);
+  const __m256i sign_mask = _mm256_set1_epi32(0x00800000);
+
+  size_t i = 0;
+  for (; 3 * i + 12 + 16 <= 3 * n_floats; i += 8) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)(const void*)&input_signfrac[3 * i]);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(const void*)&input_signfrac[3 * i + 12]);
+    __m256i signfrac = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    signfrac = _mm256_shuffle_epi8(signfrac, spread);
+    __m256i exp = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(const void*)&input_exp[i]));
+
+    __m256i word = _mm256_or_si256(_mm256_and_si256(signfrac, frac_mask),
+                                   _mm256_slli_epi32(_mm256_and_si256(signfrac, sign_mask), 8));
+    word = _mm256_or_si256(word, _mm256_slli_epi32(exp, 23));
+    _mm256_storeu_si256((__m256i*)(void*)&output_data[4 * i], word);
+  }
+  join_float_ssse3(&input_signfrac[3 * i], &input_exp[i], &output_data[4 * i], n_floats - i);
+}
+#endif
+
 void join_float_array(uint8_t* input_signfrac, size_t input_len_bytes_signfrac,
                       uint8_t* input_exp, size_t input_len_bytes_exp,
                       uint8_t* output_data, size_t output_len_bytes) {
@@ -454,63 +1097,7 @@ void join_float_array(uint8_t* input_signfrac, size_t input_len_bytes_signfrac,
     return; // not enough space to write output floats
   }
 
-  // join each float
-  for (size_t i = 0; i < n_floats; i++) {
-    // Read the 3 signfrac bytes for float i
-      // [ sign ][ exp7 exp6 exp5 exp4 exp3 exp2 exp1 exp0 ][ frac22 ... frac0 ]
-      // signfrac is little-endian:
-        // byte0 = frac0  frac1  frac2  frac3  frac4  frac5  frac6  frac7 (lowest adrress)
-        // byte1 = frac0  frac1  frac2  frac3  frac4  frac5  frac6  frac7
-        // byte2 = frac16 frac17 frac18 frac19 frac20 frac21 frac22 exp0
-        // byte3 = exp1 exp2 exp3 exp4 exp5 exp6 exp7 sign (highest address)
-      // out[0] = fraction bits 0..7     = signfrac[0]
-      // out[1] = fraction bits 8..15    = signfrac[1]
-      // out[2] = fraction bits 16..22 + exponent bit0
-      // out[3] = exponent bits 1..7 + sign bit
-
-    uint8_t b0 = input_signfrac[3 * i + 0];
-    uint8_t b1 = input_signfrac[3 * i + 1];
-    uint8_t b2 = input_signfrac[3 * i + 2];
-
-    // Read exponent byte for float i
-    uint8_t exp = input_exp[i];
-
-    //Extract sign bit (1 bit) from b2's MSb: sign = 0 or 1
-    uint8_t sign = (uint8_t)((b2 >> 7) & 0x01u);
-
-    // Extract the top 7 fraction bits from b2 (bits0..6)
-    uint8_t frac_hi7 = (uint8_t)(b2 & 0x7Fu);
-
-    // final IEEE-754 float bytes in little-endian order:
-      // output[0] = b0
-      // output[1] = b1
-      //
-      // output[2]:
-          // bits0..6 = frac_hi7
-          // bit7     = exponent bit0
-      //
-      // output[3]:
-          // bits0..6 = exponent bits1..7  (that's exp >> 1)
-          // bit7     = sign
-
-    // exponent bit0 is the least significant bit of exp
-    uint8_t exp_bit0 = (uint8_t)(exp & 0x01u);
-
-    // exponent bits1..7 become a 7-bit value (exp shifted right by 1)
-    uint8_t exp_hi7 = (uint8_t)(exp >> 1);
-
-    // Construct byte2 (fraction hi7 + exponent bit0 in MSB)
-    uint8_t out2 = (uint8_t)(frac_hi7 | (uint8_t)(exp_bit0 << 7));
-
-    // Construct byte3 (exponent hi7 + sign in MSB)
-    uint8_t out3 = (uint8_t)(exp_hi7 | (uint8_t)(sign << 7));
-
-  // Write the 4 bytes into output
-    output_data[4 * i + 0] = b0;
-    output_data[4 * i + 1] = b1;
-    output_data[4 * i + 2] = out2;
-    output_data[4 * i + 3] = out3;
-  }
+  active_kernels()->join_float(input_signfrac, input_exp, output_data, n_floats);
 
 }
 /* End of mandatory implementation. */
@@ -546,6 +1133,71 @@ static uint32_t read_bits_as_uint32(const uint8_t* src, size_t start_bit, size_t
   return value;
 }
 
+// Three-stream join kernels
+// Every variant takes n_floats exponents, and n_floats 23-bit fractions and
+// sign bits, each packed densely LSB first
+// The plain loop joins floats [first, n_floats), so faster kernels can hand it their leftovers
+static void join_float3_from(const uint8_t* input_frac, const uint8_t* input_exp, const uint8_t* input_sign,
+                             uint8_t* output_data, size_t first, size_t n_floats) {
+  for (size_t i = first; i < n_floats; i++) {
+
+    // 1) Read sign bit for float i (1 bit)
+    // The i-th sign bit lives at bit_offset=i in the sign bitstream
+    uint32_t sign = (uint32_t)get_bit_from_array(input_sign, i); // 0 or 1
+
+    // 2) Read exponent for float i (8 bits stored as one byte)
+    uint32_t exp = (uint32_t)input_exp[i];
+
+    // 3) Read 23 fraction bits for float i
+    // Fraction bits for float i start at bit offset 23*i in the fraction bitstream
+    size_t frac_start_bit = 23 * i;
+    uint32_t frac = read_bits_as_uint32(input_frac, frac_start_bit, 23); // bits [0..22]
+
+  // Encode IEEE754
+    //   bit 31        = sign
+    //   bits 30..23   = exponent (8 bits)
+    //   bits 22..0    = fraction (23 bits)
+    uint32_t word = 0;
+    word |= (frac & 0x007FFFFFu);        // keep only 23 bits
+    word |= ((exp & 0xFFu) << 23);       // exponent into bits 23..30
+    word |= ((sign & 0x1u) << 31);       // sign into bit 31
+
+    // 5) Write word to output in LITTLE-ENDIAN
+    output_data[4 * i + 0] = (uint8_t)((word >> 0)  & 0xFFu);
+    output_data[4 * i + 1] = (uint8_t)((word >> 8)  & 0xFFu);
+    output_data[4 * i + 2] = (uint8_t)((word >> 16) & 0xFFu);
+    output_data[4 * i + 3] = (uint8_t)((word >> 24) & 0xFFu);
+  }
+}
+
+static void join_float3_scalar(const uint8_t* input_frac, const uint8_t* input_exp, const uint8_t* input_sign,
+                               uint8_t* output_data, size_t n_floats) {
+  join_float3_from(input_frac, input_exp, input_sign, output_data, 0, n_floats);
+}
+
+#if defined(__x86_64__)
+// Reads each fraction with one unaligned 8-byte load, a shift and a BZHI,
+// instead of bit by bit
+__attribute__((target("bmi2")))
+static void join_float3_bmi2(const uint8_t* input_frac, const uint8_t* input_exp, const uint8_t* input_sign,
+                             uint8_t* output_data, size_t n_floats) {
+  size_t frac_len = (23 * n_floats + 7) / 8;
+
+  size_t i = 0;
+  for (; (23 * i) / 8 + 8 <= frac_len; i++) {
+    size_t bit = 23 * i;
+    uint64_t window;
+    memcpy(&window, &input_frac[bit / 8], 8);
+    uint32_t frac = (uint32_t)_bzhi_u64(window >> (bit % 8), 23);
+    uint32_t sign = (input_sign[i / 8] >> (i % 8)) & 0x1u;
+
+    uint32_t word = frac | ((uint32_t)input_exp[i] << 23) | (sign << 31);
+    memcpy(&output_data[4 * i], &word, 4); // x86 is little-endian, like the output
+  }
+  join_float3_from(input_frac, input_exp, input_sign, output_data, i, n_floats);
+}
+#endif
+
 void join_float_array_three_stream(uint8_t* input_frac,
                                    size_t   input_len_bytes_frac,
                                    uint8_t* input_exp,
@@ -625,33 +1277,494 @@ void join_float_array_three_stream(uint8_t* input_frac,
   }
   
   // Reconstructing each float
+  active_kernels()->join_float3(input_frac, input_exp, input_sign, output_data, n_floats);
+}
+
+// Double join kernels: each value is its streams' bytes laid end to end,
+// lowest first, so these are byte shuffles
+static void join_double_scalar(const uint8_t* input_mantissa, const uint8_t* input_signexp,
+                               uint8_t* output_data, size_t n_doubles) {
+  for (size_t i = 0; i < n_doubles; i++) {
+    memcpy(&output_data[8 * i], &input_mantissa[FLOAT64_MANTISSA_LEN * i], FLOAT64_MANTISSA_LEN);
+    memcpy(&output_data[8 * i + FLOAT64_MANTISSA_LEN], &input_signexp[FLOAT64_SIGNEXP_LEN * i],
+           FLOAT64_SIGNEXP_LEN);
+  }
+}
+
+static void join_double3_scalar(const uint8_t* input_mantissa_lo, const uint8_t* input_signexp,
+                                const uint8_t* input_mantissa_hi, uint8_t* output_data, size_t n_doubles) {
+  for (size_t i = 0; i < n_doubles; i++) {
+    memcpy(&output_data[8 * i], &input_mantissa_lo[FLOAT64_MANTISSA_LO_LEN * i], FLOAT64_MANTISSA_LO_LEN);
+    memcpy(&output_data[8 * i + 4], &input_mantissa_hi[FLOAT64_MANTISSA_HI_LEN * i], FLOAT64_MANTISSA_HI_LEN);
+    memcpy(&output_data[8 * i + 6], &input_signexp[FLOAT64_SIGNEXP_LEN * i], FLOAT64_SIGNEXP_LEN);
+  }
+}
+
+#if defined(__x86_64__)
+// Spreads 2 packed 6-byte mantissas into the low 6 bytes of 2 quadwords and
+// shuffles the sign and exponent bytes in above them, 2 doubles per step
+__attribute__((target("ssse3")))
+static void join_double_ssse3(const uint8_t* input_mantissa, const uint8_t* input_signexp,
+                              uint8_t* output_data, size_t n_doubles) {
+  const __m128i spread  = _mm_setr_epi8(0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1);
+  const __m128i on_top  = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1, 2, 3);
+
+  // each step loads 16 mantissa bytes but uses 12, so stop while that stays in bounds
+  size_t i = 0;
+  for (; 6 * i + 16 <= 6 * n_doubles; i += 2) {
+    __m128i mantissa = _mm_loadu_si128((const __m128i*)(const void*)&input_mantissa[6 * i]);
+    int32_t signexps;
+    memcpy(&signexps, &input_signexp[2 * i], 4);
+    __m128i word = _mm_or_si128(_mm_shuffle_epi8(mantissa, spread),
+                                _mm_shuffle_epi8(_mm_cvtsi32_si128(signexps), on_top));
+    _mm_storeu_si128((__m128i*)(void*)&output_data[8 * i], word);
+  }
+  join_double_scalar(&input_mantissa[6 * i], &input_signexp[2 * i], &output_data[8 * i], n_doubles - i);
+}
+
+// Same as the SSSE3 kernel, 4 doubles per step
+__attribute__((target("avx2")))
+static void join_double_avx2(const uint8_t* input_mantissa, const uint8_t* input_signexp,
+                             uint8_t* output_data, size_t n_doubles) {
+  const __m256i spread = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1,
+                                          0, 1, 2, 3, 4, 5, -1, -1, 6, 7, 8, 9, 10, 11, -1, -1);
+  const __m256i on_top = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1, 2, 3,
+                                          -1, -1, -1, -1, -1, -1, 4, 5, -1, -1, -1, -1, -1, -1, 6, 7);
+
+  size_t i = 0;
+  for (; 6 * i + 12 + 16 <= 6 * n_doubles; i += 4) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)(const void*)&input_mantissa[6 * i]);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(const void*)&input_mantissa[6 * i + 12]);
+    __m256i mantissa = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    __m256i signexp  = _mm256_broadcastsi128_si256(
+        _mm_loadl_epi64((const __m128i*)(const void*)&input_signexp[2 * i]));
+
+    __m256i word = _mm256_or_si256(_mm256_shuffle_epi8(mantissa, spread), _mm256_shuffle_epi8(signexp, on_top));
+    _mm256_storeu_si256((__m256i*)(void*)&output_data[8 * i], word);
+  }
+  join_double_ssse3(&input_mantissa[6 * i], &input_signexp[2 * i], &output_data[8 * i], n_doubles - i);
+}
+
+// Pairs each high mantissa with its sign and exponent (unpacking 16-bit
+// halves), then interleaves those with the low mantissas, 4 doubles per step
+__attribute__((target("sse2")))
+static void join_double3_sse2(const uint8_t* input_mantissa_lo, const uint8_t* input_signexp,
+                              const uint8_t* input_mantissa_hi, uint8_t* output_data, size_t n_doubles) {
+  size_t i = 0;
+  for (; i + 4 <= n_doubles; i += 4) {
+    __m128i lo      = _mm_loadu_si128((const __m128i*)(const void*)&input_mantissa_lo[4 * i]);
+    __m128i signexp = _mm_loadl_epi64((const __m128i*)(const void*)&input_signexp[2 * i]);
+    __m128i hi      = _mm_loadl_epi64((const __m128i*)(const void*)&input_mantissa_hi[2 * i]);
+    __m128i top     = _mm_unpacklo_epi16(hi, signexp);
+    _mm_storeu_si128((__m128i*)(void*)&output_data[8 * i], _mm_unpacklo_epi32(lo, top));
+    _mm_storeu_si128((__m128i*)(void*)&output_data[8 * i + 16], _mm_unpackhi_epi32(lo, top));
+  }
+  join_double3_scalar(&input_mantissa_lo[4 * i], &input_signexp[2 * i], &input_mantissa_hi[2 * i],
+                      &output_data[8 * i], n_doubles - i);
+}
+
+// Same as the SSE2 kernel, 8 doubles per step (unpacking works within each
+// 16-byte lane, so the halves are put back in order before storing)
+__attribute__((target("avx2")))
+static void join_double3_avx2(const uint8_t* input_mantissa_lo, const uint8_t* input_signexp,
+                              const uint8_t* input_mantissa_hi, uint8_t* output_data, size_t n_doubles) {
+  size_t i = 0;
+  for (; i + 8 <= n_doubles; i += 8) {
+    __m256i lo      = _mm256_loadu_si256((const __m256i*)(const void*)&input_mantissa_lo[4 * i]);
+    __m128i signexp = _mm_loadu_si128((const __m128i*)(const void*)&input_signexp[2 * i]);
+    __m128i hi      = _mm_loadu_si128((const __m128i*)(const void*)&input_mantissa_hi[2 * i]);
+    __m256i top     = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(hi, signexp)),
+                                              _mm_unpackhi_epi16(hi, signexp), 1);
+    __m256i first   = _mm256_unpacklo_epi32(lo, top); // doubles 0, 1 | 4, 5
+    __m256i second  = _mm256_unpackhi_epi32(lo, top); // doubles 2, 3 | 6, 7
+    _mm256_storeu_si256((__m256i*)(void*)&output_data[8 * i], _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i*)(void*)&output_data[8 * i + 32],
+                        _mm256_permute2x128_si256(first, second, 0x31));
+  }
+  join_double3_sse2(&input_mantissa_lo[4 * i], &input_signexp[2 * i], &input_mantissa_hi[2 * i],
+                    &output_data[8 * i], n_doubles - i);
+}
+#endif
+
+void join_double_array(uint8_t* input_mantissa, size_t input_len_bytes_mantissa,
+                       uint8_t* input_signexp, size_t input_len_bytes_signexp,
+                       uint8_t* output_data, size_t output_len_bytes) {
+  if (output_data == NULL || input_mantissa == NULL || input_signexp == NULL) {
+    return;
+  }
+
+  // the sign and exponent stream decides the count; the others must agree
+  size_t n_doubles = input_len_bytes_signexp / FLOAT64_SIGNEXP_LEN;
+  if (input_len_bytes_signexp % FLOAT64_SIGNEXP_LEN != 0 ||
+      input_len_bytes_mantissa != FLOAT64_MANTISSA_LEN * n_doubles || output_len_bytes < 8 * n_doubles) {
+    return;
+  }
+
+  active_kernels()->join_double(input_mantissa, input_signexp, output_data, n_doubles);
+}
+
+void join_double_array_three_stream(uint8_t* input_mantissa_lo, size_t input_len_bytes_mantissa_lo,
+                                    uint8_t* input_signexp, size_t input_len_bytes_signexp,
+                                    uint8_t* input_mantissa_hi, size_t input_len_bytes_mantissa_hi,
+                                    uint8_t* output_data, size_t output_len_bytes) {
+  if (output_data == NULL || input_mantissa_lo == NULL || input_signexp == NULL || input_mantissa_hi == NULL) {
+    return;
+  }
+
+  size_t n_doubles = input_len_bytes_signexp / FLOAT64_SIGNEXP_LEN;
+  if (input_len_bytes_signexp % FLOAT64_SIGNEXP_LEN != 0 ||
+      input_len_bytes_mantissa_lo != FLOAT64_MANTISSA_LO_LEN * n_doubles ||
+      input_len_bytes_mantissa_hi != FLOAT64_MANTISSA_HI_LEN * n_doubles || output_len_bytes < 8 * n_doubles) {
+    return;
+  }
+
+  active_kernels()->join_double3(input_mantissa_lo, input_signexp, input_mantissa_hi, output_data, n_doubles);
+}
+
+uint64_t float_value_count(const packlab_config_t* config) {
+  return config->is_float64 ? config->orig_data_size / FLOAT64_SIGNEXP_LEN : config->orig_data_size;
+}
+
+uint64_t float_output_len(const packlab_config_t* config) {
+  return (config->is_float64 ? 8 : 4) * float_value_count(config);
+}
+
+// Narrowing kernels: each turns n_floats little-endian floats into 2-byte
+// values, rounding to nearest even. The output may be the input itself, as
+// every step reads its floats before writing the (shorter) results
+// bfloat16 is the top half of a float, so rounding is adding just under half
+// of the dropped bits (plus the kept lowest bit, to break ties to even). NaNs
+// keep their top bits, with the quiet bit set so they stay NaNs
+static void narrow_bf16_scalar(const uint8_t* input_data, uint8_t* output_data, size_t n_floats) {
   for (size_t i = 0; i < n_floats; i++) {
+    uint32_t bits;
+    memcpy(&bits, &input_data[4 * i], 4);
+    uint16_t half = ((bits & 0x7FFFFFFFu) > 0x7F800000u) ? (uint16_t)((bits >> 16) | 0x0040u) :
+                                                            (uint16_t)((bits + 0x7FFFu + ((bits >> 16) & 1u)) >> 16);
+    memcpy(&output_data[2 * i], &half, 2);
+  }
+}
 
-    // 1) Read sign bit for float i (1 bit)
-    // The i-th sign bit lives at bit_offset=i in the sign bitstream
-    uint32_t sign = (uint32_t)get_bit_from_array(input_sign, i); // 0 or 1
+// IEEE half precision: 5 exponent bits, so large floats overflow to infinity
+// and small ones become subnormal halves (or zero). NaNs keep their top
+// fraction bits, quieted, as the F16C instructions do
+static void narrow_fp16_scalar(const uint8_t* input_data, uint8_t* output_data, size_t n_floats) {
+  for (size_t i = 0; i < n_floats; i++) {
+    uint32_t bits;
+    memcpy(&bits, &input_data[4 * i], 4);
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t abs  = bits & 0x7FFFFFFFu;
+    uint32_t half = 0;
+
+    if (abs > 0x7F800000u) {
+      half = 0x7E00u | ((abs >> 13) & 0x3FFu); // NaN
+    } else if (abs >= 0x477FF000u) {
+      half = 0x7C00u; // rounds past the largest half (65504), or is infinite
+    } else if (abs >= 0x38800000u) {
+      // normal: rebias the exponent (127 -> 15), then round off 13 fraction bits
+      uint32_t rebiased = abs - 0x38000000u;
+      half = (rebiased + 0xFFFu + ((rebiased >> 13) & 1u)) >> 13;
+    } else if (abs > 0x33000000u) {
+      // subnormal: the whole significand, shifted down to units of 2^-24
+      uint32_t significand = (abs & 0x7FFFFFu) | 0x800000u;
+      uint32_t shift = 126u - (abs >> 23);
+      uint32_t dropped  = significand & ((1u << shift) - 1u);
+      uint32_t halfway  = 1u << (shift - 1u);
+      half = significand >> shift;
+      if (dropped > halfway || (dropped == halfway && (half & 1u))) {
+        half++;
+      }
+    }
+    // (anything at or below 2^-25 rounds to zero)
 
-    // 2) Read exponent for float i (8 bits stored as one byte)
-    uint32_t exp = (uint32_t)input_exp[i];
+    uint16_t value = (uint16_t)(sign | half);
+    memcpy(&output_data[2 * i], &value, 2);
+  }
+}
 
-    // 3) Read 23 fraction bits for float i
-    // Fraction bits for float i start at bit offset 23*i in the fraction bitstream
-    size_t frac_start_bit = 23 * i;
-    uint32_t frac = read_bits_as_uint32(input_frac, frac_start_bit, 23); // bits [0..22]
+#if defined(__x86_64__)
+// Rounds 4 floats at a time and packs their top halves (an arithmetic shift
+// keeps them in range of the signed saturating pack), 8 floats per step
+__attribute__((target("sse2")))
+static void narrow_bf16_sse2(const uint8_t* input_data, uint8_t* output_data, size_t n_floats) {
+  const __m128i abs_mask = _mm_set1_epi32(0x7FFFFFFF);
+  const __m128i infinity = _mm_set1_epi32(0x7F800000);
+  const __m128i round    = _mm_set1_epi32(0x7FFF);
+  const __m128i one      = _mm_set1_epi32(1);
+  const __m128i quiet    = _mm_set1_epi32(0x00400000);
 
-  // Encode IEEE754
-    //   bit 31        = sign
-    //   bits 30..23   = exponent (8 bits)
-    //   bits 22..0    = fraction (23 bits)
-    uint32_t word = 0;
-    word |= (frac & 0x007FFFFFu);        // keep only 23 bits
-    word |= ((exp & 0xFFu) << 23);       // exponent into bits 23..30
-    word |= ((sign & 0x1u) << 31);       // sign into bit 31
+  size_t i = 0;
+  for (; i + 8 <= n_floats; i += 8) {
+    __m128i halves[2];
+    for (int k = 0; k < 2; k++) {
+      __m128i bits    = _mm_loadu_si128((const __m128i*)(const void*)&input_data[4 * i + 16 * k]);
+      __m128i is_nan  = _mm_cmpgt_epi32(_mm_and_si128(bits, abs_mask), infinity);
+      __m128i rounded = _mm_add_epi32(_mm_add_epi32(bits, round), _mm_and_si128(_mm_srli_epi32(bits, 16), one));
+      __m128i value   = _mm_or_si128(_mm_and_si128(is_nan, _mm_or_si128(bits, quiet)),
+                                     _mm_andnot_si128(is_nan, rounded));
+      halves[k] = _mm_srai_epi32(value, 16);
+    }
+    _mm_storeu_si128((__m128i*)(void*)&output_data[2 * i], _mm_packs_epi32(halves[0], halves[1]));
+  }
+  narrow_bf16_scalar(&input_data[4 * i], &output_data[2 * i], n_floats - i);
+}
 
-    // 5) Write word to output in LITTLE-ENDIAN
-    output_data[4 * i + 0] = (uint8_t)((word >> 0)  & 0xFFu);
-    output_data[4 * i + 1] = (uint8_t)((word >> 8)  & 0xFFu);
-    output_data[4 * i + 2] = (uint8_t)((word >> 16) & 0xFFu);
-    output_data[4 * i + 3] = (uint8_t)((word >> 24) & 0xFFu);
+// Same as the SSE2 kernel, 16 floats per step (packing works within each
+// 16-byte lane, so the quadwords are put back in order before storing)
+__attribute__((target("avx2")))
+static void narrow_bf16_avx2(const uint8_t* input_data, uint8_t* output_data, size_t n_floats) {
+  const __m256i abs_mask = _mm256_set1_epi32(0x7FFFFFFF);
+  const __m256i infinity = _mm256_set1_epi32(0x7F800000);
+  const __m256i round    = _mm256_set1_epi32(0x7FFF);
+  const __m256i one      = _mm256_set1_epi32(1);
+  const __m256i quiet    = _mm256_set1_epi32(0x00400000);
+
+  size_t i = 0;
+  for (; i + 16 <= n_floats; i += 16) {
+    __m256i halves[2];
+    for (int k = 0; k < 2; k++) {
+      __m256i bits    = _mm256_loadu_si256((const __m256i*)(const void*)&input_data[4 * i + 32 * k]);
+      __m256i is_nan  = _mm256_cmpgt_epi32(_mm256_and_si256(bits, abs_mask), infinity);
+      __m256i rounded = _mm256_add_epi32(_mm256_add_epi32(bits, round),
+                                         _mm256_and_si256(_mm256_srli_epi32(bits, 16), one));
+      __m256i value   = _mm256_blendv_epi8(rounded, _mm256_or_si256(bits, quiet), is_nan);
+      halves[k] = _mm256_srai_epi32(value, 16);
+    }
+    __m256i packed = _mm256_packs_epi32(halves[0], halves[1]);
+    _mm256_storeu_si256((__m256i*)(void*)&output_data[2 * i], _mm256_permute4x64_epi64(packed, 0xD8));
+  }
+  narrow_bf16_sse2(&input_data[4 * i], &output_data[2 * i], n_floats - i);
+}
+
+// Same again, 16 floats per step, truncating each word to its low half
+__attribute__((target("avx512f,avx512bw")))
+static void narrow_bf16_avx512(const uint8_t* input_data, uint8_t* output_data, size_t n_floats) {
+  const __m512i abs_mask = _mm512_set1_epi32(0x7FFFFFFF);
+  const __m512i infinity = _mm512_set1_epi32(0x7F800000);
+  const __m512i round    = _mm512_set1_epi32(0x7FFF);
+  const __m512i one      = _mm512_set1_epi32(1);
+  const __m512i quiet    = _mm512_set1_epi32(0x00400000);
+
+  size_t i = 0;
+  for (; i + 16 <= n_floats; i += 16) {
+    __m512i bits    = _mm512_loadu_si512((const void*)&input_data[4 * i]);
+    __mmask16 is_nan = _mm512_cmpgt_epi32_mask(_mm512_and_si512(bits, abs_mask), infinity);
+    __m512i rounded = _mm512_add_epi32(_mm512_add_epi32(bits, round),
+                                       _mm512_and_si512(_mm512_srli_epi32(bits, 16), one));
+    __m512i value   = _mm512_mask_or_epi32(rounded, is_nan, bits, quiet);
+    _mm256_storeu_si256((__m256i*)(void*)&output_data[2 * i], _mm512_cvtepi32_epi16(_mm512_srli_epi32(value, 16)));
+  }
+  narrow_bf16_avx2(&input_data[4 * i], &output_data[2 * i], n_floats - i);
+}
+
+// F16C converts 8 floats per instruction, rounding to nearest even
+__attribute__((target("avx2,f16c")))
+static void narrow_fp16_f16c(const uint8_t* input_data, uint8_t* output_data, size_t n_floats) {
+  size_t i = 0;
+  for (; i + 8 <= n_floats; i += 8) {
+    __m256 floats = _mm256_loadu_ps((const float*)(const void*)&input_data[4 * i]);
+    __m128i halves = _mm256_cvtps_ph(floats, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    _mm_storeu_si128((__m128i*)(void*)&output_data[2 * i], halves);
+  }
+  narrow_fp16_scalar(&input_data[4 * i], &output_data[2 * i], n_floats - i);
+}
+
+// Same, 16 floats per instruction
+__attribute__((target("avx512f,avx512bw")))
+static void narrow_fp16_avx512(const uint8_t* input_data, uint8_t* output_data, size_t n_floats) {
+  size_t i = 0;
+  for (; i + 16 <= n_floats; i += 16) {
+    __m512 floats = _mm512_loadu_ps((const void*)&input_data[4 * i]);
+    __m256i halves = _mm512_cvtps_ph(floats, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    _mm256_storeu_si256((__m256i*)(void*)&output_data[2 * i], halves);
+  }
+  narrow_fp16_f16c(&input_data[4 * i], &output_data[2 * i], n_floats - i);
+}
+#endif
+
+void narrow_float_array(uint8_t* input_data, size_t n_floats, uint8_t* output_data, float_emit_t emit) {
+  if (input_data == NULL || output_data == NULL) {
+    return;
+  }
+
+  if (emit == FLOAT_EMIT_BF16) {
+    active_kernels()->narrow_bf16(input_data, output_data, n_floats);
+  } else if (emit == FLOAT_EMIT_FP16) {
+    active_kernels()->narrow_fp16(input_data, output_data, n_floats);
+  } else if (output_data != input_data) {
+    memmove(output_data, input_data, 4 * n_floats);
+  }
+}
+
+// Prefix kernels, which undo the float transforms: each byte becomes the sum
+// (mod 256) or XOR of itself and every byte before it, starting from `prev`
+// Every variant returns the last byte, to carry into the next piece
+static uint8_t prefix_sum_scalar(uint8_t* data, size_t len, uint8_t prev) {
+  for (size_t i = 0; i < len; i++) {
+    prev = (uint8_t)(prev + data[i]);
+    data[i] = prev;
+  }
+  return prev;
+}
+
+static uint8_t prefix_xor_scalar(uint8_t* data, size_t len, uint8_t prev) {
+  for (size_t i = 0; i < len; i++) {
+    prev ^= data[i];
+    data[i] = prev;
+  }
+  return prev;
+}
+
+#if defined(__x86_64__)
+// Scans 16 bytes in 4 shifted steps (each byte picks up the 1, 2, 4, then 8
+// bytes before it), then adds the carry from the previous step, which is the
+// last byte broadcast to every lane
+#define DEFINE_PREFIX_SSSE3(name, combine)                                                     \
+  __attribute__((target("ssse3")))                                                             \
+  static uint8_t prefix_##name##_ssse3(uint8_t* data, size_t len, uint8_t prev) {             \
+    const __m128i last = _mm_set1_epi8(15);                                                    \
+    __m128i carry = _mm_set1_epi8((char)prev);                                                 \
+    size_t i = 0;                                                                              \
+    for (; i + 16 <= len; i += 16) {                                                           \
+      __m128i x = _mm_loadu_si128((const __m128i*)(const void*)&data[i]);                      \
+      x = combine(x, _mm_slli_si128(x, 1));                                                    \
+      x = combine(x, _mm_slli_si128(x, 2));                                                    \
+      x = combine(x, _mm_slli_si128(x, 4));                                                    \
+      x = combine(x, _mm_slli_si128(x, 8));                                                    \
+      x = combine(x, carry);                                                                   \
+      _mm_storeu_si128((__m128i*)(void*)&data[i], x);                                          \
+      carry = _mm_shuffle_epi8(x, last);                                                       \
+    }                                                                                          \
+    return prefix_##name##_scalar(&data[i], len - i, (uint8_t)_mm_cvtsi128_si32(carry));       \
+  }
+
+// Same, 32 bytes per step: each 16-byte lane is scanned on its own, then the
+// low lane's last byte is carried into the high lane
+#define DEFINE_PREFIX_AVX2(name, combine)                                                      \
+  __attribute__((target("avx2")))                                                              \
+  static uint8_t prefix_##name##_avx2(uint8_t* data, size_t len, uint8_t prev) {              \
+    const __m256i last = _mm256_set1_epi8(15);                                                 \
+    __m256i carry = _mm256_set1_epi8((char)prev);                                              \
+    size_t i = 0;                                                                              \
+    for (; i + 32 <= len; i += 32) {                                                           \
+      __m256i x = _mm256_loadu_si256((const __m256i*)(const void*)&data[i]);                   \
+      x = combine(x, _mm256_slli_si256(x, 1));                                                 \
+      x = combine(x, _mm256_slli_si256(x, 2));                                                 \
+      x = combine(x, _mm256_slli_si256(x, 4));                                                 \
+      x = combine(x, _mm256_slli_si256(x, 8));                                                 \
+      __m256i lane_last = _mm256_shuffle_epi8(x, last);                                        \
+      x = combine(x, _mm256_permute2x128_si256(lane_last, lane_last, 0x08));                   \
+      x = combine(x, carry);                                                                   \
+      _mm256_storeu_si256((__m256i*)(void*)&data[i], x);                                       \
+      lane_last = _mm256_shuffle_epi8(x, last);                                                \
+      carry = _mm256_permute2x128_si256(lane_last, lane_last, 0x11);                           \
+    }                                                                                          \
+    return prefix_##name##_scalar(&data[i], len - i, (uint8_t)_mm256_cvtsi256_si32(carry));    \
+  }
+
+DEFINE_PREFIX_SSSE3(sum, _mm_add_epi8)
+DEFINE_PREFIX_SSSE3(xor, _mm_xor_si128)
+DEFINE_PREFIX_AVX2(sum, _mm256_add_epi8)
+DEFINE_PREFIX_AVX2(xor, _mm256_xor_si256)
+#endif
+
+bool float_transform_allowed(uint64_t stream, const packlab_config_t* config) {
+  if (config->is_float64) {
+    return false;
+  }
+  return (stream == 1) || (stream == 0 && !config->should_float3);
+}
+
+size_t float_value_len(uint64_t stream) {
+  return (stream == 0) ? 3 : 1;
+}
+
+uint8_t undo_float_transform(uint8_t* data, size_t len, size_t value_len,
+                             float_transform_t transform, uint8_t prev) {
+  if (data == NULL || transform == FLOAT_TRANSFORM_NONE) {
+    return prev;
+  }
+
+  if (value_len == 1) {
+    const kernel_table_t* kernels = active_kernels();
+    return (transform == FLOAT_TRANSFORM_DELTA) ? kernels->prefix_sum(data, len, prev) :
+                                                  kernels->prefix_xor(data, len, prev);
+  }
+
+  // spaced-out values (the top bytes of sign|fraction values) take the plain loop
+  for (size_t i = value_len - 1; i < len; i += value_len) {
+    prev = (transform == FLOAT_TRANSFORM_DELTA) ? (uint8_t)(prev + data[i]) : (uint8_t)(prev ^ data[i]);
+    data[i] = prev;
+  }
+  return prev;
+}
+
+// --- kernel dispatch ---
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+static kernel_table_t kernel_tables[CPU_ISA_COUNT];
+
+// Fills in one table per level, each with the best variant it allows
+static void kernels_init(void) {
+  crc32c_init();
+
+  for (int level = 0; level < CPU_ISA_COUNT; level++) {
+    kernel_table_t* table = &kernel_tables[level];
+    table->isa          = (cpu_isa_t)level;
+    table->byte_sum     = byte_sum_scalar;
+    table->crc32c       = crc32c_portable;
+    table->find_byte    = find_byte_scalar;
+    table->prefix_sum   = prefix_sum_scalar;
+    table->prefix_xor   = prefix_xor_scalar;
+    table->join_float   = join_float_scalar;
+    table->join_float3  = join_float3_scalar;
+    table->join_double  = join_double_scalar;
+    table->join_double3 = join_double3_scalar;
+    table->narrow_bf16  = narrow_bf16_scalar;
+    table->narrow_fp16  = narrow_fp16_scalar;
+
+#if defined(__x86_64__)
+    if (level >= CPU_ISA_SSE2) {
+      table->byte_sum     = byte_sum_sse2;
+      table->find_byte    = find_byte_sse2;
+      table->join_double3 = join_double3_sse2;
+      table->narrow_bf16  = narrow_bf16_sse2;
+    }
+    if (level >= CPU_ISA_SSSE3) {
+      table->join_float  = join_float_ssse3;
+      table->join_double = join_double_ssse3;
+      table->prefix_sum  = prefix_sum_ssse3;
+      table->prefix_xor  = prefix_xor_ssse3;
+    }
+    if (level >= CPU_ISA_SSE42) {
+      table->crc32c = crc32c_sse42;
+    }
+    if (level >= CPU_ISA_AVX2) {
+      table->byte_sum     = byte_sum_avx2;
+      table->find_byte    = find_byte_avx2;
+      table->join_float   = join_float_avx2;
+      table->join_float3  = join_float3_bmi2;
+      table->join_double  = join_double_avx2;
+      table->join_double3 = join_double3_avx2;
+      table->prefix_sum   = prefix_sum_avx2;
+      table->prefix_xor   = prefix_xor_avx2;
+      table->narrow_bf16  = narrow_bf16_avx2;
+      table->narrow_fp16  = narrow_fp16_f16c;
+    }
+    if (level >= CPU_ISA_AVX512) {
+      table->byte_sum    = byte_sum_avx512;
+      table->find_byte   = find_byte_avx512;
+      table->narrow_bf16 = narrow_bf16_avx512;
+      table->narrow_fp16 = narrow_fp16_avx512;
+    }
+#endif
+  }
+}
+
+const kernel_table_t* kernels_for_isa(cpu_isa_t isa) {
+  pthread_once(&kernels_once, kernels_init);
+  if (isa >= CPU_ISA_COUNT) {
+    isa = CPU_ISA_SCALAR;
   }
+  return &kernel_tables[isa];
 }
@@ -7,16 +7,88 @@
 #include <stdint.h> // fixed_width ints
 #include <stdlib.h> // size_t and malloc
 
+#include "cpu-dispatch.h"
+
 // Definitions
 #define MAX_STREAMS       16 // packed file can contain a max of 16 streams
 #define HEADER_ALIGN      4096
 #define DATA_ALIGN        4096
-#define MAX_HEADER_SIZE   (4 + 8 + 8 + 16 + 2) // max possible header size for one stream:
-//4 = magic:2+version:1+flags:1;  8 = orig data size; 8 = packed data size; 16 = dict(if compressed); 2 = checksum(if checksum)
-// 20 bytes (MIN) to 38 bytes (MAX)
+#define HEADER_VERSION    0x03 // headers and data start on 4096-byte boundaries
+#define HEADER_VERSION_COMPACT   0x04 // compact layout for small files: no padding at all
+#define HEADER_VERSION_COMPACT64 0x05 // compact layout with headers and data on 64-byte boundaries
+#define COMPACT_ALIGN     64
+#define MAX_HEADER_SIZE   (4 + 8 + 8 + 2 + 16 + 2 + 4 + 1 + 1) // max possible header size for one stream:
+//4 = magic:2+version:1+flags:1;  8 = orig data size; 8 = packed data size; 2 = extension flags(if extended);
+//16 = dict(if compressed); 2 = checksum(if checksum); 4 = crc32c(if crc32c); 1 = block size(if block checksums);
+//1 = escape byte(if escape byte)
+// 20 bytes (MIN) to 46 bytes (MAX)
 #define DICTIONARY_LENGTH 16 
-#define ESCAPE_BYTE       0x07 
+#define ESCAPE_BYTE       0x07 // escape byte of streams that do not choose their own
 #define MAX_RUN_LENGTH    16 // each group of 4 bits can represent 16 distinct values (0–15)
+#define LITERAL_SCAN_AFTER 16 // literals in a row after which decoders search ahead for the next escape
+
+// Extension flags: present (as 2 big-endian bytes after the size fields) only
+// when bit 0 of the main flags byte is set. Each extension's header fields
+// follow the checksum, in extension bit order
+#define EXT_FLAG_CRC32C   0x0001 // stream carries a CRC32C of its stored data
+#define EXT_FLAG_BLOCK_CHECKSUMS 0x0002 // stream carries a table of per-block CRC32Cs after its data
+#define EXT_FLAG_LONG_RUNS 0x0004 // compressed data may contain long-run codes
+#define EXT_FLAG_BLOCK_DICTIONARIES 0x0008 // each block of compressed data starts with a dictionary update
+#define EXT_FLAG_ESCAPE_BYTE 0x0010 // compressed data uses the escape byte in the header instead of ESCAPE_BYTE
+#define EXT_FLAG_FLOAT_DELTA 0x0020 // float values are stored as differences from the one before
+#define EXT_FLAG_FLOAT_XOR   0x0040 // float values are stored XORed with the one before
+#define EXT_FLAG_FLOAT64     0x0080 // float streams split 64-bit doubles instead of 32-bit floats
+#define EXT_FLAG_KNOWN       0x00FF // every extension above; a header with any other is refused,
+                                    // since its data can't be decoded without knowing what it does
+
+// Long runs: with EXT_FLAG_LONG_RUNS, an escape byte followed by LONG_RUN_CODE
+// is followed by the byte to repeat and then the run length, as a varint
+// (7 bits per byte, low bits first, top bit set on every byte but the last)
+#define LONG_RUN_CODE      0x01 // (a run of 0 of dictionary entry 1 otherwise)
+#define LONG_RUN_MAX       4096 // longest run one code may stand for
+#define LONG_RUN_LEN_BYTES 2    // most varint bytes a run length of up to LONG_RUN_MAX takes
+#define MAX_CODE_LEN       (2 + 1 + LONG_RUN_LEN_BYTES) // longest code of any kind, in bytes
+
+// Float transforms: with EXT_FLAG_FLOAT_DELTA or EXT_FLAG_FLOAT_XOR (not both),
+// each value of a float stream is stored as its difference (mod 256) from, or
+// XOR with, the value before it (0 before the first), so slowly varying values
+// turn into runs. The values are every byte of the exponent stream, or the top
+// byte (sign and high fraction bits) of each value of a 2-stream sign|fraction
+// stream. Other streams may not be transformed
+typedef enum {
+  FLOAT_TRANSFORM_NONE,
+  FLOAT_TRANSFORM_DELTA,
+  FLOAT_TRANSFORM_XOR,
+} float_transform_t;
+
+// Doubles: with EXT_FLAG_FLOAT64 on every stream of a float file, each value is
+// a little-endian IEEE double, split on byte boundaries. The sign and exponent
+// stream holds each value's top 2 bytes (sign, 11 exponent bits, and the top 4
+// mantissa bits, to stay byte aligned). The 2-stream layout puts the low 6
+// mantissa bytes in stream 0; the 3-stream layout splits them into the low 4
+// (stream 0) and the next 2 (stream 2), so slowly changing high mantissa bytes
+// compress apart from the noisy low ones. Stream 1 is the sign and exponent
+// stream in both, as the exponent stream is for floats
+#define FLOAT64_SIGNEXP_LEN     2 // bytes per value of the sign and exponent stream
+#define FLOAT64_MANTISSA_LEN    6 // bytes per value of the 2-stream mantissa stream
+#define FLOAT64_MANTISSA_LO_LEN 4 // bytes per value of the 3-stream low mantissa stream
+#define FLOAT64_MANTISSA_HI_LEN 2 // bytes per value of the 3-stream high mantissa stream
+
+// Per-block checksums: the stored data is cut into blocks of 2^n bytes (the
+// last may be shorter), and a table with one entry per block follows the data
+#define MIN_BLOCK_SIZE_LOG2 12
+#define MAX_BLOCK_SIZE_LOG2 30
+#define BLOCK_ENTRY_LEN     8 // crc32c of stored block (4, BE) + decoded length of block (4, LE)
+
+// Per-block dictionaries: with EXT_FLAG_BLOCK_DICTIONARIES (only valid on
+// compressed streams with per-block checksums), every stored block starts with
+// a change to the dictionary of the block before it (the header's, for the
+// first block): a big-endian mask with bit i set if entry i changes, then the
+// new value of each changed entry, in entry order. A full mask gives the block
+// a dictionary of its own, which does not depend on any earlier block
+#define BLOCK_DICTIONARY_MASK_LEN 2
+#define BLOCK_DICTIONARY_FULL     0xFFFF
+#define BLOCK_DICTIONARY_MAX_LEN  (BLOCK_DICTIONARY_MASK_LEN + DICTIONARY_LENGTH)
 
 
 // Struct to hold header configuration data
@@ -29,9 +101,14 @@ typedef struct {
   bool is_valid;
 
   // total length of the header data, not including padding
-  // values one of 20, 36, 22 or 38
+  // 20 to MAX_HEADER_SIZE bytes, depending on the flags (see header_len_needed)
   size_t header_len;
 
+  // boundaries the stream's data, and the header after it, are padded to
+  // (HEADER_ALIGN and DATA_ALIGN, or less in the compact layouts)
+  uint64_t header_align;
+  uint64_t data_align;
+
   // whether the file was compressed
     // if so, set to true ie file must be decompressed
   bool is_compressed;
@@ -41,6 +118,10 @@ typedef struct {
     // if compressed, copy 16 dic bytes here
   uint8_t dictionary_data[DICTIONARY_LENGTH];
 
+  // byte that starts every code in the compressed data
+  // (ESCAPE_BYTE unless the header has an escape byte field)
+  uint8_t escape_byte;
+
   // whether the file was encrypted
     // if so, set to true ie file must be decrypted
   bool is_encrypted;
@@ -54,6 +135,38 @@ typedef struct {
     // note it is BIG ENDIAN
   uint16_t checksum_value;
 
+  // raw extension flags from header (0 if the header has no extension flags)
+  uint16_t extension_flags;
+
+  // whether the stored data is protected by a CRC32C (Castagnoli)
+  bool is_crc32c;
+
+  // expected CRC32C of the stored data from header
+  // (only valid if is_crc32c is true)
+    // note it is BIG ENDIAN, like the checksum
+  uint32_t crc32c_value;
+
+  // whether the stored data is split into blocks that each have a CRC32C
+  // if so, compressed blocks can also be decoded independently of each other
+  bool has_block_checksums;
+
+  // size of each block of stored data, in bytes (the last block may be shorter)
+  // (only valid if has_block_checksums is true)
+  uint64_t block_size;
+
+  // whether the compressed data may use long-run codes
+  bool has_long_runs;
+
+  // how the values of a float stream were transformed before being stored
+  float_transform_t float_transform;
+
+  // whether the float streams hold doubles rather than floats
+  bool is_float64;
+
+  // whether each block of compressed data starts with its own dictionary update
+  // (the dictionary above is then the one the first block's update applies to)
+  bool has_block_dictionaries;
+
   // whether there is a subsequent header
     // true => after this stream there is another header later
     // false => this is the last stream
@@ -88,13 +201,47 @@ void* malloc_and_check(size_t size);
 // Any unnecessary fields in config are left untouched
 void parse_header(uint8_t* input_data, size_t input_len, packlab_config_t* config);
 
+// Returns how many bytes of the header starting at input_data must be at hand
+// to parse it. Once its first 20 bytes (22 with extension flags) are there,
+// that is the whole header's length; before then, it is how many bytes it
+// takes to find that out
+size_t header_len_needed(uint8_t* input_data, size_t input_len);
+
 // Decompresses input data, creating output data
 // Returns the length of valid data inside the output data (<=output_len)
-// Expects a previously calculated compression dictionary
+// Expects a previously calculated compression dictionary, and the escape
+// byte the codes start with (ESCAPE_BYTE unless the stream chose its own)
+// `long_runs` says whether long-run codes may appear (see LONG_RUN_CODE)
 // Writes uncompressed data directly into `output_data`
 size_t decompress_data(uint8_t* input_data, size_t input_len,
                        uint8_t* output_data, size_t output_len,
-                       uint8_t* dictionary_data);
+                       uint8_t* dictionary_data, uint8_t escape_byte, bool long_runs);
+
+// Decompresses one piece of a larger compressed stream
+// Like decompress_data, but stops before any code that does not fit in the
+// output, and (unless `is_final`) leaves an escape byte at the very end of the
+// input unused, since its second byte is in the next piece. A long-run code
+// cut off by the end of the input is always left unused
+// Returns the length of valid data inside the output data, and sets
+// `input_used` to the number of input bytes consumed; the rest must be passed
+// in again at the front of the next piece
+// Fewer than MAX_CODE_LEN unused bytes may be a code still waiting for the
+// rest of its input; more than that means the output is full
+size_t decompress_data_resume(uint8_t* input_data, size_t input_len,
+                              uint8_t* output_data, size_t output_len,
+                              uint8_t* dictionary_data, uint8_t escape_byte, bool long_runs,
+                              bool is_final, size_t* input_used);
+
+// Reads the long-run code at the start of `input_data` (escape byte and
+// LONG_RUN_CODE included), writing the byte to repeat and the run length
+// Returns the length of the code, or 0 if it is cut off or invalid
+size_t read_long_run(uint8_t* input_data, size_t input_len, uint8_t* value, size_t* run_len);
+
+// Applies the dictionary update at the start of a block (see
+// EXT_FLAG_BLOCK_DICTIONARIES) to `dictionary_data`
+// Returns the length of the update, or 0 (leaving the dictionary untouched)
+// if it is cut off
+size_t read_block_dictionary(uint8_t* input_data, size_t input_len, uint8_t* dictionary_data);
 
 // Returns the next LFSR state
 // Implemented with a fixed LFSR
@@ -102,14 +249,68 @@ size_t decompress_data(uint8_t* input_data, size_t input_len,
 uint16_t lfsr_step(uint16_t oldstate);
 
 // Decrypts input data, creating output data
-// Writes decrypted data directly into `output_data`
+// Writes decrypted data directly into `output_data`, which may be `input_data`
+// itself to decrypt in place
 void decrypt_data(uint8_t* input_data, size_t input_len,
                   uint8_t* output_data, size_t output_len,
                   uint16_t encryption_key);
 
+// Decrypts one piece of a larger encrypted stream, continuing from `lfsr_state`
+// (the encryption key for the first piece)
+// Every piece except the last must have an even length
+// Returns the LFSR state to pass in for the next piece
+uint16_t decrypt_data_resume(uint8_t* input_data, size_t input_len,
+                             uint8_t* output_data, size_t output_len,
+                             uint16_t lfsr_state);
+
+// Number of blocks the stored data of a stream is split into
+// (0 if the stream has no per-block checksums)
+uint64_t block_count(packlab_config_t* config);
+
+// Length of the per-block checksum table that follows the stream's data
+uint64_t block_table_len(packlab_config_t* config);
+
+// Offset of the stream's data from the start of its header
+uint64_t stream_data_offset(packlab_config_t* config);
+
+// Offset in the file of the header after this stream, whose own header is at `header_offset`
+uint64_t next_header_offset(packlab_config_t* config, uint64_t header_offset);
+
+// Reads entry `block` of a per-block checksum table
+void read_block_entry(uint8_t* table, uint64_t block, uint32_t* crc32c_value, uint32_t* decoded_len);
+
 // Calculates a 16-bit checksum value over input data
 uint16_t calculate_checksum(uint8_t* input_data, size_t input_len);
 
+// Running state for computing the 16-bit checksum in pieces
+// The checksum is a sum mod 2^16, so pieces can be summed in any order, on
+// any thread, and combined afterwards
+typedef struct {
+  uint16_t sum;
+} checksum_state_t;
+
+// Starts a checksum with no data in it
+void checksum_init(checksum_state_t* state);
+
+// Adds input data to a running checksum
+void checksum_update(checksum_state_t* state, uint8_t* input_data, size_t input_len);
+
+// Adds the data covered by `other` into `state` (e.g. a piece done by another thread)
+void checksum_combine(checksum_state_t* state, checksum_state_t* other);
+
+// Returns the checksum of all data added so far
+// Equal to calculate_checksum() over the concatenation of every piece
+uint16_t checksum_final(checksum_state_t* state);
+
+// Continues a CRC32C (Castagnoli) over more input data
+// Start with crc = 0; feeding a buffer in pieces gives the same result as
+// feeding it all at once. Uses the SSE4.2 crc32 instruction when available
+uint32_t crc32c_update(uint32_t crc, uint8_t* input_data, size_t input_len);
+
+// Mixes one 64-bit word into a running hash (splitmix64 finalizer), for
+// hash tables keyed by a few integers: start with hash = 0 and mix in each
+uint64_t mix64(uint64_t hash, uint64_t value);
+
 // join 2 streams to create a single stream of 32 bit IEEE floats
 // one stream consists of sign|fraction (24 bits each), and
 // the other stream consists of exp (8 bits each)
@@ -141,3 +342,108 @@ void join_float_array_three_stream(uint8_t* input_frac,
                                    uint8_t* output_data,
                                    size_t   output_len_bytes);
 
+// join 2 streams to create a single stream of 64 bit IEEE doubles
+// one stream consists of the low 6 mantissa bytes of each value, and
+// the other of the top 2 bytes (sign, exponent and top mantissa bits)
+// assuming there are n doubles, then
+// input_len_bytes_mantissa must be 6*n
+// input_len_bytes_signexp must be 2*n
+// output_len_bytes must be >=8*n
+void join_double_array(uint8_t* input_mantissa, size_t input_len_bytes_mantissa,
+                       uint8_t* input_signexp, size_t input_len_bytes_signexp,
+                       uint8_t* output_data, size_t output_len_bytes);
+
+// join 3 streams to create a single stream of 64 bit IEEE doubles
+// the low 4 mantissa bytes, the top 2 bytes and the 2 bytes between them
+// assuming there are n doubles, then
+// input_len_bytes_mantissa_lo must be 4*n
+// input_len_bytes_signexp must be 2*n
+// input_len_bytes_mantissa_hi must be 2*n
+// output_len_bytes must be >=8*n
+void join_double_array_three_stream(uint8_t* input_mantissa_lo, size_t input_len_bytes_mantissa_lo,
+                                    uint8_t* input_signexp, size_t input_len_bytes_signexp,
+                                    uint8_t* input_mantissa_hi, size_t input_len_bytes_mantissa_hi,
+                                    uint8_t* output_data, size_t output_len_bytes);
+
+// What the floats of a float file are written out as: as they are, or
+// narrowed to 2 bytes each (bfloat16, or IEEE half precision)
+typedef enum {
+  FLOAT_EMIT_FP32,
+  FLOAT_EMIT_BF16,
+  FLOAT_EMIT_FP16,
+} float_emit_t;
+
+// Narrows n_floats 32 bit floats to `emit`, rounding to nearest even, into
+// output_data (2 bytes each, or 4 for FLOAT_EMIT_FP32). output_data may be input_data
+void narrow_float_array(uint8_t* input_data, size_t n_floats, uint8_t* output_data, float_emit_t emit);
+
+// Number of values in a float file, from the header of its stream 1 (the
+// exponent, or sign and exponent, stream)
+uint64_t float_value_count(const packlab_config_t* config);
+
+// Bytes a float file unpacks to, from the header of its stream 1
+uint64_t float_output_len(const packlab_config_t* config);
+
+// Undoes a float transform in place, on `len` bytes of a float stream whose
+// values are `value_len` bytes long: 1 for an exponent stream, or 3 for a
+// sign|fraction stream, whose top byte is the transformed one. `len` is a
+// multiple of `value_len`, and `prev` is the original value before the first
+// one (0 at the start of a stream)
+// Returns the last original value, to pass as `prev` for the next piece
+uint8_t undo_float_transform(uint8_t* data, size_t len, size_t value_len,
+                             float_transform_t transform, uint8_t prev);
+
+// Whether stream `stream` of a float file may carry a float transform: the
+// exponent stream, or the sign|fraction stream of a 2-stream file (never doubles)
+bool float_transform_allowed(uint64_t stream, const packlab_config_t* config);
+
+// How many bytes each value of float stream `stream` takes, for
+// undo_float_transform (3 for the sign|fraction stream, 1 for the exponents)
+size_t float_value_len(uint64_t stream);
+
+
+// Kernels that have a variant per instruction set level (see cpu-dispatch.h)
+// Every variant of a kernel gives exactly the same result as the plain C one
+typedef struct {
+  // level this table was put together for
+  cpu_isa_t isa;
+
+  // sum of `len` bytes
+  uint64_t (*byte_sum)(const uint8_t* data, size_t len);
+
+  // CRC32C over more data, on the raw register (no pre/post inversion)
+  uint32_t (*crc32c)(uint32_t crc, const uint8_t* data, size_t len);
+
+  // index of the first byte equal to `value` in `len` bytes, or `len` if there is none
+  size_t (*find_byte)(const uint8_t* data, size_t len, uint8_t value);
+
+  // in-place running sum (mod 256) or XOR of `len` bytes, continuing from `prev`;
+  // returns the last byte
+  uint8_t (*prefix_sum)(uint8_t* data, size_t len, uint8_t prev);
+  uint8_t (*prefix_xor)(uint8_t* data, size_t len, uint8_t prev);
+
+  // joins n_doubles doubles from mantissa (6 bytes each) and sign and exponent (2 bytes each) streams
+  void (*join_double)(const uint8_t* mantissa, const uint8_t* signexp, uint8_t* output, size_t n_doubles);
+
+  // joins n_doubles doubles from low mantissa (4 bytes each), sign and exponent
+  // (2 bytes each) and high mantissa (2 bytes each) streams
+  void (*join_double3)(const uint8_t* mantissa_lo, const uint8_t* signexp, const uint8_t* mantissa_hi,
+                       uint8_t* output, size_t n_doubles);
+
+  // narrows n_floats floats to bfloat16 or half precision; output may be the input
+  void (*narrow_bf16)(const uint8_t* floats, uint8_t* output, size_t n_floats);
+  void (*narrow_fp16)(const uint8_t* floats, uint8_t* output, size_t n_floats);
+
+  // joins n_floats floats from sign|fraction (3 bytes each) and exponent (1 byte each) streams
+  void (*join_float)(const uint8_t* signfrac, const uint8_t* exp, uint8_t* output, size_t n_floats);
+
+  // joins n_floats floats from packed fraction (23 bits each), exponent (1 byte each)
+  // and packed sign (1 bit each) streams
+  void (*join_float3)(const uint8_t* frac, const uint8_t* exp, const uint8_t* sign,
+                      uint8_t* output, size_t n_floats);
+} kernel_table_t;
+
+// Returns the kernels for level `isa`: the fastest variant of each that needs no more
+// `isa` must not be above cpu_isa_detect(), or the kernels may fault
+// The library itself uses kernels_for_isa(cpu_isa_active())
+const kernel_table_t* kernels_for_isa(cpu_isa_t isa);
@@ -1,14 +1,111 @@
 // Application to unpack files
 // PackLab - CS213 - Northwestern University
 
+#define _GNU_SOURCE // O_DIRECT
+
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "async-io.h"
+#include "block-cache.h"
+#include "buffer-pool.h"
+#include "cpu-dispatch.h"
+#include "header-catalog.h"
+#include "keystream-cache.h"
+#include "packlab-stream.h"
+#include "small-file.h"
+#include "spsc-ring.h"
+#include "stream-cursor.h"
+#include "stream-decoder.h"
 #include "unpack-utilities.h"
+#include "unpackd.h"
+
+// Input is read in pieces of this size, so checksumming can start on the
+// first piece while the rest is still coming in from disk
+#define READ_CHUNK_LEN (1024 * 1024)
+
+// Upper bound on threads used to check per-block checksums
+#define MAX_VERIFY_THREADS 16
+
+// Exit code when --salvage had to zero-fill corrupt blocks
+#define EXIT_SALVAGED 2
+
+// Inputs at least this large are unpacked in low-memory mode even without --low-memory
+#define LOW_MEMORY_AUTO_LEN ((uint64_t)512 * 1024 * 1024)
+
+// Input reads, and output writes of WRITE_CHUNK_LEN, kept in flight at once
+// (through io_uring where available; every chunk is a multiple of DATA_ALIGN)
+#define READ_QUEUE_DEPTH  16
+#define WRITE_QUEUE_DEPTH 16
+#define WRITE_CHUNK_LEN   (1024 * 1024)
+
+// Bytes read from a pipe, and written out, per call when unpacking from stdin
+#define PIPE_CHUNK_LEN (64 * 1024)
+
+// Buffers, and their size, in each direction of the --pipeline stages
+#define PIPELINE_BUFFERS    8
+#define PIPELINE_BUFFER_LEN (1024 * 1024)
+
+// Put-back buffers kept for reuse by later streams
+#define BUFFER_POOL_CACHE_LEN ((size_t)1 << 30)
+
+// Worker processes started by --daemon unless --workers says otherwise
+#define DEFAULT_DAEMON_WORKERS 4
+
+// Decoded blocks each daemon worker keeps for --range requests
+#define DAEMON_BLOCK_CACHE_LEN (32 * 1024 * 1024)
+
+// Directory descriptors nftw() may hold open while --list walks a tree
+#define LIST_WALK_FDS 32
+
+// Floats joined per batch in low-memory mode
+// (a multiple of 8, so 3-stream sign and fraction bits of a batch start on a byte)
+#define JOIN_BATCH_FLOATS (64 * 1024)
+
+// Floats joined per step when narrowing them for --emit, so they never leave L1
+#define NARROW_CHUNK_FLOATS (4 * 1024)
+
+// Cleared by --no-io-uring, to always use plain pread/pwrite
+static bool allow_io_uring = true;
+
+// Set by --direct-io (input) and --direct-io=all (input and output), to
+// bypass the page cache
+static bool direct_input  = false;
+static bool direct_output = false;
+
+// Set by --sparse, to leave holes in the output where whole pages are zero
+static bool sparse_output = false;
+
+// Set by --emit, to write the floats of float files narrowed to 2 bytes each
+static float_emit_t float_emit = FLOAT_EMIT_FP32;
+
+// Every large per-stream buffer comes from (and goes back to) here, so that
+// memory already faulted in for one stream is reused by the next
+// Its buffers are page-aligned, as O_DIRECT needs
+static buffer_pool_t* buffer_pool = NULL;
+
+// Keystreams of recent passwords, kept by daemon workers between requests
+// (NULL otherwise: a single unpack gains nothing from caching its keystream)
+static keystream_cache_t* keystream_cache = NULL;
+
+// Decoded blocks of recently read files, kept by daemon workers between
+// requests, so repeated --range reads of a blocked file decode nothing twice
+// (NULL otherwise, like keystream_cache)
+static block_cache_t* block_cache = NULL;
+
+// Password of the file being unpacked, asked for at most once per unpack
+static char password[80] = "";
 
 // Helper function: rounds offset up to provided alignment
 static uint64_t roundup_to_alignment(uint64_t offset, uint64_t alignment) {
@@ -22,11 +119,106 @@ static uint64_t roundup_to_alignment(uint64_t offset, uint64_t alignment) {
   return alignment * (number_of_chunks + 1);
 }
 
+// Helper function: whether `len` bytes are all zero
+static bool is_all_zero(uint8_t* data, size_t len) {
+  // byte 0 is zero, and every byte equals the one before it
+  return len == 0 || (data[0] == 0 && memcmp(data, &data[1], len - 1) == 0);
+}
+
+// Helper function: finds the next run of DATA_ALIGN pages in data[from, len)
+// that are not entirely zero (the last page may be partial)
+// Returns where it starts (len if there is none), writing its length to `run_len`
+static size_t next_data_run(uint8_t* data, size_t from, size_t len, size_t* run_len) {
+  size_t start = from;
+  while (start < len) {
+    size_t page_len = (len - start < DATA_ALIGN) ? len - start : DATA_ALIGN;
+    if (!is_all_zero(&data[start], page_len)) {
+      break;
+    }
+    start += page_len;
+  }
+
+  size_t end = start;
+  while (end < len) {
+    size_t page_len = (len - end < DATA_ALIGN) ? len - end : DATA_ALIGN;
+    if (is_all_zero(&data[end], page_len)) {
+      break;
+    }
+    end += page_len;
+  }
+
+  *run_len = end - start;
+  return start;
+}
+
+// Helper function: fwrite() that, with --sparse, seeks over zero pages rather
+// than writing them (finish_output() then fixes up the file's length)
+static bool output_fwrite(uint8_t* data, size_t len, FILE* output_fd) {
+  if (!sparse_output) {
+    return fwrite(data, sizeof(uint8_t), len, output_fd) == len;
+  }
+
+  size_t offset = 0;
+  while (offset < len) {
+    size_t run_len = 0;
+    size_t start = next_data_run(data, offset, len, &run_len);
+    if (start > offset && fseeko(output_fd, (off_t)(start - offset), SEEK_CUR) != 0) {
+      return false;
+    }
+    if (fwrite(&data[start], sizeof(uint8_t), run_len, output_fd) != run_len) {
+      return false;
+    }
+    offset = start + run_len;
+  }
+  return true;
+}
+
+// Helper function: closes an output file written with output_fwrite()
+// A sparse file that ends in a hole only gets its full length here
+static bool finish_output(FILE* output_fd) {
+  bool ok = true;
+  if (sparse_output) {
+    ok = fflush(output_fd) == 0 && ftruncate(fileno(output_fd), ftello(output_fd)) == 0;
+  }
+  return (fclose(output_fd) == 0) && ok;
+}
+
+// Helper function: opens a file for O_DIRECT I/O
+// Returns -1, after a warning, if the file system won't allow it
+static int open_direct(char* filename, int flags) {
+  int fd = open(filename, flags | O_DIRECT);
+  if (fd < 0) {
+    fprintf(stderr, "WARNING: %s does not allow direct I/O, using the page cache\n", filename);
+  }
+  return fd;
+}
+
+// Helper function: gets the file password (only asking the first time) and
+// turns it into the encryption key
+static uint16_t get_encryption_key(void) {
+  if (strlen(password) == 0) {
+    if (getenv("PACKLAB_PASSWORD")) {
+      strncpy(password, getenv("PACKLAB_PASSWORD"), sizeof(password) - 1);
+    } else {
+      printf("Type the file password and hit enter: ");
+      int match_count = scanf("%79s", password);
+      if (match_count != 1) {
+        error_and_exit("ERROR: invalid password entered\n");
+      }
+    }
+  }
+
+  // Use a checksum as a lazy method for "hashing" the password
+  // This isn't ideal as it will have many collisions (password "ab" equals password "ba")
+  return calculate_checksum((uint8_t*)password, strlen(password));
+}
+
 // Helper function: determines number of streams and offsets for a packed file
 static int analyze_streams(uint8_t* buf, uint64_t len, uint64_t* nums, uint64_t* offsets, uint64_t* orig_sizes,
                            uint64_t* stored_sizes) {
   uint64_t curoff = 0;
   packlab_config_t config;
+  bool is_float64 = false;
 
   uint64_t maxnums = *nums;
   for (uint64_t i = 0; i < maxnums; i++) {
@@ -41,6 +233,14 @@ static int analyze_streams(uint8_t* buf, uint64_t len, uint64_t* nums, uint64_t*
     stored_sizes[i] = config.data_size;
     offsets[i]      = curoff;
 
+    // every stream of a float file holds the same kind of value
+    if (i == 0) {
+      is_float64 = config.is_float64;
+    } else if (config.is_float64 != is_float64) {
+      fprintf(stderr, "float streams disagree on value size\n");
+      return -1;
+    }
+
     if (!config.should_continue) {
       *nums = i + 1;
 
@@ -77,10 +277,9 @@ static int analyze_streams(uint8_t* buf, uint64_t len, uint64_t* nums, uint64_t*
 
     uint64_t oldoff = curoff;
 
-    // skip to data
-    curoff = roundup_to_alignment(curoff + config.header_len, DATA_ALIGN);
-    // skip to next header
-    curoff = roundup_to_alignment(curoff + config.data_size, HEADER_ALIGN);
+    // skip past the data to the next header
+    // (past the per-block checksum table, if there is one)
+    curoff = next_header_offset(&config, curoff);
     // advance buffer to match, which should land us in the next header
     buf += (curoff - oldoff);
 
@@ -95,247 +294,1908 @@ static int analyze_streams(uint8_t* buf, uint64_t len, uint64_t* nums, uint64_t*
   return -1;
 }
 
-int main(int argc, char* argv[]) {
-  // Parse app flags
-  // No flags for unpack, just input and output filenames
-  if (argc != 3) {
-    printf("usage: %s inputfilename outputfilename\n", argv[0]);
-    error_and_exit("\n");
+// Helper function: joins the decoded streams of a 2 or 3 stream float file,
+// of `stream_lens` bytes each, into `output_len` bytes of floats (or doubles)
+// With --emit, the floats are joined a chunk at a time into a small buffer and
+// narrowed from there, so the full-size floats are never written out
+static void join_streams(uint64_t num_streams, bool is_float64, uint8_t** streams, uint64_t* stream_lens,
+                         uint8_t* output_data, uint64_t output_len) {
+  if (float_emit != FLOAT_EMIT_FP32) {
+    uint8_t joined[4 * NARROW_CHUNK_FLOATS];
+    uint64_t n_floats = stream_lens[1];
+    if (output_len < 2 * n_floats) {
+      return;
+    }
+    // chunks are a multiple of 8 floats, so 3-stream fraction and sign bits
+    // of every chunk start on a byte boundary
+    for (uint64_t first = 0; first < n_floats; first += NARROW_CHUNK_FLOATS) {
+      size_t count = (n_floats - first < NARROW_CHUNK_FLOATS) ? (size_t)(n_floats - first) : NARROW_CHUNK_FLOATS;
+      if (num_streams == 2) {
+        join_float_array(&streams[0][3 * first], 3 * count, &streams[1][first], count, joined, sizeof(joined));
+      } else {
+        join_float_array_three_stream(&streams[0][23 * first / 8], (23 * count + 7) / 8, &streams[1][first], count,
+                                      &streams[2][first / 8], (count + 7) / 8, joined, sizeof(joined));
+      }
+      narrow_float_array(joined, count, &output_data[2 * first], float_emit);
+    }
+    return;
   }
-  char* input_filename  = argv[1];
-  char* output_filename = argv[2];
 
-  // Validate input data
-  if (strcmp(input_filename, output_filename) == 0) {
-    // This check is for safety to make sure we don't overwrite a file
-    error_and_exit("ERROR: input and output filename match\n");
+  if (is_float64 && num_streams == 2) {
+    join_double_array(streams[0], stream_lens[0], streams[1], stream_lens[1], output_data, output_len);
+  } else if (is_float64) {
+    join_double_array_three_stream(streams[0], stream_lens[0], streams[1], stream_lens[1],
+                                   streams[2], stream_lens[2], output_data, output_len);
+  } else if (num_streams == 2) {
+    join_float_array(streams[0], stream_lens[0], streams[1], stream_lens[1], output_data, output_len);
+  } else {
+    join_float_array_three_stream(streams[0], stream_lens[0], streams[1], stream_lens[1],
+                                  streams[2], stream_lens[2], output_data, output_len);
   }
+}
 
-  // Open input file
-  FILE* input_fd = fopen(input_filename, "r");
-  if (input_fd == NULL) {
-    error_and_exit("ERROR: input file likely does not exist\n");
+// Helper function: --emit only applies to files of 32-bit floats
+static void check_float_emit(uint64_t num_streams, bool is_float64) {
+  if (float_emit != FLOAT_EMIT_FP32 && (num_streams == 1 || is_float64)) {
+    error_and_exit("ERROR: only 32-bit float files can be narrowed\n");
   }
+}
 
-  // Determine size of input file
-  struct stat st;
-  int result = stat(input_filename, &st);
-  if (result != 0) {
-    error_and_exit("ERROR: input file likely does not exist\n");
+// Helper function: exits if the checksums computed over a stream's stored
+// data do not match the ones in its header
+static void check_stream_checksums(packlab_config_t* config, uint16_t calc_checksum, uint32_t calc_crc32c) {
+  if (config->is_checksummed && calc_checksum != config->checksum_value) {
+    error_and_exit("ERROR: checksum is invalid\n");
   }
-  size_t raw_len = st.st_size;
-
-  // Read entire input file contents
-  uint8_t* raw_data = malloc_and_check(raw_len);
-  size_t read_len   = fread(raw_data, sizeof(uint8_t), raw_len, input_fd);
-  if (read_len != raw_len) {
-    error_and_exit("ERROR: fread failed on input\n");
+  if (config->is_crc32c && calc_crc32c != config->crc32c_value) {
+    error_and_exit("ERROR: crc32c is invalid\n");
   }
-  fclose(input_fd);
+}
 
-  // Attempt to parse the initial header to see if it's valid
-  // If so, we'll analyze the file and determine the total number of streams
-  // If it's not valid, there's no point in doing more work, just error immediately
-  packlab_config_t initial_config = {0};
-  parse_header(raw_data, raw_len, &initial_config);
-  if (!initial_config.is_valid) {
+// Helper function: checks that a stream's parsed header is sane for its
+// position in the file, and that its data fits in the `input_len` bytes
+// from the start of its header to the next one (or the end of the file)
+static void check_stream_config(uint64_t stream, packlab_config_t* config, uint64_t input_len) {
+  // Check if header is valid
+  if (!config->is_valid) {
     error_and_exit("ERROR: header is invalid\n");
   }
-  if (initial_config.header_len > MAX_HEADER_SIZE || initial_config.header_len == 0) {
+
+  // Check that header length makes sense too
+  if (config->header_len > MAX_HEADER_SIZE || config->header_len == 0) {
     error_and_exit("ERROR: header length is invalid\n");
   }
 
-  // Now find the streamsa to prepare for student
-  // processing. The only supported formats here are:
-  //    normal - single stream
-  //    f2     - 2 streams, floats, with 8 bit exponent stream and 24 bit sign+mantissa
-  //    f3     - 3 streams, floats, with 8 bit exponent stream, 23 bit mantissa stream, 1 bit sign stream
-
-  uint64_t num_streams = MAX_STREAMS;
-  uint64_t offsets[MAX_STREAMS+1];     // byte offset to header of stream k, plus final offset and end of data
-  uint64_t orig_sizes[MAX_STREAMS];    // size of the original data in streak k
-  uint64_t stored_sizes[MAX_STREAMS];  // size of the stored data in streak k
+  // Check independently if this is sane if it's a continuation
+  if (config->should_continue && !config->should_float) {
+    error_and_exit("ERROR: have non-float continuation\n");
+  }
 
-  if (analyze_streams(raw_data, raw_len, &num_streams, offsets, orig_sizes, stored_sizes)) {
-    error_and_exit("ERROR: cannot analyze streams\n");
+  if (stream == 1 && !config->should_float) {
+    error_and_exit("ERROR: have 2nd stream without float\n");
   }
 
-  // Final offset is at the end of the input data
-  offsets[num_streams] = raw_len;
+  if (stream == 2 && !config->should_float3) {
+    error_and_exit("ERROR: have 3rd stream without float3\n");
+  }
 
-  // now we will generate space for storing the output data, and space for the
-  // final result this setup is generalized, though the later code will only
-  // handle the 1 stream raw, and 2 or 3 stream float formats
+  if (config->float_transform != FLOAT_TRANSFORM_NONE && !float_transform_allowed(stream, config)) {
+    error_and_exit("ERROR: have a float transform on a stream that can't take one\n");
+  }
 
-  uint8_t* output_data[num_streams];
-  for (uint64_t stream = 0; stream < num_streams; stream++) {
-    output_data[stream] = malloc_and_check(orig_sizes[stream]);
-    memset(output_data[stream], 0, orig_sizes[stream]);
+  // Make sure the stream's data is actually inside the file
+  if (config->header_len > input_len) {
+    error_and_exit("ERROR: input stream is shorter than expected\n");
   }
+  uint64_t data_offset = stream_data_offset(config);
+  if (config->data_size > 0 &&
+      (data_offset > input_len || config->data_size > input_len - data_offset)) {
+    error_and_exit("ERROR: input stream is shorter than expected\n");
+  }
+}
 
-  // FP assumptions here
-  uint64_t final_output_size = 0;
-  if (num_streams == 1) {
-    final_output_size = orig_sizes[0];
-  } else if (num_streams == 2 || num_streams == 3) {
-    final_output_size = 4 * orig_sizes[1];  // "exponent stream" size
-  } else {
-    error_and_exit("ERROR: have too many streams\n");
+// Shared between the thread reading the input file and the thread checksumming it
+typedef struct {
+  FILE* input_fd;
+  int direct_fd; // the same file opened with O_DIRECT, or -1
+  uint8_t* raw_data;
+  size_t raw_len;
+
+  pthread_mutex_t lock;
+  pthread_cond_t progress;
+  size_t bytes_read; // protected by lock
+  bool failed;       // protected by lock
+} input_reader_t;
+
+// Checksums of each stream's stored data, computed while the file is being read
+typedef struct {
+  uint64_t num_streams; // streams whose headers have been parsed so far
+  uint64_t next_header; // offset of the next header to parse
+  bool done;            // no more headers to parse
+  uint64_t data_start[MAX_STREAMS];
+  uint64_t data_end[MAX_STREAMS];
+  bool is_checksummed[MAX_STREAMS];
+  bool is_crc32c[MAX_STREAMS];
+  checksum_state_t checksum[MAX_STREAMS];
+  uint32_t crc32c[MAX_STREAMS];
+} read_verifier_t;
+
+// Reads the input with a queue of chunk reads in flight, reporting progress
+// as the run of finished chunks from the start of the file grows
+static void* read_input_chunks(void* arg) {
+  input_reader_t* reader = arg;
+  // O_DIRECT reads must be whole pages; raw_data has room for the last one
+  bool is_direct = (reader->direct_fd >= 0);
+  int fd = is_direct ? reader->direct_fd : fileno(reader->input_fd);
+  size_t num_chunks = (reader->raw_len + READ_CHUNK_LEN - 1) / READ_CHUNK_LEN;
+  bool* chunk_done = malloc_and_check(num_chunks + 1);
+  memset(chunk_done, 0, num_chunks + 1);
+
+  async_io_t io;
+  async_io_init(&io, READ_QUEUE_DEPTH, allow_io_uring);
+  async_io_register_buffer(&io, reader->raw_data,
+                           is_direct ? roundup_to_alignment(reader->raw_len, DATA_ALIGN) : reader->raw_len);
+
+  size_t next_chunk = 0;
+  size_t chunks_read = 0; // every chunk before this one is done
+  bool failed = false;
+  while (chunks_read < num_chunks && !failed) {
+    while (next_chunk < num_chunks && async_io_can_submit(&io)) {
+      size_t offset = next_chunk * READ_CHUNK_LEN;
+      size_t chunk_len = (reader->raw_len - offset < READ_CHUNK_LEN) ? reader->raw_len - offset : READ_CHUNK_LEN;
+      size_t read_len = is_direct ? roundup_to_alignment(chunk_len, DATA_ALIGN) : chunk_len;
+      async_io_submit_read(&io, fd, &reader->raw_data[offset], read_len, offset, (void*)(uintptr_t)next_chunk);
+      next_chunk++;
+    }
+
+    int64_t result = 0;
+    size_t chunk = (uintptr_t)async_io_wait(&io, &result);
+    size_t chunk_len = (reader->raw_len - chunk * READ_CHUNK_LEN < READ_CHUNK_LEN) ?
+                       reader->raw_len - chunk * READ_CHUNK_LEN : READ_CHUNK_LEN;
+    failed = (result != (int64_t)chunk_len);
+    chunk_done[chunk] = !failed;
+
+    size_t before = chunks_read;
+    while (chunks_read < num_chunks && chunk_done[chunks_read]) {
+      chunks_read++;
+    }
+    if (chunks_read != before || failed) {
+      pthread_mutex_lock(&reader->lock);
+      reader->bytes_read = (chunks_read == num_chunks) ? reader->raw_len : chunks_read * READ_CHUNK_LEN;
+      reader->failed     = failed;
+      pthread_cond_signal(&reader->progress);
+      pthread_mutex_unlock(&reader->lock);
+    }
   }
 
-  uint8_t* final_output_data = malloc_and_check(final_output_size);
-  memset(final_output_data, 0, final_output_size);
+  // collect whatever is still in flight before the buffer can go away
+  while (io.in_flight > 0) {
+    int64_t result = 0;
+    async_io_wait(&io, &result);
+  }
+  async_io_free(&io);
+  free(chunk_done);
+  return NULL;
+}
 
-  // now reconstruct each stream
-  for (uint64_t stream = 0; stream < num_streams; stream++) {
-    // Create a zero'd out configuration
-    packlab_config_t config = {0};
+// Helper function: writes `len` bytes of `data` to the start of `fd`, keeping
+// a queue of chunk writes in flight
+// With a `direct_fd` (and page-aligned `data`), whole pages go through that
+// and only the partial page at the end through `fd`
+// With --sparse, zero pages are skipped and left as holes
+// Returns false if any of them failed
+static bool write_output(int fd, int direct_fd, uint8_t* data, size_t len) {
+  size_t direct_len = (direct_fd >= 0) ? len & ~(size_t)(DATA_ALIGN - 1) : 0;
+  async_io_t io;
+  async_io_init(&io, WRITE_QUEUE_DEPTH, allow_io_uring);
+  async_io_register_buffer(&io, data, len);
 
-    uint8_t* input_data = &raw_data[offsets[stream]];
-    uint64_t input_len  = offsets[stream + 1] - offsets[stream];
+  bool ok = true;
+  size_t offset  = 0;
+  size_t run_end = 0; // the run of data being written ends here
+  while (true) {
+    if (ok && offset == run_end && offset < len) {
+      size_t run_len = len - offset;
+      if (sparse_output) {
+        offset = next_data_run(data, offset, len, &run_len);
+      }
+      run_end = offset + run_len;
+    }
+    if (ok && offset < run_end && async_io_can_submit(&io)) {
+      size_t chunk_len = (run_end - offset < WRITE_CHUNK_LEN) ? run_end - offset : WRITE_CHUNK_LEN;
+      bool is_direct = (offset < direct_len);
+      if (is_direct && chunk_len > direct_len - offset) {
+        chunk_len = direct_len - offset;
+      }
+      async_io_submit_write(&io, is_direct ? direct_fd : fd, &data[offset], chunk_len, offset,
+                            (void*)(uintptr_t)chunk_len);
+      offset += chunk_len;
+      continue;
+    }
+    if (io.in_flight == 0) {
+      break;
+    }
+    int64_t result = 0;
+    size_t chunk_len = (uintptr_t)async_io_wait(&io, &result);
+    ok = ok && (result == (int64_t)chunk_len);
+  }
+  async_io_free(&io);
 
-    // Parse the header to determine the packed file's configuration
-    parse_header(input_data, input_len, &config);
+  if (ok && sparse_output) {
+    ok = (ftruncate(fd, len) == 0);
+  }
+  return ok;
+}
 
-    // Check if header is valid
+// Helper function: checksums the newly read bytes [verified, available) of
+// every stream they belong to, first parsing any headers that have arrived
+static void verify_new_input(read_verifier_t* verifier, uint8_t* raw_data, size_t raw_len,
+                             size_t verified, size_t available) {
+  while (!verifier->done && verifier->next_header < available) {
+    uint64_t header = verifier->next_header;
+    packlab_config_t config = {0};
+    parse_header(&raw_data[header], available - header, &config);
     if (!config.is_valid) {
-      error_and_exit("ERROR: header is invalid\n");
+      // either the rest of the header is still on its way, or it's broken,
+      // in which case the full analysis after reading will say so
+      if (available == raw_len || available - header >= MAX_HEADER_SIZE) {
+        verifier->done = true;
+      }
+      break;
     }
 
-    // Check that header length makes sense too
-    if (initial_config.header_len > MAX_HEADER_SIZE || initial_config.header_len == 0) {
-      error_and_exit("ERROR: header length is invalid\n");
+    uint64_t stream = verifier->num_streams++;
+    verifier->data_start[stream] = header + stream_data_offset(&config);
+    verifier->data_end[stream]   = verifier->data_start[stream] + config.data_size;
+    verifier->is_checksummed[stream] = config.is_checksummed;
+    verifier->is_crc32c[stream]      = config.is_crc32c;
+    checksum_init(&verifier->checksum[stream]);
+    verifier->crc32c[stream] = 0;
+
+    if (!config.should_continue || verifier->num_streams == MAX_STREAMS) {
+      verifier->done = true;
+    } else {
+      verifier->next_header = next_header_offset(&config, header);
     }
+  }
 
-    // Check independently if this is sane if it's a continuation
-    if (config.should_continue && !config.should_float) {
-      error_and_exit("ERROR: have non-float continuation\n");
+  for (uint64_t stream = 0; stream < verifier->num_streams; stream++) {
+    uint64_t lo = verifier->data_start[stream] > verified ? verifier->data_start[stream] : verified;
+    uint64_t hi = verifier->data_end[stream] < available ? verifier->data_end[stream] : available;
+    if (lo >= hi) {
+      continue;
     }
 
-    if (stream == 1 && !config.should_float) {
-      error_and_exit("ERROR: have 2nd stream without float\n");
+    // sum this piece on its own, then fold it into the stream's running checksum
+    if (verifier->is_checksummed[stream]) {
+      checksum_state_t piece;
+      checksum_init(&piece);
+      checksum_update(&piece, &raw_data[lo], hi - lo);
+      checksum_combine(&verifier->checksum[stream], &piece);
+    }
+    if (verifier->is_crc32c[stream]) {
+      verifier->crc32c[stream] = crc32c_update(verifier->crc32c[stream], &raw_data[lo], hi - lo);
     }
+  }
+}
+
+// Helper function: reads the whole input file on a separate thread while this
+// thread checksums each piece as soon as it lands, so verification overlaps with I/O
+static void read_and_verify_input(FILE* input_fd, int direct_fd, uint8_t* raw_data, size_t raw_len,
+                                  read_verifier_t* verifier) {
+  memset(verifier, 0, sizeof(*verifier));
+
+  input_reader_t reader = {0};
+  reader.input_fd  = input_fd;
+  reader.direct_fd = direct_fd;
+  reader.raw_data = raw_data;
+  reader.raw_len  = raw_len;
+  pthread_mutex_init(&reader.lock, NULL);
+  pthread_cond_init(&reader.progress, NULL);
+
+  pthread_t thread;
+  bool threaded = (pthread_create(&thread, NULL, read_input_chunks, &reader) == 0);
+  if (!threaded) {
+    read_input_chunks(&reader);
+  }
 
-    if (stream == 2 && !config.should_float3) {
-      error_and_exit("ERROR: have 3rd stream without float3\n");
+  size_t verified = 0;
+  while (true) {
+    pthread_mutex_lock(&reader.lock);
+    while (reader.bytes_read == verified && !reader.failed && verified < raw_len) {
+      pthread_cond_wait(&reader.progress, &reader.lock);
     }
+    size_t available = reader.bytes_read;
+    bool failed      = reader.failed;
+    pthread_mutex_unlock(&reader.lock);
 
-    // Create a buffer containing the file data only
-    if (config.header_len > input_len) {
-      error_and_exit("ERROR: input stream is shorter than expected\n");
+    if (available > verified) {
+      verify_new_input(verifier, raw_data, raw_len, verified, available);
+      verified = available;
     }
+    if (failed || verified == raw_len) {
+      break;
+    }
+  }
+
+  if (threaded) {
+    pthread_join(thread, NULL);
+  }
+  pthread_cond_destroy(&reader.progress);
+  pthread_mutex_destroy(&reader.lock);
 
-    // Create a buffer of the data for this stream, copied from the raw input data
-    // This is poor performance, but makes the below code simpler
-    size_t data_len = stored_sizes[stream];
-    uint8_t* data   = malloc_and_check(data_len);
-    memcpy(data, &(input_data[roundup_to_alignment(config.header_len, DATA_ALIGN)]), data_len);
+  if (verified != raw_len) {
+    error_and_exit("ERROR: fread failed on input\n");
+  }
+}
 
-    // Handle checksumming
-    if (config.is_checksummed) {
+// One thread's share of per-block checksum verification
+typedef struct {
+  packlab_config_t* config;
+  uint8_t* stored_data;
+  uint8_t* table;
+  bool* corrupt;
+  uint64_t first_block;
+  uint64_t end_block;
+} block_verify_job_t;
 
-      // Calculate checksum of data
-      uint16_t calc_checksum = calculate_checksum(data, data_len);
+static void* verify_block_range(void* arg) {
+  block_verify_job_t* job = arg;
+  uint64_t block_size = job->config->block_size;
+  uint64_t data_size  = job->config->data_size;
 
-      // Validate checksum
-      if (calc_checksum != config.checksum_value) {
-        error_and_exit("ERROR: checksum is invalid\n");
-      }
+  for (uint64_t block = job->first_block; block < job->end_block; block++) {
+    uint64_t start = block * block_size;
+    uint64_t len   = (data_size - start < block_size) ? data_size - start : block_size;
+
+    uint32_t expected_crc32c = 0;
+    uint32_t decoded_len     = 0;
+    read_block_entry(job->table, block, &expected_crc32c, &decoded_len);
+    job->corrupt[block] = crc32c_update(0, &job->stored_data[start], len) != expected_crc32c;
+  }
+  return NULL;
+}
+
+// Helper function: checks every block of a stream against its own CRC32C,
+// spreading the blocks across threads. Marks corrupt blocks and returns how many there are
+static uint64_t verify_blocks(packlab_config_t* config, uint8_t* stored_data, uint8_t* table, bool* corrupt) {
+  uint64_t num_blocks = block_count(config);
+
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  uint64_t num_threads = (online > 0) ? (uint64_t)online : 1;
+  if (num_threads > MAX_VERIFY_THREADS) {
+    num_threads = MAX_VERIFY_THREADS;
+  }
+  if (num_threads > num_blocks) {
+    num_threads = num_blocks;
+  }
+
+  block_verify_job_t jobs[MAX_VERIFY_THREADS];
+  pthread_t threads[MAX_VERIFY_THREADS];
+  bool started[MAX_VERIFY_THREADS] = {false};
+  uint64_t per_thread = (num_threads > 0) ? (num_blocks + num_threads - 1) / num_threads : 0;
+
+  for (uint64_t t = 0; t < num_threads; t++) {
+    jobs[t].config      = config;
+    jobs[t].stored_data = stored_data;
+    jobs[t].table       = table;
+    jobs[t].corrupt     = corrupt;
+    jobs[t].first_block = t * per_thread;
+    jobs[t].end_block   = (t + 1) * per_thread < num_blocks ? (t + 1) * per_thread : num_blocks;
+
+    // the last share runs on this thread; any thread that can't start does too
+    if (t + 1 < num_threads && pthread_create(&threads[t], NULL, verify_block_range, &jobs[t]) == 0) {
+      started[t] = true;
+    } else {
+      verify_block_range(&jobs[t]);
+    }
+  }
+  for (uint64_t t = 0; t < num_threads; t++) {
+    if (started[t]) {
+      pthread_join(threads[t], NULL);
     }
+  }
 
-    // Handle decryption
-    if (config.is_encrypted) {
-      // Get a password from the user, only the first time
-      static char password[80] = "";
-      if (strlen(password) == 0) {
-        if (getenv("PACKLAB_PASSWORD")) {
-          strcpy(password, getenv("PACKLAB_PASSWORD"));
-        } else {
-          printf("Type the file password and hit enter: ");
-          int match_count = scanf("%79s", password);
-          if (match_count != 1) {
-            error_and_exit("ERROR: invalid password entered\n");
-          }
-        }
-      }
+  uint64_t num_corrupt = 0;
+  for (uint64_t block = 0; block < num_blocks; block++) {
+    num_corrupt += corrupt[block] ? 1 : 0;
+  }
+  return num_corrupt;
+}
 
-      // Use a checksum as a lazy method for "hashing" the password
-      // This isn't ideal as it will have many collisions (password "ab" equals password "ba")
-      uint16_t encryption_key = calculate_checksum((uint8_t*)password, strlen(password));
+// Helper function: rebuilds a stream that has per-block checksums, decoding
+// each block on its own and zero-filling any corrupt ones
+// (compressed blocks must be decoded on their own, since an escape byte that
+// ends a block is a literal rather than the start of a pair)
+// With per-block dictionaries the dictionary switches at each block boundary;
+// a corrupt block loses the dictionary for every block after it, up to the
+// next one with a whole dictionary of its own, so those are zero-filled too
+// Returns the length of the rebuilt data
+static size_t decode_blocks(packlab_config_t* config, uint8_t* data, uint8_t* table, bool* corrupt,
+                             uint8_t* output_data, size_t output_len) {
+  uint64_t num_blocks = block_count(config);
+  size_t out_pos = 0;
 
-      // Decrypt the data
-      size_t output_len    = data_len;
-      uint8_t* output_temp = malloc_and_check(output_len);
-      decrypt_data(data, data_len, output_temp, output_len, encryption_key);
+  uint8_t dictionary[DICTIONARY_LENGTH];
+  memcpy(dictionary, config->dictionary_data, DICTIONARY_LENGTH);
+  bool dictionary_lost = false;
 
-      // Replace data with new output
-      free(data);
-      data     = output_temp;
-      data_len = output_len;
+  for (uint64_t block = 0; block < num_blocks; block++) {
+    uint64_t start = block * config->block_size;
+    uint64_t len   = config->data_size - start;
+    if (len > config->block_size) {
+      len = config->block_size;
     }
 
-    // Handle decompression
-    if (config.is_compressed) {
-      // Decompress the data
-      // worst-case output could be MAX_RUN_LENGTH bytes for every two bytes
-      size_t output_len    = (MAX_RUN_LENGTH * input_len) / 2;
-      uint8_t* output_temp = malloc_and_check(output_len);
-      output_len = decompress_data(data, data_len, output_temp, output_len, config.dictionary_data);
+    uint32_t expected_crc32c = 0;
+    uint32_t decoded_len     = 0;
+    read_block_entry(table, block, &expected_crc32c, &decoded_len);
+    if (decoded_len > output_len - out_pos) {
+      error_and_exit("ERROR: block table does not match stream length, cannot decode blocks\n");
+    }
 
-      // Replace data with new output
-      free(data);
-      data     = output_temp;
-      data_len = output_len;
+    size_t dictionary_len = 0;
+    if (config->has_block_dictionaries && corrupt[block]) {
+      dictionary_lost = true;
+    } else if (config->has_block_dictionaries) {
+      dictionary_len = read_block_dictionary(&data[start], len, dictionary);
+      if (dictionary_len == 0) {
+        error_and_exit("ERROR: block dictionary is cut off\n");
+      }
+      if (dictionary_len == BLOCK_DICTIONARY_MAX_LEN) {
+        dictionary_lost = false;
+      }
+      if (dictionary_lost) {
+        fprintf(stderr, "WARNING: block %lu depends on the dictionary of a corrupt block, zero-filling it\n",
+                block);
+      }
     }
 
-    // check for size mis-matches and copy data
-    if (data_len != orig_sizes[stream]) {
-      error_and_exit("ERROR: reconstructed stream is wrong length\n");
+    size_t written = decoded_len;
+    if (corrupt[block] || dictionary_lost) {
+      memset(&output_data[out_pos], 0, decoded_len);
+    } else if (config->is_compressed) {
+      written = decompress_data(&data[start + dictionary_len], len - dictionary_len, &output_data[out_pos],
+                                decoded_len, dictionary, config->escape_byte, config->has_long_runs);
+    } else if (len == decoded_len) {
+      memcpy(&output_data[out_pos], &data[start], len);
+    } else {
+      written = 0;
     }
-    memcpy(output_data[stream], data, data_len);
 
-    free(data);
+    if (written != decoded_len) {
+      error_and_exit("ERROR: block table does not match stream length, cannot decode blocks\n");
+    }
+    out_pos += written;
   }
 
-  // Handle floating point streams, if any
-  if (num_streams == 1) {
-    memcpy(final_output_data, output_data[0], orig_sizes[0]);
+  return out_pos;
+}
 
-  } else if (num_streams == 2) {
-    // there can't be any size error here, so this function will always work
-    join_float_array(output_data[0], orig_sizes[0], output_data[1],
-        orig_sizes[1], final_output_data, final_output_size);
+// Helper function: gives up on a low-memory unpack whose output was already
+// partly written, so a bad input never leaves a plausible-looking output file
+static void low_memory_fail(FILE* output_fd, char* output_filename, const char* message) {
+  fclose(output_fd);
+  unlink(output_filename);
+  error_and_exit(message);
+}
 
-  } else if (num_streams == 3) {
-    join_float_array_three_stream(output_data[0], orig_sizes[0],
-        output_data[1], orig_sizes[1], output_data[2], orig_sizes[2],
-        final_output_data, final_output_size);
+// Helper function: reads exactly `len` decoded bytes from a stream
+static void low_memory_read(stream_cursor_t* cursor, uint8_t* buffer, size_t len,
+                            FILE* output_fd, char* output_filename) {
+  if (stream_cursor_read(cursor, buffer, len) != len) {
+    low_memory_fail(output_fd, output_filename, "ERROR: reconstructed stream is wrong length\n");
+  }
+}
 
-  } else {
-    error_and_exit("ERROR: impossible number of streams at reconstruction\n");
+// Unpacks without ever holding a whole stream in memory: the input file is
+// mapped, each stream is decoded through its own cursor, and the streams are
+// joined and written out a batch of values at a time
+// Integrity is checked as the streams are consumed; the output is removed if
+// a check fails at the end
+// Returns -1, having written nothing, if the file has to take the in-memory path
+static int unpack_low_memory(char* input_filename, char* output_filename) {
+  int input_fd = open(input_filename, O_RDONLY);
+  if (input_fd < 0) {
+    error_and_exit("ERROR: input file likely does not exist\n");
+  }
+  struct stat st;
+  if (fstat(input_fd, &st) != 0) {
+    error_and_exit("ERROR: input file likely does not exist\n");
+  }
+  size_t raw_len = st.st_size;
+  if (raw_len == 0) {
+    close(input_fd);
+    return -1;
   }
 
-  // Cleanup
+  uint8_t* raw_data = mmap(NULL, raw_len, PROT_READ, MAP_PRIVATE, input_fd, 0);
+  close(input_fd);
+  if (raw_data == MAP_FAILED) {
+    return -1;
+  }
+  posix_madvise(raw_data, raw_len, POSIX_MADV_SEQUENTIAL);
+
+  // Only the header pages get touched here
+  uint64_t num_streams = MAX_STREAMS;
+  uint64_t offsets[MAX_STREAMS+1];
+  uint64_t orig_sizes[MAX_STREAMS];
+  uint64_t stored_sizes[MAX_STREAMS];
+  packlab_config_t configs[MAX_STREAMS];
+  bool supported = analyze_streams(raw_data, raw_len, &num_streams, offsets, orig_sizes, stored_sizes) == 0;
+  offsets[num_streams] = raw_len;
+
+  for (uint64_t stream = 0; supported && stream < num_streams; stream++) {
+    memset(&configs[stream], 0, sizeof(configs[stream]));
+    parse_header(&raw_data[offsets[stream]], offsets[stream + 1] - offsets[stream], &configs[stream]);
+    check_stream_config(stream, &configs[stream], offsets[stream + 1] - offsets[stream]);
+
+    // blocked streams may need salvaging, which works on whole streams
+    if (configs[stream].has_block_checksums) {
+      supported = false;
+    }
+  }
+  if (!supported) {
+    munmap(raw_data, raw_len);
+    return -1;
+  }
+
+  stream_cursor_t cursors[MAX_STREAMS];
   for (uint64_t stream = 0; stream < num_streams; stream++) {
-    free(output_data[stream]);
+    uint16_t encryption_key = configs[stream].is_encrypted ? get_encryption_key() : 0;
+    uint8_t* stored_data = &raw_data[offsets[stream] + stream_data_offset(&configs[stream])];
+    stream_cursor_init(&cursors[stream], &configs[stream], stored_data, encryption_key);
   }
 
-  // Create output file
-  // This is done late in the process in case the input was invalid
   FILE* output_fd = fopen(output_filename, "w");
   if (output_fd == NULL) {
     error_and_exit("ERROR: could not open output file\n");
   }
 
-  // Write data to output file
-  size_t write_len = fwrite(final_output_data, sizeof(uint8_t), final_output_size, output_fd);
-  if (write_len != final_output_size) {
-    error_and_exit("ERROR: could not write output file data\n");
+  // one batch worth of each stream, plus the joined output (doubles take
+  // twice the room, so their batches have half as many values)
+  size_t batch_bytes  = 4 * JOIN_BATCH_FLOATS;
+  bool is_float64     = configs[0].is_float64;
+  size_t batch_values = is_float64 ? JOIN_BATCH_FLOATS / 2 : JOIN_BATCH_FLOATS;
+  check_float_emit(num_streams, is_float64);
+  uint8_t* batch[3];
+  for (int i = 0; i < 3; i++) {
+    batch[i] = malloc_and_check(batch_bytes);
+  }
+  uint8_t* joined = malloc_and_check(batch_bytes);
+
+  // last original value of each transformed float stream, carried across batches
+  uint8_t prev[MAX_STREAMS] = {0};
+
+  // FP assumptions here, as in the in-memory path
+  uint64_t total_values = (num_streams == 1) ? orig_sizes[0] : float_value_count(&configs[1]);
+  for (uint64_t done = 0; done < total_values; ) {
+    uint64_t remaining = total_values - done;
+    size_t count  = 0;
+    size_t out_len = 0;
+
+    if (num_streams == 1) {
+      count = (remaining < batch_bytes) ? (size_t)remaining : batch_bytes;
+      low_memory_read(&cursors[0], joined, count, output_fd, output_filename);
+      out_len = count;
+
+    } else if (is_float64) {
+      count = (remaining < batch_values) ? (size_t)remaining : batch_values;
+      size_t signexp_len = FLOAT64_SIGNEXP_LEN * count;
+      size_t lo_len      = ((num_streams == 2) ? FLOAT64_MANTISSA_LEN : FLOAT64_MANTISSA_LO_LEN) * count;
+      low_memory_read(&cursors[0], batch[0], lo_len, output_fd, output_filename);
+      low_memory_read(&cursors[1], batch[1], signexp_len, output_fd, output_filename);
+      out_len = 8 * count;
+      if (num_streams == 2) {
+        join_double_array(batch[0], lo_len, batch[1], signexp_len, joined, out_len);
+      } else {
+        size_t hi_len = FLOAT64_MANTISSA_HI_LEN * count;
+        low_memory_read(&cursors[2], batch[2], hi_len, output_fd, output_filename);
+        join_double_array_three_stream(batch[0], lo_len, batch[1], signexp_len, batch[2], hi_len, joined, out_len);
+      }
+
+    } else if (num_streams == 2) {
+      count = (remaining < JOIN_BATCH_FLOATS) ? (size_t)remaining : JOIN_BATCH_FLOATS;
+      low_memory_read(&cursors[0], batch[0], 3 * count, output_fd, output_filename);
+      low_memory_read(&cursors[1], batch[1], count, output_fd, output_filename);
+      for (uint64_t stream = 0; stream < 2; stream++) {
+        prev[stream] = undo_float_transform(batch[stream], float_value_len(stream) * count, float_value_len(stream),
+                                            configs[stream].float_transform, prev[stream]);
+      }
+      out_len = 4 * count;
+      join_float_array(batch[0], 3 * count, batch[1], count, joined, out_len);
+
+    } else {
+      // batches are a multiple of 8 floats, so sign and fraction bits of
+      // every batch but the last start on a byte boundary
+      count = (remaining < JOIN_BATCH_FLOATS) ? (size_t)remaining : JOIN_BATCH_FLOATS;
+      size_t frac_len = (23 * count + 7) / 8;
+      size_t sign_len = (count + 7) / 8;
+      low_memory_read(&cursors[0], batch[0], frac_len, output_fd, output_filename);
+      low_memory_read(&cursors[1], batch[1], count, output_fd, output_filename);
+      low_memory_read(&cursors[2], batch[2], sign_len, output_fd, output_filename);
+      prev[1] = undo_float_transform(batch[1], count, 1, configs[1].float_transform, prev[1]);
+      out_len = 4 * count;
+      join_float_array_three_stream(batch[0], frac_len, batch[1], count, batch[2], sign_len,
+                                    joined, out_len);
+    }
+
+    // narrowed in place, while the batch is still in cache
+    if (float_emit != FLOAT_EMIT_FP32) {
+      narrow_float_array(joined, count, joined, float_emit);
+      out_len = 2 * count;
+    }
+
+    if (!output_fwrite(joined, out_len, output_fd)) {
+      low_memory_fail(output_fd, output_filename, "ERROR: could not write output file data\n");
+    }
+    done += count;
   }
-  fclose(output_fd);
-  free(final_output_data);
-  free(raw_data);
 
+  // Use up anything left in the streams, so their lengths and checksums can be checked
+  for (uint64_t stream = 0; stream < num_streams; stream++) {
+    while (stream_cursor_read(&cursors[stream], batch[0], batch_bytes) > 0) {
+    }
+    bool intact = stream_cursor_is_intact(&cursors[stream]);
+    stream_cursor_free(&cursors[stream]);
+    if (!intact) {
+      low_memory_fail(output_fd, output_filename,
+                      "ERROR: reconstructed stream is wrong length or its checksum is invalid\n");
+    }
+  }
+
+  if (!finish_output(output_fd)) {
+    unlink(output_filename);
+    error_and_exit("ERROR: could not write output file data\n");
+  }
+  for (int i = 0; i < 3; i++) {
+    free(batch[i]);
+  }
+  free(joined);
+  munmap(raw_data, raw_len);
   return 0;
 }
 
+// Unpacks a small file with as few system calls as possible and no heap
+// memory: one read into a static buffer, decoding into static buffers, and
+// one write. Only the plain cases are handled here (see small_file_eligible)
+// Whether a file is one of them is settled from its headers, and its stored
+// data checked, before the password is asked for; a checksum mismatch is
+// reported right away, like the regular path would
+// Returns -1, having written nothing and asked for nothing, for any other
+// kind of file, so the regular path can deal with it
+static int unpack_small_file(char* input_filename, char* output_filename) {
+  // (static rather than on the stack: unpack handles one file at a time)
+  static uint8_t raw_data[SMALL_FILE_LEN];
+  static uint8_t stream_data[SMALL_OUTPUT_LEN];
+  static uint8_t final_data[SMALL_OUTPUT_LEN];
+
+  int input_fd = open(input_filename, O_RDONLY | O_CLOEXEC);
+  if (input_fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(input_fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > SMALL_FILE_LEN) {
+    close(input_fd);
+    return -1;
+  }
+  size_t raw_len = (size_t)st.st_size;
+  ssize_t got = read(input_fd, raw_data, raw_len);
+  close(input_fd);
+  if (got < 0 || (size_t)got != raw_len) {
+    return -1;
+  }
+
+  archive_headers_t headers;
+  if (parse_archive_headers(raw_data, raw_len, &headers) != NULL || !small_file_eligible(raw_len, &headers)) {
+    return -1;
+  }
+
+  // files --emit can't narrow fail on the usual path
+  if (float_emit != FLOAT_EMIT_FP32 && (headers.num_streams == 1 || headers.streams[0].is_float64)) {
+    return -1;
+  }
+  uint64_t write_len = headers.streams[0].orig_data_size;
+  if (headers.num_streams > 1) {
+    write_len = (float_emit != FLOAT_EMIT_FP32) ? 2 * float_value_count(&headers.streams[1]) :
+                                                  float_output_len(&headers.streams[1]);
+    if (write_len > SMALL_OUTPUT_LEN) {
+      return -1;
+    }
+  }
+
+  const char* error = small_file_verify(raw_data, &headers);
+  if (error != NULL) {
+    error_and_exit(error);
+  }
+
+  bool is_encrypted = false;
+  for (uint64_t stream = 0; stream < headers.num_streams; stream++) {
+    is_encrypted = is_encrypted || headers.streams[stream].is_encrypted;
+  }
+  uint16_t encryption_key = is_encrypted ? get_encryption_key() : 0;
+  const uint8_t* keystream = NULL;
+  if (keystream_cache != NULL && is_encrypted) {
+    keystream = keystream_cache_get(keystream_cache, encryption_key);
+  }
+
+  uint8_t* output_data[HEADER_CATALOG_MAX_STREAMS];
+  if (!small_file_decode(raw_data, &headers, encryption_key, keystream, stream_data, output_data)) {
+    return -1;
+  }
+
+  uint8_t* write_data = output_data[0];
+  if (headers.num_streams > 1) {
+    write_data = final_data;
+    memset(final_data, 0, write_len);
+    uint64_t orig_sizes[HEADER_CATALOG_MAX_STREAMS];
+    for (uint64_t stream = 0; stream < headers.num_streams; stream++) {
+      orig_sizes[stream] = headers.streams[stream].orig_data_size;
+    }
+    join_streams(headers.num_streams, headers.streams[0].is_float64, output_data, orig_sizes,
+                 final_data, write_len);
+  }
+
+  int output_fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (output_fd < 0) {
+    error_and_exit("ERROR: could not open output file\n");
+  }
+  if (write(output_fd, write_data, write_len) != (ssize_t)write_len) {
+    error_and_exit("ERROR: could not write output file data\n");
+  }
+  close(output_fd);
+  return 0;
+}
+
+// Helper function: reads, checks and decodes one block of a stream with
+// per-block checksums into `output_data`, which holds its `decoded_len` bytes
+// `stored_data` is scratch space for the stored block
+// Returns false if the block is corrupt or does not decode to its length
+static bool decode_one_block(int input_fd, uint64_t data_offset, packlab_config_t* config, uint8_t* table,
+                             uint64_t block, uint8_t* stored_data, uint8_t* output_data, size_t decoded_len) {
+  uint32_t expected_crc32c = 0;
+  uint32_t table_len       = 0;
+  read_block_entry(table, block, &expected_crc32c, &table_len);
+  uint64_t start = block * config->block_size;
+  size_t len     = (config->data_size - start < config->block_size) ? (size_t)(config->data_size - start) :
+                                                                     (size_t)config->block_size;
+  if (pread(input_fd, stored_data, len, (off_t)(data_offset + start)) != (ssize_t)len ||
+      crc32c_update(0, stored_data, len) != expected_crc32c) {
+    return false;
+  }
+
+  // only asked for once a block has checked out
+  if (config->is_encrypted) {
+    keystream_xor(keystream_cache_get(keystream_cache, get_encryption_key()), start, stored_data, stored_data, len);
+  }
+  if (!config->is_compressed) {
+    memcpy(output_data, stored_data, len);
+    return len == decoded_len;
+  }
+  return decompress_data(stored_data, len, output_data, decoded_len, config->dictionary_data,
+                         config->escape_byte, config->has_long_runs) == decoded_len;
+}
+
+// Unpacks just the --range of a raw file with per-block checksums, for a
+// daemon worker: only the blocks the range touches are read and decoded, and
+// they are kept in the worker's block cache for the requests that follow
+// Each block used is checked against its own CRC32C; the whole-stream
+// checksums are not, since that would take reading the entire file
+// Blocks of an encrypted file are cached under the key they were decrypted
+// with. Unless the password is already at hand, the first block is decoded
+// (and checked) before it is asked for, so that one can't come from the cache
+// Returns -1, having written nothing, for any other kind of file or any
+// problem, so the regular path can deal with it (and report any error)
+static int unpack_range_from_blocks(char* input_filename, char* output_filename,
+                                    uint64_t range_start, uint64_t range_len) {
+  int input_fd = open(input_filename, O_RDONLY | O_CLOEXEC);
+  if (input_fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  archive_headers_t headers;
+  block_cache_key_t key;
+  if (fstat(input_fd, &st) != 0 || read_archive_headers(input_fd, (uint64_t)st.st_size, &headers) != NULL ||
+      !block_cache_key_from_fd(input_fd, 0, &key)) {
+    close(input_fd);
+    return -1;
+  }
+
+  // blocks with per-block dictionaries depend on every block before them
+  packlab_config_t* config = &headers.streams[0];
+  if (headers.num_streams != 1 || !config->has_block_checksums || config->has_block_dictionaries ||
+      range_start > config->orig_data_size || range_len > config->orig_data_size - range_start) {
+    close(input_fd);
+    return -1;
+  }
+
+  uint64_t data_offset = headers.header_offsets[0] + stream_data_offset(config);
+  uint64_t table_len   = block_table_len(config);
+  uint8_t* table       = malloc_and_check(table_len);
+  if (pread(input_fd, table, table_len, (off_t)(data_offset + config->data_size)) != (ssize_t)table_len) {
+    free(table);
+    close(input_fd);
+    return -1;
+  }
+
+  // the cache key includes the encryption key, once it can be had without asking
+  bool has_key = !config->is_encrypted || strlen(password) > 0 || getenv("PACKLAB_PASSWORD") != NULL;
+  if (has_key && config->is_encrypted) {
+    key.encryption_key = get_encryption_key();
+  }
+
+  uint8_t* output_data = buffer_pool_get(buffer_pool, range_len);
+  uint8_t* stored_data = NULL; // (both only allocated on a cache miss)
+  uint8_t* block_data  = NULL;
+  size_t block_data_len = 0;
+
+  // the table gives each block's decoded length, so the blocks the range
+  // touches are found without decoding any before them
+  uint64_t range_end   = range_start + range_len;
+  uint64_t block_start = 0;
+  uint64_t out_pos     = 0;
+  bool ok = true;
+  for (uint64_t block = 0; block < block_count(config) && block_start < range_end && ok; block++) {
+    uint32_t expected_crc32c = 0;
+    uint32_t decoded_len     = 0;
+    read_block_entry(table, block, &expected_crc32c, &decoded_len);
+    uint64_t block_end = block_start + decoded_len;
+    if (block_end <= range_start || decoded_len == 0) {
+      block_start = block_end;
+      continue;
+    }
+
+    if (decoded_len > block_data_len) {
+      buffer_pool_put(buffer_pool, block_data);
+      block_data     = buffer_pool_get(buffer_pool, decoded_len);
+      block_data_len = decoded_len;
+    }
+    key.block_number = block;
+    size_t cached_len = 0;
+    if (!has_key || !block_cache_lookup(block_cache, &key, block_data, decoded_len, &cached_len) ||
+        cached_len != decoded_len) {
+      if (stored_data == NULL) {
+        stored_data = buffer_pool_get(buffer_pool, config->block_size);
+      }
+      ok = decode_one_block(input_fd, data_offset, config, table, block, stored_data, block_data, decoded_len);
+      if (ok && !has_key) {
+        key.encryption_key = get_encryption_key(); // (already asked for by decode_one_block)
+        has_key = true;
+      }
+      if (ok) {
+        block_cache_insert(block_cache, &key, block_data, decoded_len);
+      }
+    }
+
+    uint64_t from = (range_start > block_start) ? range_start - block_start : 0;
+    uint64_t to   = (range_end < block_end) ? range_end - block_start : decoded_len;
+    if (ok) {
+      memcpy(&output_data[out_pos], &block_data[from], to - from);
+      out_pos += to - from;
+    }
+    block_start = block_end;
+  }
+  close(input_fd);
+  free(table);
+  buffer_pool_put(buffer_pool, stored_data);
+  buffer_pool_put(buffer_pool, block_data);
+
+  // (a table whose lengths fall short of the stream is left to the regular path too)
+  if (!ok || out_pos != range_len) {
+    buffer_pool_put(buffer_pool, output_data);
+    return -1;
+  }
+
+  FILE* output_fd = fopen(output_filename, "w");
+  if (output_fd == NULL) {
+    error_and_exit("ERROR: could not open output file\n");
+  }
+  if (!write_output(fileno(output_fd), -1, output_data, range_len)) {
+    error_and_exit("ERROR: could not write output file data\n");
+  }
+  fclose(output_fd);
+  buffer_pool_put(buffer_pool, output_data);
+  return 0;
+}
+
+// Unpacks a file arriving on stdin, which can't be sized or mapped ahead of
+// time, by pushing it through the incremental decoder a piece at a time
+// The output is removed if the input turns out to be bad
+// stdin is taken, so the password can only come from PACKLAB_PASSWORD
+static void unpack_from_stdin(char* output_filename) {
+  FILE* output_fd = fopen(output_filename, "w");
+  if (output_fd == NULL) {
+    error_and_exit("ERROR: could not open output file\n");
+  }
+
+  uint8_t* input_chunk  = malloc_and_check(PIPE_CHUNK_LEN);
+  uint8_t* output_chunk = malloc_and_check(PIPE_CHUNK_LEN);
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  bool has_password = (getenv("PACKLAB_PASSWORD") != NULL);
+  packlab_stream_init(ctx, has_password ? get_encryption_key() : 0);
+  ctx->emit = float_emit;
+
+  packlab_stream_status_t status = PACKLAB_STREAM_OK;
+  size_t input_len = 0;
+  while (status == PACKLAB_STREAM_OK && (input_len = fread(input_chunk, 1, PIPE_CHUNK_LEN, stdin)) > 0) {
+    packlab_stream_feed(ctx, input_chunk, input_len);
+    // keep draining while there is input left, or the output came back full
+    size_t produced = 0;
+    do {
+      status = packlab_stream_drain(ctx, output_chunk, PIPE_CHUNK_LEN, &produced);
+      if (!output_fwrite(output_chunk, produced, output_fd)) {
+        low_memory_fail(output_fd, output_filename, "ERROR: could not write output file data\n");
+      }
+      if (ctx->config.is_encrypted && !has_password) {
+        low_memory_fail(output_fd, output_filename, "ERROR: set PACKLAB_PASSWORD to unpack encrypted input from stdin\n");
+      }
+    } while (status == PACKLAB_STREAM_OK && (ctx->avail_in > 0 || produced == PIPE_CHUNK_LEN));
+  }
+
+  if (packlab_stream_end(ctx) != PACKLAB_STREAM_END) {
+    low_memory_fail(output_fd, output_filename, ctx->error);
+  }
+  if (!finish_output(output_fd)) {
+    unlink(output_filename);
+    error_and_exit("ERROR: could not write output file data\n");
+  }
+  free(ctx);
+  free(input_chunk);
+  free(output_chunk);
+}
+
+// One buffer passed between --pipeline stages
+typedef struct {
+  uint8_t* data;
+  size_t len;
+  bool is_last; // nothing follows this buffer
+
+  // writer only: writes of this buffer in flight, and bytes they still owe
+  unsigned writes_pending;
+  size_t bytes_pending;
+} pipeline_buffer_t;
+
+// Shared state of the --pipeline stages. Each ring has exactly one producer
+// and one consumer, and buffers go round in circles:
+//   reader  -> filled_input  -> decoder -> free_input  -> reader
+//   decoder -> filled_output -> writer  -> free_output -> decoder
+typedef struct {
+  int input_fd;
+  FILE* output_fd;
+  int direct_output_fd; // the output opened with O_DIRECT, or -1
+  uint16_t encryption_key;
+
+  spsc_ring_t filled_input;
+  spsc_ring_t free_input;
+  spsc_ring_t filled_output;
+  spsc_ring_t free_output;
+
+  // set by the decoder on bad input, so the reader can stop early
+  atomic_bool decode_failed;
+  const char* decode_error;
+  bool write_failed;
+  bool read_failed;
+} pipeline_t;
+
+// Reader stage: preads the input into free buffers, in order
+static void* pipeline_read(void* arg) {
+  pipeline_t* pipeline = (pipeline_t*)arg;
+  uint64_t offset = 0;
+
+  bool is_last = false;
+  while (!is_last) {
+    pipeline_buffer_t* buffer = spsc_ring_pop(&pipeline->free_input);
+    ssize_t got = 0;
+    if (!atomic_load(&pipeline->decode_failed)) {
+      got = pread(pipeline->input_fd, buffer->data, PIPELINE_BUFFER_LEN, offset);
+    }
+    if (got < 0) {
+      pipeline->read_failed = true;
+      got = 0;
+    }
+    offset += got;
+
+    buffer->len     = got;
+    buffer->is_last = is_last = (got == 0);
+    spsc_ring_push(&pipeline->filled_input, buffer);
+  }
+  return NULL;
+}
+
+// Decoder stage: pushes each input buffer through the incremental decoder,
+// filling output buffers as it goes
+// After a failure it keeps recycling input buffers until the reader stops
+static void* pipeline_decode(void* arg) {
+  pipeline_t* pipeline = (pipeline_t*)arg;
+  packlab_stream_t* ctx = malloc_and_check(sizeof(*ctx));
+  packlab_stream_init(ctx, pipeline->encryption_key);
+  ctx->emit = float_emit;
+
+  pipeline_buffer_t* output = spsc_ring_pop(&pipeline->free_output);
+  output->len = 0;
+  packlab_stream_status_t status = PACKLAB_STREAM_OK;
+
+  bool is_last = false;
+  while (!is_last) {
+    pipeline_buffer_t* input = spsc_ring_pop(&pipeline->filled_input);
+    is_last = input->is_last;
+
+    if (status == PACKLAB_STREAM_OK && input->len > 0) {
+      packlab_stream_feed(ctx, input->data, input->len);
+      // keep draining while there is input left, or the output filled up
+      bool filled = false;
+      do {
+        size_t produced = 0;
+        status = packlab_stream_drain(ctx, &output->data[output->len], PIPELINE_BUFFER_LEN - output->len,
+                                      &produced);
+        output->len += produced;
+        filled = (output->len == PIPELINE_BUFFER_LEN);
+        if (filled) {
+          output->is_last = false;
+          spsc_ring_push(&pipeline->filled_output, output);
+          output = spsc_ring_pop(&pipeline->free_output);
+          output->len = 0;
+        }
+      } while (status == PACKLAB_STREAM_OK && (ctx->avail_in > 0 || filled));
+
+      if (status == PACKLAB_STREAM_ERROR) {
+        atomic_store(&pipeline->decode_failed, true);
+      }
+    }
+    spsc_ring_push(&pipeline->free_input, input);
+  }
+
+  if (packlab_stream_end(ctx) != PACKLAB_STREAM_END) {
+    pipeline->decode_error = ctx->error;
+    atomic_store(&pipeline->decode_failed, true);
+  }
+  free(ctx);
+
+  output->is_last = true;
+  spsc_ring_push(&pipeline->filled_output, output);
+  return NULL;
+}
+
+// Writer stage: writes filled output buffers, several at a time, recycling
+// each one once all of its writes complete
+// With --sparse, each buffer is written as its runs of nonzero pages
+// After a failure it keeps recycling buffers until the decoder stops
+static void pipeline_finish_write(pipeline_t* pipeline, async_io_t* io) {
+  int64_t result = 0;
+  pipeline_buffer_t* buffer = async_io_wait(io, &result);
+  if (result < 0) {
+    pipeline->write_failed = true;
+  } else {
+    buffer->bytes_pending -= result;
+  }
+
+  buffer->writes_pending--;
+  if (buffer->writes_pending == 0) {
+    if (buffer->bytes_pending != 0) {
+      pipeline->write_failed = true;
+    }
+    spsc_ring_push(&pipeline->free_output, buffer);
+  }
+}
+
+static void* pipeline_write(void* arg) {
+  pipeline_t* pipeline = (pipeline_t*)arg;
+  int fd = fileno(pipeline->output_fd);
+  uint64_t offset = 0;
+
+  async_io_t io;
+  async_io_init(&io, PIPELINE_BUFFERS, allow_io_uring);
+
+  bool is_last = false;
+  while (!is_last) {
+    // while waiting for the decoder, hand back buffers whose writes are done
+    // (it may be waiting on exactly those)
+    void* item = NULL;
+    while (!spsc_ring_try_pop(&pipeline->filled_output, &item)) {
+      if (io.in_flight == 0) {
+        item = spsc_ring_pop(&pipeline->filled_output);
+        break;
+      }
+      pipeline_finish_write(pipeline, &io);
+    }
+    pipeline_buffer_t* buffer = item;
+    is_last = buffer->is_last;
+
+    size_t run_offset = 0;
+    while (!pipeline->write_failed && run_offset < buffer->len) {
+      size_t run_len = buffer->len - run_offset;
+      if (sparse_output) {
+        run_offset = next_data_run(buffer->data, run_offset, buffer->len, &run_len);
+        if (run_len == 0) {
+          break;
+        }
+      }
+      if (!async_io_can_submit(&io)) {
+        pipeline_finish_write(pipeline, &io);
+      }
+
+      // everything but the tail of the last buffer is whole pages, so can go out with O_DIRECT
+      bool is_direct = pipeline->direct_output_fd >= 0 && run_len % DATA_ALIGN == 0;
+      buffer->writes_pending++;
+      buffer->bytes_pending += run_len;
+      async_io_submit_write(&io, is_direct ? pipeline->direct_output_fd : fd, &buffer->data[run_offset],
+                            run_len, offset + run_offset, buffer);
+      run_offset += run_len;
+    }
+    offset += buffer->len;
+
+    if (buffer->writes_pending == 0) {
+      spsc_ring_push(&pipeline->free_output, buffer);
+    }
+  }
+
+  while (io.in_flight > 0) {
+    pipeline_finish_write(pipeline, &io);
+  }
+  async_io_free(&io);
+
+  if (sparse_output && !pipeline->write_failed && ftruncate(fd, offset) != 0) {
+    pipeline->write_failed = true;
+  }
+  return NULL;
+}
+
+// Unpacks with reading, decoding and writing in three threads, so that disk
+// and CPU are busy at the same time. Memory use is fixed by the ring sizes
+// (plus, for float files, every stream but the last)
+// The output is removed if anything fails
+static void unpack_pipelined(char* input_filename, char* output_filename) {
+  pipeline_t pipeline;
+  memset(&pipeline, 0, sizeof(pipeline));
+  atomic_init(&pipeline.decode_failed, false);
+
+  pipeline.input_fd = open(input_filename, O_RDONLY);
+  if (pipeline.input_fd < 0) {
+    error_and_exit("ERROR: input file likely does not exist\n");
+  }
+
+  // the password prompt can't wait until a decoder thread finds an encrypted stream
+  uint8_t header[MAX_HEADER_SIZE];
+  ssize_t header_len = pread(pipeline.input_fd, header, sizeof(header), 0);
+  packlab_config_t config = {0};
+  parse_header(header, (header_len > 0) ? header_len : 0, &config);
+  pipeline.encryption_key = config.is_encrypted ? get_encryption_key() : 0;
+
+  // the reader's reads are whole buffers at buffer-sized offsets, so fine for O_DIRECT
+  int direct_fd = direct_input ? open_direct(input_filename, O_RDONLY) : -1;
+  if (direct_fd >= 0) {
+    close(pipeline.input_fd);
+    pipeline.input_fd = direct_fd;
+  }
+
+  pipeline.output_fd = fopen(output_filename, "w");
+  if (pipeline.output_fd == NULL) {
+    error_and_exit("ERROR: could not open output file\n");
+  }
+  pipeline.direct_output_fd = direct_output ? open_direct(output_filename, O_WRONLY) : -1;
+
+  // every buffer starts out free
+  spsc_ring_t* rings[] = { &pipeline.filled_input, &pipeline.free_input,
+                           &pipeline.filled_output, &pipeline.free_output };
+  for (int i = 0; i < 4; i++) {
+    spsc_ring_init(rings[i], PIPELINE_BUFFERS);
+  }
+  pipeline_buffer_t buffers[2 * PIPELINE_BUFFERS];
+  memset(buffers, 0, sizeof(buffers));
+  for (int i = 0; i < 2 * PIPELINE_BUFFERS; i++) {
+    buffers[i].data = buffer_pool_get(buffer_pool, PIPELINE_BUFFER_LEN);
+    spsc_ring_push((i < PIPELINE_BUFFERS) ? &pipeline.free_input : &pipeline.free_output, &buffers[i]);
+  }
+
+  pthread_t reader, decoder, writer;
+  if (pthread_create(&reader, NULL, pipeline_read, &pipeline) != 0 ||
+      pthread_create(&decoder, NULL, pipeline_decode, &pipeline) != 0 ||
+      pthread_create(&writer, NULL, pipeline_write, &pipeline) != 0) {
+    error_and_exit("ERROR: could not start pipeline threads\n");
+  }
+  pthread_join(reader, NULL);
+  pthread_join(decoder, NULL);
+  pthread_join(writer, NULL);
+
+  for (int i = 0; i < 2 * PIPELINE_BUFFERS; i++) {
+    buffer_pool_put(buffer_pool, buffers[i].data);
+  }
+  for (int i = 0; i < 4; i++) {
+    spsc_ring_free(rings[i]);
+  }
+  close(pipeline.input_fd);
+  if (pipeline.direct_output_fd >= 0) {
+    close(pipeline.direct_output_fd);
+  }
+
+  if (pipeline.read_failed) {
+    low_memory_fail(pipeline.output_fd, output_filename, "ERROR: could not read input file data\n");
+  }
+  if (atomic_load(&pipeline.decode_failed)) {
+    low_memory_fail(pipeline.output_fd, output_filename,
+                    (pipeline.decode_error != NULL) ? pipeline.decode_error : "ERROR: input is invalid\n");
+  }
+  if (pipeline.write_failed || fclose(pipeline.output_fd) != 0) {
+    unlink(output_filename);
+    error_and_exit("ERROR: could not write output file data\n");
+  }
+}
+
+// Prints how much buffer memory the unpack needed, for --memory-stats
+static void report_memory(bool memory_stats) {
+  if (!memory_stats) {
+    return;
+  }
+  buffer_pool_stats_t stats = buffer_pool_get_stats(buffer_pool);
+  fprintf(stderr, "buffers: %lu gets, %lu reused, %lu mapped, %lu unmapped\n",
+          stats.gets, stats.reuses, stats.maps, stats.unmaps);
+  fprintf(stderr, "buffers: peak %lu KB in use, peak %lu KB mapped\n",
+          stats.peak_bytes_in_use >> 10, stats.peak_bytes_mapped >> 10);
+  if (block_cache != NULL) {
+    block_cache_stats_t blocks = block_cache_get_stats(block_cache);
+    fprintf(stderr, "block cache: %lu hits, %lu misses, %lu blocks (%lu KB) held\n",
+            blocks.hits, blocks.misses, blocks.entries, blocks.bytes_used >> 10);
+  }
+}
+
+static void usage_and_exit(char* program) {
+  printf("usage: %s [--salvage] [--low-memory] [--pipeline] [--no-io-uring] [--direct-io[=all]] [--sparse]\n"
+         "       [--huge-pages] [--prefault] [--memory-stats] [--range=START:LENGTH] [--emit=bf16|fp16]\n"
+         "       [--connect=SOCKET] inputfilename outputfilename\n"
+         "       %s --daemon=SOCKET [--workers=N]\n"
+         "       %s --connect=SOCKET --daemon-stats\n"
+         "       %s --list|--info [--catalog=FILE] path...\n", program, program, program, program);
+  printf("  --salvage  with per-block checksums, zero-fill corrupt blocks instead of failing\n");
+  printf("             (exits with status %d if anything had to be zero-filled)\n", EXIT_SALVAGED);
+  printf("  --low-memory  decode and write a batch at a time, using a few MB regardless of file size\n");
+  printf("                (automatic for inputs of %d MB or more)\n", (int)(LOW_MEMORY_AUTO_LEN >> 20));
+  printf("  --pipeline  read, decode and write in separate threads, overlapping disk and CPU\n");
+  printf("  --no-io-uring  read and write with pread/pwrite even where io_uring is available\n");
+  printf("  --direct-io  read the input with O_DIRECT, bypassing the page cache; =all also writes\n");
+  printf("               the output that way (not with --low-memory, which maps the input)\n");
+  printf("  --sparse  leave holes in the output instead of writing pages that are all zero\n");
+  printf("  --huge-pages  back large buffers with transparent huge pages\n");
+  printf("  --prefault  fault large buffers in when they are mapped (MAP_POPULATE)\n");
+  printf("  --memory-stats  print buffer counts and peak buffer memory to stderr\n");
+  printf("  --range  write only LENGTH bytes of the unpacked data, starting at byte START\n");
+  printf("  --emit  write the values of a 32-bit float file as bfloat16 or IEEE half precision\n"
+         "         (2 bytes each, rounded to nearest even) instead of as floats\n");
+  printf("  --daemon  serve unpack requests on a Unix socket with N worker processes (default %d)\n"
+         "            (each keeps %d MB of decoded blocks, so --range reads of blocked files decode less)\n",
+         DEFAULT_DAEMON_WORKERS, (int)(DAEMON_BLOCK_CACHE_LEN >> 20));
+  printf("  --connect  have the daemon on SOCKET do the unpack (%s=SOCKET does the same, but\n"
+         "             unpacks here if no daemon is running); --daemon-stats prints its counters\n", UNPACKD_ENV);
+  printf("  --list  print each stream of the packed files under the paths, reading only their headers:\n"
+         "          path, streams, stream, flags (cekrbf3), original size and stored size\n");
+  printf("  --info  describe the headers of the packed files under the paths\n");
+  printf("  --catalog  keep the headers --list and --info read in FILE, to skip unchanged files next time\n");
+  printf("  an inputfilename of - reads the packed file from stdin, decoding it as it arrives\n");
+  printf("  (not with --salvage or --range, which need the whole file at hand)\n");
+  printf("  %s=scalar|sse2|ssse3|sse4.2|avx2|avx512 limits the instruction sets kernels use\n"
+         "  (default: the best this CPU supports, currently %s)\n", CPU_ISA_ENV, cpu_isa_name(cpu_isa_detect()));
+  error_and_exit("\n");
+}
+
+// State of a --list or --info run, shared with the nftw() callback
+static header_catalog_t* list_catalog = NULL;
+static bool list_details = false;
+static int  list_failures = 0;
+
+// Helper function: describes one stream's flags as "cekrbf3", with a dash for each one unset
+static void format_stream_flags(packlab_config_t* config, char flags[8]) {
+  flags[0] = config->is_compressed       ? 'c' : '-';
+  flags[1] = config->is_encrypted        ? 'e' : '-';
+  flags[2] = config->is_checksummed      ? 'k' : '-';
+  flags[3] = config->is_crc32c           ? 'r' : '-';
+  flags[4] = config->has_block_checksums ? 'b' : '-';
+  flags[5] = config->should_float        ? 'f' : '-';
+  flags[6] = config->should_float3       ? '3' : '-';
+  flags[7] = '\0';
+}
+
+// Helper function: prints the headers of one packed file, for --list (a line
+// per stream) or --info (a readable summary)
+static void print_archive_headers(const char* path, archive_headers_t* headers) {
+  if (!list_details) {
+    for (uint64_t stream = 0; stream < headers->num_streams; stream++) {
+      packlab_config_t* config = &headers->streams[stream];
+      char flags[8];
+      format_stream_flags(config, flags);
+      printf("%s\t%lu\t%lu\t%s\t%lu\t%lu\n", path, headers->num_streams, stream, flags,
+             config->orig_data_size, config->data_size);
+    }
+    return;
+  }
+
+  // the float layouts unpack to 4 (or 8) bytes per value of the exponent stream
+  uint64_t output_size = (headers->num_streams == 1) ? headers->streams[0].orig_data_size :
+                                                       float_output_len(&headers->streams[1]);
+  const char* layouts[] = { "", "raw", "float, 2 streams", "float, 3 streams" };
+  printf("%s: %s%s, unpacks to %lu bytes\n", path, layouts[headers->num_streams],
+         headers->streams[0].is_float64 ? " of doubles" : "", output_size);
+  for (uint64_t stream = 0; stream < headers->num_streams; stream++) {
+    packlab_config_t* config = &headers->streams[stream];
+    printf("  stream %lu: header at %lu (%lu bytes), %lu stored bytes -> %lu bytes\n", stream,
+           headers->header_offsets[stream], config->header_len, config->data_size, config->orig_data_size);
+    if (config->header_align != HEADER_ALIGN) {
+      printf("    compact layout, aligned to %lu bytes\n", config->header_align);
+    }
+    if (config->is_compressed) {
+      printf("    compressed\n");
+    }
+    if (config->is_encrypted) {
+      printf("    encrypted\n");
+    }
+    if (config->is_checksummed) {
+      printf("    checksum 0x%04x\n", config->checksum_value);
+    }
+    if (config->is_crc32c) {
+      printf("    crc32c 0x%08x\n", config->crc32c_value);
+    }
+    if (config->has_block_checksums) {
+      printf("    %lu blocks of %lu bytes, each with a crc32c\n", block_count(config), config->block_size);
+    }
+    if (config->has_block_dictionaries) {
+      printf("    a dictionary per block\n");
+    }
+    if (config->is_compressed && config->escape_byte != ESCAPE_BYTE) {
+      printf("    escape byte 0x%02x\n", config->escape_byte);
+    }
+    if (config->float_transform != FLOAT_TRANSFORM_NONE) {
+      printf("    %s values stored %s\n", (stream == 0) ? "sign and high fraction" : "exponent",
+             (config->float_transform == FLOAT_TRANSFORM_DELTA) ? "as deltas" : "XORed with the one before");
+    }
+  }
+}
+
+// Lists one file, from the catalog if it has the file as it is now, and
+// otherwise from its header pages
+static int list_file(const char* path, const struct stat* st, int type, struct FTW* walk) {
+  (void)walk;
+  if (type != FTW_F || !S_ISREG(st->st_mode)) {
+    return 0;
+  }
+
+  archive_headers_t headers;
+  if (list_catalog == NULL || !header_catalog_lookup(list_catalog, st, &headers)) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      fprintf(stderr, "%s: could not open file\n", path);
+      list_failures++;
+      return 0;
+    }
+    const char* error = read_archive_headers(fd, (uint64_t)st->st_size, &headers);
+    close(fd);
+    if (error != NULL) {
+      fprintf(stderr, "%s: %s\n", path, error);
+      list_failures++;
+      return 0;
+    }
+    if (list_catalog != NULL) {
+      header_catalog_insert(list_catalog, st, &headers);
+    }
+  }
+
+  print_archive_headers(path, &headers);
+  return 0;
+}
+
+// Prints the headers of every packed file named in `argv` (directories are
+// walked) without reading any stream data
+// With --catalog=FILE, headers are cached in FILE for the next run
+// Returns the exit status: 1 if any file could not be listed
+static int list_archives(int argc, char* argv[]) {
+  list_details  = strcmp(argv[1], "--info") == 0;
+  list_failures = 0;
+
+  int arg = 2;
+  char* catalog_path = NULL;
+  if (arg < argc && strncmp(argv[arg], "--catalog=", strlen("--catalog=")) == 0) {
+    catalog_path = &argv[arg][strlen("--catalog=")];
+    list_catalog = header_catalog_load(catalog_path);
+    arg++;
+  }
+  if (arg == argc) {
+    usage_and_exit(argv[0]);
+  }
+
+  for (; arg < argc; arg++) {
+    if (nftw(argv[arg], list_file, LIST_WALK_FDS, FTW_PHYS) != 0) {
+      fprintf(stderr, "%s: could not be read\n", argv[arg]);
+      list_failures++;
+    }
+  }
+
+  if (list_catalog != NULL) {
+    header_catalog_stats_t stats = header_catalog_get_stats(list_catalog);
+    fprintf(stderr, "catalog: %lu entries, %lu hits, %lu misses\n", stats.entries, stats.hits, stats.misses);
+    if (!header_catalog_save(list_catalog, catalog_path)) {
+      fprintf(stderr, "WARNING: could not write catalog %s\n", catalog_path);
+    }
+    header_catalog_destroy(list_catalog);
+    list_catalog = NULL;
+  }
+  fflush(stdout);
+  return list_failures > 0 ? 1 : 0;
+}
+
+// Unpacks one file as `argv` describes (for the command line or a daemon request)
+// Returns the exit status
+static int run_unpack(int argc, char* argv[]) {
+  // Parse app flags
+  // Options come first, then input and output filenames
+  bool salvage    = false;
+  bool low_memory = false;
+  bool pipelined  = false;
+  bool memory_stats = false;
+  bool has_range  = false;
+  uint64_t range_start = 0;
+  uint64_t range_len   = 0;
+  unsigned pool_options = 0;
+
+  // a daemon worker runs many of these, so nothing may carry over from the last
+  allow_io_uring = true;
+  direct_input   = false;
+  direct_output  = false;
+  sparse_output  = false;
+  float_emit     = FLOAT_EMIT_FP32;
+  memset(password, 0, sizeof(password));
+
+  int arg = 1;
+  for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+    if (strcmp(argv[arg], "--salvage") == 0) {
+      salvage = true;
+    } else if (strcmp(argv[arg], "--low-memory") == 0) {
+      low_memory = true;
+    } else if (strcmp(argv[arg], "--pipeline") == 0) {
+      pipelined = true;
+    } else if (strcmp(argv[arg], "--no-io-uring") == 0) {
+      allow_io_uring = false;
+    } else if (strcmp(argv[arg], "--huge-pages") == 0) {
+      pool_options |= BUFFER_POOL_HUGE_PAGES;
+    } else if (strcmp(argv[arg], "--prefault") == 0) {
+      pool_options |= BUFFER_POOL_PREFAULT;
+    } else if (strcmp(argv[arg], "--memory-stats") == 0) {
+      memory_stats = true;
+    } else if (strcmp(argv[arg], "--sparse") == 0) {
+      sparse_output = true;
+    } else if (strcmp(argv[arg], "--direct-io") == 0) {
+      direct_input = true;
+    } else if (strcmp(argv[arg], "--direct-io=all") == 0) {
+      direct_input  = true;
+      direct_output = true;
+    } else if (strcmp(argv[arg], "--emit=fp32") == 0) {
+      float_emit = FLOAT_EMIT_FP32;
+    } else if (strcmp(argv[arg], "--emit=bf16") == 0) {
+      float_emit = FLOAT_EMIT_BF16;
+    } else if (strcmp(argv[arg], "--emit=fp16") == 0) {
+      float_emit = FLOAT_EMIT_FP16;
+    } else if (sscanf(argv[arg], "--range=%lu:%lu", &range_start, &range_len) == 2) {
+      has_range = true;
+    } else {
+      usage_and_exit(argv[0]);
+    }
+  }
+  if (argc - arg != 2) {
+    usage_and_exit(argv[0]);
+  }
+  char* input_filename  = argv[arg];
+  char* output_filename = argv[arg + 1];
+
+  // Validate input data
+  if (strcmp(input_filename, output_filename) == 0) {
+    // This check is for safety to make sure we don't overwrite a file
+    error_and_exit("ERROR: input and output filename match\n");
+  }
+  if (has_range) {
+    // only the in-memory path has the whole output at hand to pick the range from
+    if (strcmp(input_filename, "-") == 0) {
+      error_and_exit("ERROR: --range cannot be used on stdin input\n");
+    }
+    low_memory    = false;
+    pipelined     = false;
+    direct_output = false; // the range need not start on a page
+  }
+  if (strcmp(input_filename, "-") == 0) {
+    // stdin is decoded as it arrives, with nothing kept to go back and zero-fill
+    if (salvage) {
+      error_and_exit("ERROR: --salvage cannot be used on stdin input\n");
+    }
+    unpack_from_stdin(output_filename);
+    return 0;
+  }
+
+  // A daemon worker serves ranges of blocked files from its block cache
+  if (has_range && block_cache != NULL && !salvage && float_emit == FLOAT_EMIT_FP32 &&
+      unpack_range_from_blocks(input_filename, output_filename, range_start, range_len) == 0) {
+    report_memory(memory_stats);
+    return 0;
+  }
+
+  // Small files are done before the setup below costs more than the unpack itself
+  if (!salvage && !low_memory && !pipelined && !has_range && !memory_stats &&
+      !direct_input && !direct_output && !sparse_output &&
+      unpack_small_file(input_filename, output_filename) == 0) {
+    return 0;
+  }
+
+  if (buffer_pool == NULL) {
+    buffer_pool = buffer_pool_create(BUFFER_POOL_CACHE_LEN, pool_options);
+  }
+
+  if (pipelined && !salvage) {
+    unpack_pipelined(input_filename, output_filename);
+    report_memory(memory_stats);
+    return 0;
+  }
+
+  // Large files don't fit in memory twice over, so stream them through
+  // Salvaging needs whole streams, so it always uses the in-memory path
+  struct stat st;
+  if (!salvage && !has_range && stat(input_filename, &st) == 0 && (uint64_t)st.st_size >= LOW_MEMORY_AUTO_LEN) {
+    low_memory = true;
+  }
+  if (low_memory && !salvage && unpack_low_memory(input_filename, output_filename) == 0) {
+    return 0;
+  }
+
+  // Open input file
+  FILE* input_fd = fopen(input_filename, "r");
+  if (input_fd == NULL) {
+    error_and_exit("ERROR: input file likely does not exist\n");
+  }
+
+  // Determine size of input file
+  int result = stat(input_filename, &st);
+  if (result != 0) {
+    error_and_exit("ERROR: input file likely does not exist\n");
+  }
+  size_t raw_len = st.st_size;
+
+  // Read entire input file contents, checksumming streams as they arrive
+  int direct_fd = direct_input ? open_direct(input_filename, O_RDONLY) : -1;
+  // (O_DIRECT reads whole pages, so may go up to a page past the end)
+  uint8_t* raw_data = buffer_pool_get(buffer_pool, roundup_to_alignment(raw_len, DATA_ALIGN));
+  read_verifier_t verifier;
+  read_and_verify_input(input_fd, direct_fd, raw_data, raw_len, &verifier);
+  fclose(input_fd);
+  if (direct_fd >= 0) {
+    close(direct_fd);
+  }
+
+  // Attempt to parse the initial header to see if it's valid
+  // If so, we'll analyze the file and determine the total number of streams
+  // If it's not valid, there's no point in doing more work, just error immediately
+  packlab_config_t initial_config = {0};
+  parse_header(raw_data, raw_len, &initial_config);
+  if (!initial_config.is_valid) {
+    error_and_exit("ERROR: header is invalid\n");
+  }
+  if (initial_config.header_len > MAX_HEADER_SIZE || initial_config.header_len == 0) {
+    error_and_exit("ERROR: header length is invalid\n");
+  }
+
+  // Now find the streamsa to prepare for student
+  // processing. The only supported formats here are:
+  //    normal - single stream
+  //    f2     - 2 streams, floats, with 8 bit exponent stream and 24 bit sign+mantissa
+  //    f3     - 3 streams, floats, with 8 bit exponent stream, 23 bit mantissa stream, 1 bit sign stream
+  //    d2, d3 - 2 or 3 streams, doubles (EXT_FLAG_FLOAT64), with 16 bit sign+exponent stream
+
+  uint64_t num_streams = MAX_STREAMS;
+  uint64_t offsets[MAX_STREAMS+1];     // byte offset to header of stream k, plus final offset and end of data
+  uint64_t orig_sizes[MAX_STREAMS];    // size of the original data in streak k
+  uint64_t stored_sizes[MAX_STREAMS];  // size of the stored data in streak k
+
+  if (analyze_streams(raw_data, raw_len, &num_streams, offsets, orig_sizes, stored_sizes)) {
+    error_and_exit("ERROR: cannot analyze streams\n");
+  }
+  check_float_emit(num_streams, initial_config.is_float64);
+
+  // Final offset is at the end of the input data
+  offsets[num_streams] = raw_len;
+
+  // now we will generate space for storing the output data, and space for the
+  // final result this setup is generalized, though the later code will only
+  // handle the 1 stream raw, and 2 or 3 stream float formats
+
+  // (each is filled in, and sized, as its stream is decoded)
+  uint8_t* output_data[num_streams];
+
+  // FP assumptions here
+  uint64_t final_output_size = 0;
+  if (num_streams == 1) {
+    final_output_size = orig_sizes[0];
+  } else if (num_streams == 2 || num_streams == 3) {
+    // "exponent stream" size (2 bytes per double, 1 per float)
+    final_output_size = initial_config.is_float64 ? 8 * (orig_sizes[1] / FLOAT64_SIGNEXP_LEN) : 4 * orig_sizes[1];
+    if (float_emit != FLOAT_EMIT_FP32) {
+      final_output_size = 2 * orig_sizes[1];
+    }
+  } else {
+    error_and_exit("ERROR: have too many streams\n");
+  }
+
+  // total blocks that --salvage had to zero-fill
+  uint64_t total_corrupt = 0;
+
+  // now reconstruct each stream
+  for (uint64_t stream = 0; stream < num_streams; stream++) {
+    // Create a zero'd out configuration
+    packlab_config_t config = {0};
+
+    uint8_t* input_data = &raw_data[offsets[stream]];
+    uint64_t input_len  = offsets[stream + 1] - offsets[stream];
+
+    // Parse the header to determine the packed file's configuration
+    parse_header(input_data, input_len, &config);
+    check_stream_config(stream, &config, input_len);
+
+    uint64_t data_offset = stream_data_offset(&config);
+    size_t data_len      = stored_sizes[stream];
+    uint8_t* stored_data = &input_data[data_offset];
+
+    // Check every block on its own first, so damage can be pinpointed
+    uint64_t num_corrupt  = 0;
+    bool* corrupt_blocks  = NULL;
+    uint8_t* block_table  = &stored_data[data_len];
+    if (config.has_block_checksums) {
+      uint64_t table_len = block_table_len(&config);
+      if (data_offset + data_len > input_len || table_len > input_len - data_offset - data_len) {
+        error_and_exit("ERROR: input stream is shorter than expected\n");
+      }
+
+      uint64_t num_blocks = block_count(&config);
+      corrupt_blocks = malloc_and_check(num_blocks * sizeof(bool));
+      num_corrupt = verify_blocks(&config, stored_data, block_table, corrupt_blocks);
+
+      uint64_t decoded_offset = 0;
+      for (uint64_t block = 0; block < num_blocks; block++) {
+        uint32_t expected_crc32c = 0;
+        uint32_t decoded_len     = 0;
+        read_block_entry(block_table, block, &expected_crc32c, &decoded_len);
+        if (corrupt_blocks[block]) {
+          uint64_t start = offsets[stream] + data_offset + block * config.block_size;
+          uint64_t len   = (data_len - block * config.block_size < config.block_size) ?
+                           data_len - block * config.block_size : config.block_size;
+          fprintf(stderr, "%s: stream %lu block %lu is corrupt (file bytes %lu-%lu, stream bytes %lu-%lu)\n",
+                  salvage ? "WARNING" : "ERROR", stream, block, start, start + len - 1,
+                  decoded_offset, decoded_offset + decoded_len - 1);
+        }
+        decoded_offset += decoded_len;
+      }
+      if (num_corrupt > 0 && !salvage) {
+        error_and_exit("ERROR: stream has corrupt blocks (use --salvage to extract the intact ones)\n");
+      }
+      total_corrupt += num_corrupt;
+    }
+
+    // Use the checksums computed while reading, if they cover this stream
+    // (they always should, unless the file's layout is broken)
+    bool verified_on_read = stream < verifier.num_streams &&
+                            verifier.data_start[stream] == offsets[stream] + data_offset &&
+                            verifier.data_end[stream] == offsets[stream] + data_offset + data_len;
+    bool verify = (config.is_checksummed || config.is_crc32c) && !verified_on_read;
+
+    // The stored data is checked before any password is asked for, so a
+    // damaged file is reported as such instead of prompting first. That
+    // takes a pass of its own only for an encrypted stream the read missed;
+    // any other stream is checked in the decode pass below
+    // (when salvaging, the whole-stream checks are already known to fail)
+    if (verified_on_read && num_corrupt == 0) {
+      check_stream_checksums(&config, checksum_final(&verifier.checksum[stream]), verifier.crc32c[stream]);
+    } else if (verify && config.is_encrypted) {
+      checksum_state_t checksum;
+      checksum_init(&checksum);
+      checksum_update(&checksum, stored_data, data_len);
+      uint32_t crc32c = config.is_crc32c ? crc32c_update(0, stored_data, data_len) : 0;
+      if (num_corrupt == 0) {
+        check_stream_checksums(&config, checksum_final(&checksum), crc32c);
+      }
+      verify = false;
+    }
+
+    // Get the key before starting, so the pass below never stops for input
+    uint16_t encryption_key = 0;
+    if (config.is_encrypted) {
+      encryption_key = get_encryption_key();
+    }
+
+    // Each stream needs just one buffer, of its final size
+    // Blocked streams are decoded block by block from the input itself, so
+    // they are only decrypted (in place) here. Everything else is verified,
+    // decrypted and decompressed in one pass, by the loop made for its flags
+    bool by_blocks = config.has_block_checksums && (config.is_compressed || num_corrupt > 0);
+    output_data[stream] = buffer_pool_get(buffer_pool, orig_sizes[stream]);
+
+    stream_decoder_state_t state;
+    stream_decoder_init(&state, &config, encryption_key);
+    if (keystream_cache != NULL && config.is_encrypted) {
+      state.keystream = keystream_cache_get(keystream_cache, encryption_key);
+    }
+    stream_decoder_t decode = stream_decoder_select(config.is_compressed && !by_blocks,
+                                                    config.is_encrypted, verify);
+    size_t output_len = by_blocks ? decode(stored_data, data_len, stored_data, data_len, &state) :
+                                    decode(stored_data, data_len, output_data[stream], orig_sizes[stream], &state);
+    if (verify && num_corrupt == 0) {
+      check_stream_checksums(&config, checksum_final(&state.checksum), state.crc32c);
+    }
+
+    // Handle blocked streams, which get decompressed (or salvaged) block by block
+    if (by_blocks) {
+      output_len = decode_blocks(&config, stored_data, block_table, corrupt_blocks, output_data[stream],
+                                 orig_sizes[stream]);
+    }
+
+    // check for size mis-matches
+    if (!state.complete || output_len != orig_sizes[stream]) {
+      error_and_exit("ERROR: reconstructed stream is wrong length\n");
+    }
+
+    // Put back the float values that were stored as deltas (or XORs)
+    undo_float_transform(output_data[stream], output_len, float_value_len(stream), config.float_transform, 0);
+
+    free(corrupt_blocks);
+  }
+
+  // Handle floating point streams, if any
+  // A single stream is already the final output
+  uint8_t* final_output_data = output_data[0];
+  if (num_streams > 1) {
+    final_output_data = buffer_pool_get(buffer_pool, final_output_size);
+    memset(final_output_data, 0, final_output_size);
+  }
+
+  if (num_streams == 1) {
+    // nothing to join
+
+  } else if (num_streams == 2 || num_streams == 3) {
+    // there can't be any size error here, so this will always work
+    join_streams(num_streams, initial_config.is_float64, output_data, orig_sizes,
+                 final_output_data, final_output_size);
+
+  } else {
+    error_and_exit("ERROR: impossible number of streams at reconstruction\n");
+  }
+
+  // Cleanup
+  if (num_streams > 1) {
+    for (uint64_t stream = 0; stream < num_streams; stream++) {
+      buffer_pool_put(buffer_pool, output_data[stream]);
+    }
+  }
+
+  // Pick out the requested range, if any
+  uint8_t* write_data = final_output_data;
+  uint64_t write_len  = final_output_size;
+  if (has_range) {
+    if (range_start > final_output_size || range_len > final_output_size - range_start) {
+      error_and_exit("ERROR: --range is past the end of the unpacked data\n");
+    }
+    write_data = &final_output_data[range_start];
+    write_len  = range_len;
+  }
+
+  // Create output file
+  // This is done late in the process in case the input was invalid
+  FILE* output_fd = fopen(output_filename, "w");
+  if (output_fd == NULL) {
+    error_and_exit("ERROR: could not open output file\n");
+  }
+
+  // Write data to output file
+  int direct_output_fd = direct_output ? open_direct(output_filename, O_WRONLY) : -1;
+  if (!write_output(fileno(output_fd), direct_output_fd, write_data, write_len)) {
+    error_and_exit("ERROR: could not write output file data\n");
+  }
+  if (direct_output_fd >= 0) {
+    close(direct_output_fd);
+  }
+  fclose(output_fd);
+  buffer_pool_put(buffer_pool, final_output_data);
+  buffer_pool_put(buffer_pool, raw_data);
+  report_memory(memory_stats);
+
+  if (total_corrupt > 0) {
+    fprintf(stderr, "WARNING: %lu corrupt blocks were zero-filled\n", total_corrupt);
+    return EXIT_SALVAGED;
+  }
+  return 0;
+}
+
+
+// Sets up a daemon worker, whose buffers, keystreams and decoded blocks stay
+// warm across requests
+static void start_daemon_worker(void) {
+  buffer_pool     = buffer_pool_create(BUFFER_POOL_CACHE_LEN, 0);
+  keystream_cache = keystream_cache_create();
+  block_cache     = block_cache_create(DAEMON_BLOCK_CACHE_LEN);
+}
+
+// Helper function: has the daemon on `socket_path` run this unpack
+// The input is opened here, so it is read with this user's access, and the
+// output is named by an absolute path, since the daemon has its own directory
+// Returns false, without doing anything, if no daemon is listening
+static bool unpack_through_daemon(const char* socket_path, int argc, char* argv[], int* exit_status) {
+  char* request_argv[argc + 1];
+  memcpy(request_argv, argv, argc * sizeof(char*));
+  request_argv[argc] = NULL;
+
+  int input_fd = -1;
+  char input_arg[] = UNPACKD_FD_PREFIX "3";
+  char output_path[PATH_MAX];
+  if (argc >= 3 && strncmp(argv[argc - 2], "--", 2) != 0 && strncmp(argv[argc - 1], "--", 2) != 0) {
+    char* input_filename  = argv[argc - 2];
+    char* output_filename = argv[argc - 1];
+    if (strcmp(input_filename, output_filename) == 0) {
+      error_and_exit("ERROR: input and output filename match\n");
+    }
+
+    // stdin ("-") goes along anyway
+    if (strcmp(input_filename, "-") != 0) {
+      input_fd = open(input_filename, O_RDONLY | O_CLOEXEC);
+      if (input_fd < 0) {
+        error_and_exit("ERROR: input file likely does not exist\n");
+      }
+      request_argv[argc - 2] = input_arg;
+    }
+
+    char cwd[PATH_MAX];
+    if (output_filename[0] != '/' && getcwd(cwd, sizeof(cwd)) != NULL &&
+        snprintf(output_path, sizeof(output_path), "%s/%s", cwd, output_filename) < (int)sizeof(output_path)) {
+      request_argv[argc - 1] = output_path;
+    }
+  }
+
+  unpackd_result_t result;
+  bool served = unpackd_request(socket_path, argc, request_argv, input_fd, -1, &result);
+  if (input_fd >= 0) {
+    close(input_fd);
+  }
+  if (!served) {
+    return false;
+  }
+
+  if (argc == 2 && strcmp(argv[1], "--daemon-stats") == 0) {
+    unpackd_print_stats(&result.stats, stdout);
+  }
+  *exit_status = result.exit_status;
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  // --list and --info only read headers, so they never need a daemon
+  if (argc >= 2 && (strcmp(argv[1], "--list") == 0 || strcmp(argv[1], "--info") == 0)) {
+    return list_archives(argc, argv);
+  }
+
+  // --daemon=SOCKET serves unpack requests until stopped
+  if (argc >= 2 && strncmp(argv[1], "--daemon=", strlen("--daemon=")) == 0) {
+    unsigned workers = DEFAULT_DAEMON_WORKERS;
+    if (argc > 3 || (argc == 3 && sscanf(argv[2], "--workers=%u", &workers) != 1)) {
+      usage_and_exit(argv[0]);
+    }
+    unpackd_serve(&argv[1][strlen("--daemon=")], workers, start_daemon_worker, run_unpack);
+    return 0;
+  }
+
+  // --connect=SOCKET hands the unpack to a daemon, which must be running
+  if (argc >= 2 && strncmp(argv[1], "--connect=", strlen("--connect=")) == 0) {
+    char* socket_path = &argv[1][strlen("--connect=")];
+    argv[1] = argv[0];
+    int exit_status = 1;
+    if (!unpack_through_daemon(socket_path, argc - 1, &argv[1], &exit_status)) {
+      error_and_exit("ERROR: no unpackd is listening on that socket\n");
+    }
+    return exit_status;
+  }
+
+  // so does naming a socket in the environment, but without a daemon the unpack happens here
+  char* socket_path = getenv(UNPACKD_ENV);
+  int exit_status = 0;
+  if (socket_path != NULL && socket_path[0] != '\0' &&
+      unpack_through_daemon(socket_path, argc, argv, &exit_status)) {
+    return exit_status;
+  }
+  return run_unpack(argc, argv);
+}
@@ -0,0 +1,530 @@
+// Long-lived unpack daemon on a Unix domain socket, and its client
+// PackLab - CS213 - Northwestern University
+
+#define _GNU_SOURCE // accept4, SOCK_CLOEXEC, MSG_CMSG_CLOEXEC
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unpackd.h"
+#include "unpack-utilities.h"
+
+#define REQUEST_MAGIC  0x02130041u
+#define PASSWORD_LEN   80
+#define STATS_REQUEST  "--daemon-stats" // asks for the counters instead of running unpack
+#define LISTEN_BACKLOG 128
+
+
+// One request, sent as a single message with its descriptors attached
+typedef struct {
+  uint32_t magic;
+  uint32_t num_fds;
+  uint32_t args_len;
+  bool has_password; // the client's PACKLAB_PASSWORD, which the worker runs with
+  char password[PASSWORD_LEN];
+  char args[UNPACKD_ARGS_LEN];
+} request_t;
+
+// Counters shared by every worker process (lock-free atomics work across processes)
+typedef struct {
+  _Atomic uint64_t requests;
+  _Atomic uint64_t failures;
+  _Atomic uint64_t in_flight;
+  _Atomic uint64_t workers_started;
+  _Atomic uint64_t input_bytes;
+  _Atomic uint64_t output_bytes;
+  _Atomic uint64_t total_ns;
+  _Atomic uint64_t max_ns;
+  _Atomic uint64_t latency_buckets[UNPACKD_LATENCY_BUCKETS];
+
+  // whether each worker is partway through a request, so the daemon can count
+  // a request as failed if its worker dies
+  _Atomic bool busy[UNPACKD_MAX_WORKERS];
+} shared_stats_t;
+
+// State of the request a worker is running, for finishing it from an exit handler
+typedef struct {
+  int conn_fd; // -1 when idle
+  unsigned worker;
+  uint64_t start_ns;
+  uint64_t input_bytes;
+  char* output_path;
+  int saved_fds[3];
+} worker_state_t;
+
+static shared_stats_t* shared = NULL;
+static worker_state_t current = { .conn_fd = -1 };
+static volatile sig_atomic_t stopping = 0;
+
+
+// --- helper functions ---
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void take_snapshot(unpackd_stats_t* stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->requests        = atomic_load(&shared->requests);
+  stats->failures        = atomic_load(&shared->failures);
+  stats->in_flight       = atomic_load(&shared->in_flight);
+  stats->workers_started = atomic_load(&shared->workers_started);
+  stats->input_bytes     = atomic_load(&shared->input_bytes);
+  stats->output_bytes    = atomic_load(&shared->output_bytes);
+  stats->total_ns        = atomic_load(&shared->total_ns);
+  stats->max_ns          = atomic_load(&shared->max_ns);
+  for (int b = 0; b < UNPACKD_LATENCY_BUCKETS; b++) {
+    stats->latency_buckets[b] = atomic_load(&shared->latency_buckets[b]);
+  }
+}
+
+static void record_latency(uint64_t elapsed_ns) {
+  atomic_fetch_add(&shared->total_ns, elapsed_ns);
+  uint64_t max = atomic_load(&shared->max_ns);
+  while (elapsed_ns > max && !atomic_compare_exchange_weak(&shared->max_ns, &max, elapsed_ns)) {
+  }
+
+  uint64_t us = elapsed_ns / 1000;
+  int bucket = 0;
+  while (us > 1 && bucket < UNPACKD_LATENCY_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  atomic_fetch_add(&shared->latency_buckets[bucket], 1);
+}
+
+static uint64_t file_size(const char* path) {
+  struct stat st;
+  if (path == NULL || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+  return (uint64_t)st.st_size;
+}
+
+// Puts the worker's own stdin/stdout/stderr back after a request
+static void restore_stdio(void) {
+  fflush(stdout);
+  fflush(stderr);
+  clearerr(stdin);
+  for (int fd = 0; fd < 3; fd++) {
+    dup2(current.saved_fds[fd], fd);
+  }
+}
+
+// Records the end of the current request and tells the client how it went
+static void finish_request(int exit_status) {
+  uint64_t elapsed = now_ns() - current.start_ns;
+  restore_stdio();
+
+  unpackd_result_t result;
+  memset(&result, 0, sizeof(result));
+  result.exit_status = exit_status;
+  result.elapsed_ns  = elapsed;
+  result.input_bytes = current.input_bytes;
+  if (exit_status == 0) {
+    result.output_bytes = file_size(current.output_path);
+  }
+
+  atomic_fetch_add(&shared->requests, 1);
+  if (exit_status != 0) {
+    atomic_fetch_add(&shared->failures, 1);
+  }
+  atomic_fetch_add(&shared->input_bytes, result.input_bytes);
+  atomic_fetch_add(&shared->output_bytes, result.output_bytes);
+  record_latency(elapsed);
+  atomic_fetch_sub(&shared->in_flight, 1);
+  atomic_store(&shared->busy[current.worker], false);
+  take_snapshot(&result.stats);
+
+  send(current.conn_fd, &result, sizeof(result), MSG_NOSIGNAL);
+  close(current.conn_fd);
+  current.conn_fd = -1;
+}
+
+// Whatever exits the worker mid-request (error_and_exit, usage errors) still answers the client
+static void finish_on_exit(void) {
+  if (current.conn_fd >= 0) {
+    finish_request(1);
+  }
+}
+
+// Receives a request message and its descriptors
+// Returns the number of descriptors, or -1 if the message is unusable
+static int receive_request(int conn_fd, request_t* request, int* fds) {
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(UNPACKD_MAX_FDS * sizeof(int))];
+  } control;
+  struct iovec iov = { .iov_base = request, .iov_len = sizeof(*request) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.space;
+  msg.msg_controllen = sizeof(control.space);
+
+  ssize_t got = recvmsg(conn_fd, &msg, MSG_CMSG_CLOEXEC);
+  int num_fds = 0;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      int count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+      for (int i = 0; i < count && num_fds < UNPACKD_MAX_FDS; i++) {
+        memcpy(&fds[num_fds++], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+      }
+    }
+  }
+
+  if (got != (ssize_t)sizeof(*request) || request->magic != REQUEST_MAGIC ||
+      request->num_fds != (uint32_t)num_fds || num_fds < 3 ||
+      request->args_len == 0 || request->args_len > UNPACKD_ARGS_LEN ||
+      request->args[request->args_len - 1] != '\0' || (msg.msg_flags & MSG_CTRUNC)) {
+    for (int i = 0; i < num_fds; i++) {
+      close(fds[i]);
+    }
+    return -1;
+  }
+  return num_fds;
+}
+
+static void serve_connection(int conn_fd, unsigned worker, unpackd_handler_t handler) {
+  request_t request;
+  int fds[UNPACKD_MAX_FDS];
+  int num_fds = receive_request(conn_fd, &request, fds);
+  if (num_fds < 0) {
+    close(conn_fd);
+    return;
+  }
+
+  // attached files are reached through /proc, so the unpack code can keep using paths
+  char* argv[UNPACKD_ARGS_LEN / 2];
+  int argc = unpackd_unpack_args(request.args, request.args_len, argv, UNPACKD_ARGS_LEN / 2 - 1);
+  char fd_paths[UNPACKD_MAX_FDS][32];
+  for (int i = 0; i < argc; i++) {
+    int index = -1;
+    if (strncmp(argv[i], UNPACKD_FD_PREFIX, strlen(UNPACKD_FD_PREFIX)) == 0) {
+      index = atoi(&argv[i][strlen(UNPACKD_FD_PREFIX)]);
+    }
+    if (index >= 3 && index < num_fds) {
+      snprintf(fd_paths[index], sizeof(fd_paths[index]), "/proc/self/fd/%d", fds[index]);
+      argv[i] = fd_paths[index];
+    }
+  }
+  argv[argc] = NULL;
+
+  current.conn_fd     = conn_fd;
+  current.worker      = worker;
+  current.start_ns    = now_ns();
+  current.input_bytes = (argc >= 3) ? file_size(argv[argc - 2]) : 0;
+  current.output_path = (argc >= 3) ? argv[argc - 1] : NULL;
+  atomic_fetch_add(&shared->in_flight, 1);
+  atomic_store(&shared->busy[worker], true);
+
+  int status = 0;
+  if (argc == 2 && strcmp(argv[1], STATS_REQUEST) == 0) {
+    // nothing to run; the counters go back with the result
+    current.input_bytes = 0;
+    current.output_path = NULL;
+  } else {
+    if (request.has_password) {
+      request.password[PASSWORD_LEN - 1] = '\0';
+      setenv("PACKLAB_PASSWORD", request.password, 1);
+    } else {
+      unsetenv("PACKLAB_PASSWORD");
+    }
+    for (int fd = 0; fd < 3; fd++) {
+      dup2(fds[fd], fd);
+    }
+    status = handler(argc, argv);
+  }
+
+  finish_request(status);
+  unsetenv("PACKLAB_PASSWORD");
+  memset(request.password, 0, sizeof(request.password));
+  for (int i = 0; i < num_fds; i++) {
+    close(fds[i]);
+  }
+}
+
+static void run_worker(int listen_fd, unsigned worker, unpackd_worker_init_t worker_init,
+                       unpackd_handler_t handler) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  for (int fd = 0; fd < 3; fd++) {
+    current.saved_fds[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+  }
+  atexit(finish_on_exit);
+  atomic_fetch_add(&shared->workers_started, 1);
+  if (worker_init != NULL) {
+    worker_init();
+  }
+
+  while (true) {
+    int conn_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn_fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      error_and_exit("ERROR: unpackd worker could not accept a connection\n");
+    }
+    serve_connection(conn_fd, worker, handler);
+  }
+}
+
+static pid_t spawn_worker(int listen_fd, unsigned worker, unpackd_worker_init_t worker_init,
+                          unpackd_handler_t handler) {
+  pid_t pid = fork();
+  if (pid < 0) {
+    error_and_exit("ERROR: unpackd could not start a worker\n");
+  }
+  if (pid == 0) {
+    run_worker(listen_fd, worker, worker_init, handler);
+    exit(0);
+  }
+  return pid;
+}
+
+static void handle_stop(int signal_number) {
+  (void)signal_number;
+  stopping = 1;
+}
+
+static bool fill_address(const char* socket_path, struct sockaddr_un* address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(address->sun_path)) {
+    return false;
+  }
+  strcpy(address->sun_path, socket_path);
+  return true;
+}
+
+
+// --- public functions ---
+
+void unpackd_serve(const char* socket_path, unsigned num_workers,
+                   unpackd_worker_init_t worker_init, unpackd_handler_t handler) {
+  if (num_workers == 0 || num_workers > UNPACKD_MAX_WORKERS) {
+    error_and_exit("ERROR: unpackd worker count is out of range\n");
+  }
+  struct sockaddr_un address;
+  if (!fill_address(socket_path, &address)) {
+    error_and_exit("ERROR: unpackd socket path is too long\n");
+  }
+
+  int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    error_and_exit("ERROR: unpackd could not create its socket\n");
+  }
+  // a socket file left by a daemon that is gone can be replaced; a live one cannot
+  if (connect(listen_fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+    error_and_exit("ERROR: an unpackd is already listening on that socket\n");
+  }
+  close(listen_fd);
+  unlink(socket_path);
+
+  listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  mode_t old_mask = umask(0077); // only this user may send requests
+  int bound = bind(listen_fd, (struct sockaddr*)&address, sizeof(address));
+  umask(old_mask);
+  if (bound != 0 || listen(listen_fd, LISTEN_BACKLOG) != 0) {
+    error_and_exit("ERROR: unpackd could not listen on its socket\n");
+  }
+
+  shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    error_and_exit("ERROR: malloc failed\n");
+  }
+  memset(shared, 0, sizeof(*shared));
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_stop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  pid_t workers[UNPACKD_MAX_WORKERS];
+  for (unsigned w = 0; w < num_workers; w++) {
+    workers[w] = spawn_worker(listen_fd, w, worker_init, handler);
+  }
+  fprintf(stderr, "unpackd: listening on %s with %u workers\n", socket_path, num_workers);
+
+  // replace workers that die, until told to stop
+  while (!stopping) {
+    int status = 0;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      continue;
+    }
+    for (unsigned w = 0; w < num_workers; w++) {
+      if (workers[w] != pid) {
+        continue;
+      }
+      if (atomic_exchange(&shared->busy[w], false)) {
+        // died without answering (e.g. a crash): the client just sees the socket close
+        atomic_fetch_add(&shared->requests, 1);
+        atomic_fetch_add(&shared->failures, 1);
+        atomic_fetch_sub(&shared->in_flight, 1);
+      }
+      if (!stopping) {
+        workers[w] = spawn_worker(listen_fd, w, worker_init, handler);
+      }
+    }
+  }
+
+  for (unsigned w = 0; w < num_workers; w++) {
+    kill(workers[w], SIGTERM);
+  }
+  while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+  }
+  close(listen_fd);
+  unlink(socket_path);
+
+  unpackd_stats_t stats;
+  take_snapshot(&stats);
+  unpackd_print_stats(&stats, stderr);
+  munmap(shared, sizeof(*shared));
+}
+
+bool unpackd_request(const char* socket_path, int argc, char** argv, int input_fd, int output_fd,
+                     unpackd_result_t* result) {
+  struct sockaddr_un address;
+  if (!fill_address(socket_path, &address)) {
+    return false;
+  }
+  int conn_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (conn_fd < 0) {
+    return false;
+  }
+  if (connect(conn_fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    close(conn_fd);
+    return false;
+  }
+
+  request_t* request = malloc_and_check(sizeof(*request));
+  memset(request, 0, sizeof(*request));
+  request->magic    = REQUEST_MAGIC;
+  request->args_len = (uint32_t)unpackd_pack_args(argc, argv, request->args, sizeof(request->args));
+  if (request->args_len == 0) {
+    error_and_exit("ERROR: arguments are too long to send to unpackd\n");
+  }
+  const char* password = getenv("PACKLAB_PASSWORD");
+  if (password != NULL) {
+    request->has_password = true;
+    strncpy(request->password, password, PASSWORD_LEN - 1);
+  }
+
+  int fds[UNPACKD_MAX_FDS] = { 0, 1, 2 };
+  int num_fds = 3;
+  if (input_fd >= 0) {
+    fds[num_fds++] = input_fd;
+  }
+  if (output_fd >= 0) {
+    fds[num_fds++] = output_fd;
+  }
+  request->num_fds = (uint32_t)num_fds;
+
+  union {
+    struct cmsghdr header;
+    char space[CMSG_SPACE(UNPACKD_MAX_FDS * sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec iov = { .iov_base = request, .iov_len = sizeof(*request) };
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov        = &iov;
+  msg.msg_iovlen     = 1;
+  msg.msg_control    = control.space;
+  msg.msg_controllen = CMSG_SPACE(num_fds * sizeof(int));
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type  = SCM_RIGHTS;
+  cmsg->cmsg_len   = CMSG_LEN(num_fds * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, num_fds * sizeof(int));
+
+  memset(result, 0, sizeof(*result));
+  bool sent = sendmsg(conn_fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(*request);
+  memset(request, 0, sizeof(*request));
+  free(request);
+
+  ssize_t got = sent ? recv(conn_fd, result, sizeof(*result), 0) : -1;
+  while (got < 0 && errno == EINTR) {
+    got = recv(conn_fd, result, sizeof(*result), 0);
+  }
+  if (got != (ssize_t)sizeof(*result)) {
+    fprintf(stderr, "ERROR: unpackd dropped the request\n");
+    memset(result, 0, sizeof(*result));
+    result->exit_status = 1;
+  }
+  close(conn_fd);
+  return true;
+}
+
+size_t unpackd_pack_args(int argc, char** argv, char* buffer, size_t buffer_len) {
+  size_t len = 0;
+  for (int i = 0; i < argc; i++) {
+    size_t arg_len = strlen(argv[i]) + 1;
+    if (arg_len > buffer_len - len) {
+      return 0;
+    }
+    memcpy(&buffer[len], argv[i], arg_len);
+    len += arg_len;
+  }
+  return len;
+}
+
+int unpackd_unpack_args(char* buffer, size_t len, char** argv, int max_args) {
+  int argc = 0;
+  size_t pos = 0;
+  while (pos < len && argc < max_args) {
+    argv[argc++] = &buffer[pos];
+    pos += strlen(&buffer[pos]) + 1;
+  }
+  return argc;
+}
+
+void unpackd_print_stats(unpackd_stats_t* stats, FILE* out) {
+  uint64_t completed = 0;
+  for (int b = 0; b < UNPACKD_LATENCY_BUCKETS; b++) {
+    completed += stats->latency_buckets[b];
+  }
+
+  // percentiles to the histogram's resolution: the upper edge of the bucket they fall in
+  uint64_t p50_us = 0;
+  uint64_t p99_us = 0;
+  uint64_t seen = 0;
+  for (int b = 0; b < UNPACKD_LATENCY_BUCKETS && completed > 0; b++) {
+    seen += stats->latency_buckets[b];
+    if (p50_us == 0 && seen * 2 >= completed) {
+      p50_us = (uint64_t)2 << b;
+    }
+    if (p99_us == 0 && seen * 100 >= completed * 99) {
+      p99_us = (uint64_t)2 << b;
+    }
+  }
+
+  double seconds = stats->total_ns / 1e9;
+  fprintf(out, "unpackd: %lu requests, %lu failed, %lu in flight, %lu workers started\n",
+          stats->requests, stats->failures, stats->in_flight, stats->workers_started);
+  fprintf(out, "unpackd: latency mean %.3f ms, p50 <%lu us, p99 <%lu us, max %.3f ms\n",
+          completed ? stats->total_ns / 1e6 / completed : 0.0, p50_us, p99_us, stats->max_ns / 1e6);
+  fprintf(out, "unpackd: %lu KB in, %lu KB out, %.1f MB/s output while busy\n",
+          stats->input_bytes >> 10, stats->output_bytes >> 10,
+          seconds > 0 ? stats->output_bytes / 1e6 / seconds : 0.0);
+}
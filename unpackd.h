@@ -0,0 +1,77 @@
+// Long-lived unpack daemon on a Unix domain socket, and its client
+// PackLab - CS213 - Northwestern University
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>  // FILE
+#include <stdint.h> // fixed_width ints
+#include <stdlib.h> // size_t
+
+// Definitions
+#define UNPACKD_ENV          "PACKLAB_UNPACKD" // socket path that makes plain `unpack` use the daemon
+#define UNPACKD_MAX_WORKERS  64
+#define UNPACKD_ARGS_LEN     4096 // room for the NUL-separated arguments of one request
+#define UNPACKD_MAX_FDS      5    // stdin, stdout, stderr, and optionally the input and output files
+#define UNPACKD_FD_PREFIX    "fd:" // an argument "fd:N" names attached descriptor N instead of a path
+#define UNPACKD_LATENCY_BUCKETS 32 // request latency histogram: bucket b counts [2^b, 2^(b+1)) microseconds
+
+
+// Counters across every request the daemon has run
+typedef struct {
+  uint64_t requests;
+  uint64_t failures;  // requests that exited nonzero (including workers lost mid-request)
+  uint64_t in_flight;
+  uint64_t workers_started;
+
+  uint64_t input_bytes;
+  uint64_t output_bytes;
+  uint64_t total_ns;   // summed request latency
+  uint64_t max_ns;
+  uint64_t latency_buckets[UNPACKD_LATENCY_BUCKETS];
+} unpackd_stats_t;
+
+// What happened to one request
+typedef struct {
+  int32_t exit_status;
+  uint64_t elapsed_ns;
+  uint64_t input_bytes;
+  uint64_t output_bytes;
+  unpackd_stats_t stats; // daemon-wide counters as of the end of this request
+} unpackd_result_t;
+
+// Runs one request inside a worker, like `unpack` run with `argv`
+// Descriptors 0-2 are the client's own while it runs. Paths "fd:N" in `argv`
+// have already been turned into paths for the attached descriptors
+// Returns the exit status; exiting the process (e.g. error_and_exit) also counts as failure
+typedef int (*unpackd_handler_t)(int argc, char** argv);
+
+// Called in each worker once, right after it starts
+typedef void (*unpackd_worker_init_t)(void);
+
+
+// Listens on `socket_path` and serves requests with `num_workers` worker
+// processes, each running one request at a time with `handler`
+// Workers persist between requests, so whatever they keep (buffers, caches)
+// stays warm. A worker that exits mid-request is replaced
+// Returns only after SIGINT or SIGTERM, once the workers are stopped
+void unpackd_serve(const char* socket_path, unsigned num_workers,
+                   unpackd_worker_init_t worker_init, unpackd_handler_t handler);
+
+// Sends a request to the daemon at `socket_path`: `argv` as unpack would take
+// it, with the caller's stdin, stdout and stderr (and `input_fd`/`output_fd`
+// unless -1, named by "fd:N" arguments) attached
+// Returns false if there is no daemon to talk to; otherwise fills in `result`
+bool unpackd_request(const char* socket_path, int argc, char** argv, int input_fd, int output_fd,
+                     unpackd_result_t* result);
+
+// Packs `argc` arguments into `buffer` as NUL-separated strings
+// Returns the length used, or 0 if they do not fit
+size_t unpackd_pack_args(int argc, char** argv, char* buffer, size_t buffer_len);
+
+// Splits packed arguments back up, pointing into `buffer`, which must end with a NUL
+// Returns the number of arguments, at most `max_args`
+int unpackd_unpack_args(char* buffer, size_t len, char** argv, int max_args);
+
+// Prints the daemon-wide counters, including latency percentiles
+void unpackd_print_stats(unpackd_stats_t* stats, FILE* out);